@@ -0,0 +1,119 @@
+# Lexer specification. build_misc.py turns this into src/lex/token_ids.h,
+# which numbers every operator and word the lexer recognises, and
+# src/lex/lex_tables.h, which holds the character class table, the operator DFA
+# and the word table.
+#
+# class NAME CHARS...
+#     Put characters in a character class. Each of CHARS is a single character,
+#     a range such as a-z, or one of the escapes \s (space), \t, \n, \v, \f,
+#     \r. Characters not in any class are in class OTHER.
+#
+# oper SPELLING NAME
+#     Declare an operator. The lexer takes the longest operator matching the
+#     text. Every character of an operator must be in class OPER or SLASH.
+#     The operator's token ID is TOK_NAME.
+#
+# keyword WORDS...
+# word WORDS...
+#     Give each word a token ID, TOK_WORD in upper case. 'keyword' is for
+#     reserved words, and 'word' for words which only mean something in
+#     context, and may still be used as names.
+#
+# type NAME SIZE ENCODING
+#     Declare a builtin type name, which is reserved like a keyword and gets a
+#     token ID the same way. SIZE is in bytes, or 'ptr' for the size of a
+#     pointer on the target; ENCODING is a value of enum type_encoding. Names
+#     which are not primitives (var, void) are pointer-sized OBJECTs.
+#
+# Every keyword, type name and contextual word goes into one perfect hash
+# table, src/keyword_tables.h; the type sizes and encodings go into
+# src/types/builtin_types.h.
+
+class SPACE   \s \t \n \v \f \r
+class DIGIT   0-9
+class WORD    a-z A-Z _
+class AT      @
+class DOLLAR  $
+class QUOTE   "
+class SLASH   /
+class OPER    + - ~ * % < > & ^ | ! = ( ) [ ] { } , ; : . ?
+
+oper /      DIV
+oper /=     DIV_ASSIGN
+oper +      PLUS
+oper ++     INC
+oper +=     PLUS_ASSIGN
+oper -      MINUS
+oper --     DEC
+oper -=     MINUS_ASSIGN
+oper ~      COMPL
+oper *      MUL
+oper *=     MUL_ASSIGN
+oper %      MOD
+oper %=     MOD_ASSIGN
+oper %%     FMOD
+oper %%=    FMOD_ASSIGN
+oper <      LT
+oper <=     LE
+oper <<     SHL
+oper <<=    SHL_ASSIGN
+oper >      GT
+oper >=     GE
+oper >>     SHR
+oper >>=    SHR_ASSIGN
+oper &      AND
+oper &&     LAND
+oper &=     AND_ASSIGN
+oper ^      XOR
+oper ^=     XOR_ASSIGN
+oper |      OR
+oper ||     LOR
+oper |=     OR_ASSIGN
+oper !      NOT
+oper !=     NE
+oper !==    NIDENT
+oper =      ASSIGN
+oper ==     EQ
+oper ===    IDENT
+oper (      LPAREN
+oper )      RPAREN
+oper [      LBRACKET
+oper ]      RBRACKET
+oper {      LBRACE
+oper }      RBRACE
+oper ,      COMMA
+oper :      COLON
+oper :=     DECLARE
+oper ;      SEMI
+oper .      DOT
+oper ...    ELLIPSIS
+oper ?      QUESTION
+
+keyword class extern macro
+keyword let const static volatile threadlocal nomangle
+keyword null allowconflict global
+keyword record switch case default if else for
+keyword foreach do while return as true false break continue
+
+type    i8          1       SINT
+type    i16         2       SINT
+type    i32         4       SINT
+type    i64         8       SINT
+type    ssize       ptr     SINT
+type    int         4       SINT
+type    u8          1       UINT
+type    u16         2       UINT
+type    u32         4       UINT
+type    u64         8       UINT
+type    size        ptr     UINT
+type    unsigned    4       UINT
+type    f16         2       FLOAT
+type    f32         4       FLOAT
+type    f64         8       FLOAT
+type    float       4       FLOAT
+type    double      8       FLOAT
+type    var         ptr     OBJECT
+type    void        ptr     OBJECT
+type    bool        1       BOOL
+
+word    executable package import
@@ -0,0 +1,34 @@
+# Expression operator precedence. build_misc.py turns this into
+# src/parse/oper_tables.h, the binding powers for the Pratt expression parser
+# in src/parse/expr.c.
+#
+# Each line is one precedence level, from the loosest to the tightest:
+#
+# infix ASSOC OPERS...
+#     Binary operators, 'left' or 'right' associative.
+# prefix OPERS...
+#     Unary operators before their operand.
+# postfix OPERS...
+#     Operators after their operand. ( [ and . are calls, indexing and member
+#     access; the parser reads what follows them itself.
+#
+# OPERS are spelled as in autogen/lexer.spec, and may be keywords. An operator
+# may be both prefix and infix, or both prefix and postfix, but not infix and
+# postfix. The parser treats ? (the conditional) and 'as' (a cast, whose right
+# operand is a type) specially, but takes their precedence from here.
+
+infix   right   = := += -= *= /= %= %%= <<= >>= &= ^= |=
+infix   right   ?
+infix   left    ||
+infix   left    &&
+infix   left    |
+infix   left    ^
+infix   left    &
+infix   left    == != === !==
+infix   left    < <= > >=
+infix   left    << >>
+infix   left    + -
+infix   left    * / % %%
+infix   left    as
+prefix          + - ! ~ ++ -- & *
+postfix         ++ -- ( [ .
@@ -0,0 +1,395 @@
+/* Copyright (c) 2011, Christopher Pavlina. All rights reserved. */
+
+/* alco-bench: front-end throughput benchmark. Generates each corpus (see
+ * corpus.h), then times lexer_lex () and parse_file () over it in a child
+ * process of its own, so that the peak RSS is the corpus's alone. The results
+ * can be saved as a baseline, and compared against one to catch regressions.
+ *
+ * Allocations are counted by wrapping malloc (), calloc () and realloc () at
+ * link time (see wscript), so they cover the compiler's own calls but not the
+ * C library's. */
+
+#include "corpus.h"
+#include "src/env.h"
+#include "src/error.h"
+#include "src/intern.h"
+#include "src/lex/lex.h"
+#include "src/parse/parse.h"
+#include "src/types/type.h"
+#include <errno.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+static size_t n_allocs;
+
+void *__real_malloc (size_t size);
+void *__real_calloc (size_t n, size_t size);
+void *__real_realloc (void *p, size_t size);
+
+void *
+__wrap_malloc (size_t size)
+{
+    ++n_allocs;
+    return __real_malloc (size);
+}
+
+void *
+__wrap_calloc (size_t n, size_t size)
+{
+    ++n_allocs;
+    return __real_calloc (n, size);
+}
+
+void *
+__wrap_realloc (void *p, size_t size)
+{
+    ++n_allocs;
+    return __real_realloc (p, size);
+}
+
+/* Measurements of one corpus. Rates are per second, from the fastest of the
+ * iterations. */
+struct result {
+    double lex_bytes, lex_tokens;
+    double parse_bytes, parse_nodes;
+    double allocs;
+    double peak_rss_kb;
+};
+
+/* The metrics, for the baseline file. 'higher' is whether a higher value is
+ * better. */
+static const struct {
+    const char *name;
+    size_t offset;
+    int higher;
+} METRICS[] = {
+    {"lex_bytes_per_s", offsetof (struct result, lex_bytes), 1},
+    {"lex_tokens_per_s", offsetof (struct result, lex_tokens), 1},
+    {"parse_bytes_per_s", offsetof (struct result, parse_bytes), 1},
+    {"parse_nodes_per_s", offsetof (struct result, parse_nodes), 1},
+    {"allocs", offsetof (struct result, allocs), 0},
+    {"peak_rss_kb", offsetof (struct result, peak_rss_kb), 0},
+};
+#define N_METRICS (sizeof (METRICS) / sizeof (*METRICS))
+#define METRIC(r, i) (*(double *) ((char *) (r) + METRICS[i].offset))
+
+struct options {
+    double scale;
+    int iterations;
+    double threshold;
+    unsigned seed;
+    const char *dir, *baseline, *save, *gen;
+    int keep;
+};
+
+static double
+now (void)
+{
+    struct timespec ts;
+    clock_gettime (CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static enum ast_visit_result
+count_node (struct ast *ast, size_t depth, void *data)
+{
+    (void) ast;
+    (void) depth;
+    ++*(size_t *) data;
+    return AST_CONTINUE;
+}
+
+/* Every tag counts the same, so every tag gets the same hook */
+static struct ast_visitor count_visitor;
+
+static size_t
+count_nodes (struct ast *ast)
+{
+    size_t n = 0;
+    int tag;
+
+    if (!ast) return 0;
+    if (!count_visitor.pre[0]) {
+        for (tag = 0; tag < AST_N_TAGS; ++tag)
+            count_visitor.pre[tag] = count_node;
+    }
+    ast_visit (ast, &count_visitor, &n);
+    return n;
+}
+
+/* Time the front end over 'path' - in a child process, which writes the
+ * result to 'fd' */
+static void
+measure (const char *path, int iterations, int fd)
+{
+    struct env env;
+    struct lex lex;
+    struct ast *ast;
+    struct result r;
+    double t, best_lex = 0, best_parse = 0;
+    size_t bytes = 0, tokens = 0, nodes = 0, allocs;
+    int i;
+
+    memset (&env, 0, sizeof (env));
+    env.bits = 64;
+    memset (&r, 0, sizeof (r));
+
+    for (i = 0; i < iterations; ++i) {
+        lexer_init (path, &env, &lex);
+        t = now ();
+        lexer_lex (&lex);
+        t = now () - t;
+        if (!i || t < best_lex) best_lex = t;
+        bytes = lex.text_len;
+        tokens = lex.n_tokens;
+        lexer_free (&lex);
+
+        allocs = n_allocs;
+        lexer_init (path, &env, &lex);
+        t = now ();
+        lexer_stream (&lex);
+        ast = parse_file (&lex, &env);
+        t = now () - t;
+        if (!i || t < best_parse) best_parse = t;
+        nodes = count_nodes (ast);
+        free_ast (ast);
+        lexer_free (&lex);
+        r.allocs = n_allocs - allocs;
+    }
+
+    r.lex_bytes = bytes / best_lex;
+    r.lex_tokens = tokens / best_lex;
+    r.parse_bytes = bytes / best_parse;
+    r.parse_nodes = nodes / best_parse;
+    types_free ();
+    intern_free ();
+
+    if (write (fd, &r, sizeof (r)) != sizeof (r))
+        error_errno ();
+}
+
+/* Generate the corpus and run measure () over it in a child */
+static void
+run_corpus (const struct corpus *c, struct options *opts, struct result *r)
+{
+    char path[4096];
+    FILE *f;
+    int fds[2], status;
+    pid_t pid;
+    struct rusage usage;
+
+    snprintf (path, sizeof (path), "%s/alco-bench-%s.al", opts->dir, c->name);
+    f = fopen (path, "w");
+    if (!f) error_message ("%s: %s", path, strerror (errno));
+    corpus_write (c, f, (size_t) (c->default_size * opts->scale), opts->seed);
+    if (fclose (f)) error_message ("%s: %s", path, strerror (errno));
+
+    if (pipe (fds)) error_errno ();
+    fflush (stdout);
+    pid = fork ();
+    if (pid < 0) error_errno ();
+    if (!pid) {
+        close (fds[0]);
+        measure (path, opts->iterations, fds[1]);
+        _exit (0);
+    }
+    close (fds[1]);
+    if (read (fds[0], r, sizeof (*r)) != sizeof (*r))
+        error_message ("benchmark of '%s' failed", c->name);
+    close (fds[0]);
+    if (wait4 (pid, &status, 0, &usage) < 0) error_errno ();
+    if (!WIFEXITED (status) || WEXITSTATUS (status))
+        error_message ("benchmark of '%s' failed", c->name);
+    r->peak_rss_kb = usage.ru_maxrss;
+
+    if (!opts->keep)
+        remove (path);
+}
+
+/* Compare against the baseline file. Returns the number of regressions. */
+static int
+check_baseline (const char *file, const char **names,
+                struct result *results, size_t n, double threshold)
+{
+    char corpus[64], metric[64];
+    double value, now_value, change;
+    size_t i, m;
+    int regressions = 0;
+    FILE *f;
+
+    f = fopen (file, "r");
+    if (!f) error_message ("%s: %s", file, strerror (errno));
+
+    while (fscanf (f, "%63s %63s %lf", corpus, metric, &value) == 3) {
+        for (i = 0; i < n && strcmp (names[i], corpus); ++i);
+        for (m = 0; m < N_METRICS && strcmp (METRICS[m].name, metric); ++m);
+        if (i == n || m == N_METRICS || value <= 0)
+            continue;
+
+        now_value = METRIC (&results[i], m);
+        change = 100.0 * (now_value - value) / value;
+        if (!METRICS[m].higher)
+            change = -change;
+        if (change < -threshold) {
+            printf ("REGRESSION: %s %s: %g, baseline %g (%.1f%% worse)\n",
+                    corpus, metric, now_value, value, -change);
+            ++regressions;
+        }
+    }
+    fclose (f);
+    return regressions;
+}
+
+static void
+save_results (const char *file, const char **names, struct result *results,
+              size_t n)
+{
+    size_t i, m;
+    FILE *f;
+
+    f = fopen (file, "w");
+    if (!f) error_message ("%s: %s", file, strerror (errno));
+    for (i = 0; i < n; ++i) {
+        for (m = 0; m < N_METRICS; ++m)
+            fprintf (f, "%s %s %.6g\n", names[i], METRICS[m].name,
+                     METRIC (&results[i], m));
+    }
+    if (fclose (f)) error_message ("%s: %s", file, strerror (errno));
+}
+
+static void
+usage (void)
+{
+    const struct corpus *c;
+
+    printf ("Usage: alco-bench [options] [corpus...]\n\n"
+            "Corpora:");
+    for (c = CORPORA; c->name; ++c)
+        printf (" %s", c->name);
+    printf (" (default: all)\n\n"
+            "Options:\n"
+            "  -scale=F       Multiply the corpus sizes by F (default 1)\n"
+            "  -iterations=N  Time the best of N runs (default 5)\n"
+            "  -baseline=FILE Compare against results saved in FILE, and "
+            "fail on a\n"
+            "                 regression\n"
+            "  -threshold=PCT Allow results PCT percent worse than the "
+            "baseline\n"
+            "                 (default 10)\n"
+            "  -save=FILE     Save the results to FILE, for -baseline\n"
+            "  -dir=DIR       Write the corpora to DIR (default /tmp)\n"
+            "  -keep          Keep the corpora afterwards\n"
+            "  -seed=N        Seed for the corpus generator (default 1)\n"
+            "  -gen=FILE      Just write the one corpus named to FILE\n");
+    exit (0);
+}
+
+/* Match "-name=value", returning the value */
+static const char *
+option (const char *arg, const char *name)
+{
+    size_t len = strlen (name);
+    if (arg[0] == '-' && !strncmp (arg + 1, name, len) && arg[len + 1] == '=')
+        return arg + len + 2;
+    return NULL;
+}
+
+int
+main (int argc, char **argv)
+{
+    struct options opts = {1.0, 5, 10.0, 1, "/tmp", NULL, NULL, NULL, 0};
+    const char **names;
+    const struct corpus *c;
+    struct result *results;
+    size_t n = 0, i;
+    int regressions = 0;
+    const char *v;
+    FILE *f;
+
+    error_set_name (argv[0]);
+    types_init ();
+
+    for (c = CORPORA; c->name; ++c)
+        ++n;
+    names = malloc ((argc + n) * sizeof (*names));
+    n = 0;
+    if (!names) error_errno ();
+
+    for (i = 1; i < (size_t) argc; ++i) {
+        if (!strcmp (argv[i], "-help") || !strcmp (argv[i], "--help"))
+            usage ();
+        else if ((v = option (argv[i], "scale")))
+            opts.scale = atof (v);
+        else if ((v = option (argv[i], "iterations")))
+            opts.iterations = atoi (v);
+        else if ((v = option (argv[i], "threshold")))
+            opts.threshold = atof (v);
+        else if ((v = option (argv[i], "seed")))
+            opts.seed = strtoul (v, NULL, 0);
+        else if ((v = option (argv[i], "dir")))
+            opts.dir = v;
+        else if ((v = option (argv[i], "baseline")))
+            opts.baseline = v;
+        else if ((v = option (argv[i], "save")))
+            opts.save = v;
+        else if ((v = option (argv[i], "gen")))
+            opts.gen = v;
+        else if (!strcmp (argv[i], "-keep"))
+            opts.keep = 1;
+        else if (argv[i][0] == '-')
+            error_message ("unknown option %s", argv[i]);
+        else if (!corpus_find (argv[i]))
+            error_message ("unknown corpus %s", argv[i]);
+        else
+            names[n++] = argv[i];
+    }
+    if (opts.scale <= 0 || opts.iterations < 1)
+        error_message ("-scale and -iterations must be positive");
+
+    if (opts.gen) {
+        if (n != 1)
+            error_message ("-gen needs exactly one corpus");
+        f = fopen (opts.gen, "w");
+        if (!f) error_message ("%s: %s", opts.gen, strerror (errno));
+        c = corpus_find (names[0]);
+        corpus_write (c, f, (size_t) (c->default_size * opts.scale),
+                      opts.seed);
+        if (fclose (f)) error_message ("%s: %s", opts.gen, strerror (errno));
+        return 0;
+    }
+
+    if (!n) {
+        for (c = CORPORA; c->name; ++c)
+            names[n++] = c->name;
+    }
+    results = malloc (n * sizeof (*results));
+    if (!results) error_errno ();
+
+    printf ("%-8s %10s %10s %10s %10s %10s %10s\n", "corpus", "lex MB/s",
+            "Mtok/s", "parse MB/s", "Knodes/s", "allocs", "peak RSS");
+    for (i = 0; i < n; ++i) {
+        run_corpus (corpus_find (names[i]), &opts, &results[i]);
+        printf ("%-8s %10.1f %10.2f %10.1f %10.1f %10.0f %8.0f M\n", names[i],
+                results[i].lex_bytes / 1e6, results[i].lex_tokens / 1e6,
+                results[i].parse_bytes / 1e6, results[i].parse_nodes / 1e3,
+                results[i].allocs, results[i].peak_rss_kb / 1024);
+    }
+
+    if (opts.save)
+        save_results (opts.save, names, results, n);
+    if (opts.baseline)
+        regressions = check_baseline (opts.baseline, names, results, n,
+                                      opts.threshold);
+
+    free (results);
+    free (names);
+    return regressions ? 1 : 0;
+}
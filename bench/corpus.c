@@ -0,0 +1,253 @@
+/* Copyright (c) 2011, Christopher Pavlina. All rights reserved. */
+
+#include "corpus.h"
+#include <string.h>
+
+/* A small xorshift generator, so that the corpora are the same everywhere */
+static unsigned
+next_rand (unsigned *state)
+{
+    unsigned x = *state ? *state : 2463534242u;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    return *state = x;
+}
+
+/* Write one operand: a name or a small literal */
+static size_t
+write_operand (FILE *f, unsigned *rand)
+{
+    switch (next_rand (rand) % 3) {
+    case 0:
+        return fprintf (f, "a");
+    case 1:
+        return fprintf (f, "b%u", next_rand (rand) % 8);
+    default:
+        return fprintf (f, "%u", next_rand (rand) % 1000);
+    }
+}
+
+/* Write an expression with 'n' binary operators */
+static size_t
+write_expr (FILE *f, unsigned n, unsigned *rand)
+{
+    static const char *const opers[] = {
+        "+", "-", "*", "/", "%", "%%", "<<", ">>", "&", "|", "^", "<", "<=",
+        ">", ">=", "==", "!=", "===", "!==", "&&", "||"
+    };
+    size_t written = write_operand (f, rand);
+    unsigned i;
+
+    for (i = 0; i < n; ++i) {
+        written += fprintf (f, " %s ",
+                            opers[next_rand (rand) % (sizeof (opers) /
+                                                      sizeof (*opers))]);
+        written += write_operand (f, rand);
+    }
+    return written;
+}
+
+static size_t
+write_indent (FILE *f, unsigned depth)
+{
+    return fprintf (f, "%*s", 4 * depth, "");
+}
+
+/* Functions with blocks nested 'depth' deep, each with a parenthesised
+ * condition */
+static void
+write_nest (FILE *f, size_t size, unsigned seed)
+{
+    const unsigned depth = 48;
+    size_t written = 0;
+    unsigned rand = seed, n, d, p;
+
+    for (n = 0; written < size; ++n) {
+        written += fprintf (f, "i32 nest%u (i32 a, i32 b0) {\n", n);
+        for (d = 1; d <= depth; ++d) {
+            written += write_indent (f, d);
+            written += fprintf (f, "let b%u := ", d % 8);
+            for (p = 0; p < d % 16; ++p)
+                written += fprintf (f, "(");
+            written += write_expr (f, 1, &rand);
+            for (p = 0; p < d % 16; ++p)
+                written += fprintf (f, " + %u)", p);
+            written += fprintf (f, ";\n");
+            written += write_indent (f, d);
+            written += fprintf (f, d % 2 ? "if (" : "while (");
+            written += write_expr (f, 2, &rand);
+            written += fprintf (f, ") {\n");
+        }
+        written += write_indent (f, depth + 1);
+        written += fprintf (f, "return a;\n");
+        for (d = depth; d > 0; --d) {
+            written += write_indent (f, d);
+            written += fprintf (f, "}\n");
+        }
+        written += fprintf (f, "    return b0;\n}\n\n");
+    }
+}
+
+/* Write an identifier of 'len' characters, different for each 'n' */
+static size_t
+write_long_ident (FILE *f, unsigned n, unsigned len)
+{
+    static const char chars[] =
+        "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ_0123456789";
+    char buf[256];
+    unsigned i;
+
+    for (i = 0; i < len && i < sizeof (buf) - 1; ++i)
+        buf[i] = chars[(n * 7 + i * 13) % (sizeof (chars) - 1)];
+    buf[0] = 'v';
+    buf[i] = 0;
+    return fprintf (f, "%s_%u", buf, n);
+}
+
+static void
+write_ident (FILE *f, size_t size, unsigned seed)
+{
+    size_t written = 0;
+    unsigned rand = seed, n, i, len;
+
+    for (n = 0; written < size; ++n) {
+        len = 32 + next_rand (&rand) % 200;
+        written += fprintf (f, "i64 ");
+        written += write_long_ident (f, n, len);
+        written += fprintf (f, " (i64 ");
+        written += write_long_ident (f, n + 1, len);
+        written += fprintf (f, ") {\n");
+        for (i = 0; i < 8; ++i) {
+            written += fprintf (f, "    let ");
+            written += write_long_ident (f, n + i + 2, len);
+            written += fprintf (f, " := ");
+            written += write_long_ident (f, n + i + 1, len);
+            written += fprintf (f, " * ");
+            written += write_long_ident (f, n + 1, len);
+            written += fprintf (f, ";\n");
+        }
+        written += fprintf (f, "    return ");
+        written += write_long_ident (f, n + 9, len);
+        written += fprintf (f, ";\n}\n\n");
+    }
+}
+
+/* Write one literal, of any kind the lexer accepts */
+static size_t
+write_literal (FILE *f, unsigned *rand)
+{
+    unsigned v = next_rand (rand);
+
+    switch (v % 8) {
+    case 0:
+        return fprintf (f, "%u", v >> 3);
+    case 1:
+        return fprintf (f, "0x%x:u32", v >> 3);
+    case 2:
+        return fprintf (f, "0o%o:i64", v >> 3);
+    case 3:
+        return fprintf (f, "%u:u16", (v >> 3) % 65536);
+    case 4:
+        return fprintf (f, "%u.%u", (v >> 3) % 100000, v % 1000);
+    case 5:
+        return fprintf (f, "%u.%ue%c%u", (v >> 3) % 10, v % 1000000,
+                        v & 1024 ? '-' : '+', (v >> 11) % 300);
+    case 6:
+        return fprintf (f, "%u.%uf", (v >> 3) % 1000, v % 100);
+    default:
+        /* A typespec may only follow the digits of an integer or of an
+         * exponent - 1.5:f32 is three tokens */
+        return fprintf (f, "%u.%ue%u:f32", (v >> 3) % 1000, v % 100,
+                        (v >> 10) % 30);
+    }
+}
+
+static void
+write_literal_table (FILE *f, size_t size, unsigned seed)
+{
+    size_t written = 0;
+    unsigned rand = seed, n, i;
+
+    for (n = 0; written < size; ++n) {
+        written += fprintf (f, "void table%u (var t) {\n", n);
+        for (i = 0; i < 256; ++i) {
+            written += fprintf (f, "    t[%u] = ", i);
+            written += write_literal (f, &rand);
+            written += fprintf (f, ";\n");
+        }
+        written += fprintf (f, "}\n\n");
+    }
+}
+
+static void
+write_comment (FILE *f, size_t size, unsigned seed)
+{
+    size_t written = 0;
+    unsigned rand = seed, n, i;
+
+    for (n = 0; written < size; ++n) {
+        written += fprintf (f, "/* Function %u.\n", n);
+        for (i = 0; i < 12; ++i)
+            written += fprintf (f, " * Lorem ipsum dolor sit amet, "
+                                "consectetur adipiscing elit, sed do eiusmod "
+                                "tempor.\n");
+        written += fprintf (f, " * /* Nested: incididunt ut labore */ et "
+                            "dolore magna aliqua.\n */\n");
+        written += fprintf (f, "i32 commented%u (i32 a) {\n", n);
+        for (i = 0; i < 6; ++i) {
+            written += fprintf (f, "    // Ut enim ad minim veniam, quis "
+                                "nostrud exercitation ullamco laboris\n");
+            written += fprintf (f, "    a = ");
+            written += write_expr (f, 1, &rand);
+            written += fprintf (f, "; /* nisi ut /* aliquip */ ex ea */\n");
+        }
+        written += fprintf (f, "    return a; // commodo consequat\n}\n\n");
+    }
+}
+
+/* The other corpora in turn, in chunks of about 1 MiB */
+static void
+write_huge (FILE *f, size_t size, unsigned seed)
+{
+    static void (*const parts[]) (FILE *, size_t, unsigned) = {
+        write_nest, write_ident, write_literal_table, write_comment
+    };
+    const size_t chunk = 1 << 20;
+    size_t written;
+    long start = ftell (f);
+    unsigned n;
+
+    for (n = 0, written = 0; written < size; ++n) {
+        parts[n % 4] (f, chunk, seed + n);
+        written = ftell (f) - start;
+    }
+}
+
+const struct corpus CORPORA[] = {
+    {"nest", 4 << 20, write_nest},
+    {"ident", 4 << 20, write_ident},
+    {"literal", 4 << 20, write_literal_table},
+    {"comment", 4 << 20, write_comment},
+    {"huge", 64 << 20, write_huge},
+    {NULL, 0, NULL}
+};
+
+const struct corpus *
+corpus_find (const char *name)
+{
+    const struct corpus *c;
+
+    for (c = CORPORA; c->name; ++c) {
+        if (!strcmp (c->name, name))
+            return c;
+    }
+    return NULL;
+}
+
+void
+corpus_write (const struct corpus *c, FILE *f, size_t size, unsigned seed)
+{
+    fprintf (f, "package bench;\n\n");
+    c->write (f, size, seed);
+}
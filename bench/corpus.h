@@ -0,0 +1,39 @@
+/* Copyright (c) 2011, Christopher Pavlina. All rights reserved. */
+
+#ifndef _BENCH_CORPUS_H
+#define _BENCH_CORPUS_H 1
+
+#include <stdio.h>
+#include <stddef.h>
+
+/* Synthetic Alpha source for benchmarking the front end. Each kind of corpus
+ * stresses one part of it:
+ *
+ *   nest      deeply nested blocks and parentheses
+ *   ident     long identifiers
+ *   literal   tables of integer and real literals in every radix
+ *   comment   mostly comments, nested and line
+ *   huge      all of the above, in one very big file
+ *
+ * The output is deterministic for a given kind, size and seed. */
+
+struct corpus {
+    const char *name;
+    /* Size written for scale 1, in bytes */
+    size_t default_size;
+    /* Write about 'size' bytes of top-level declarations to 'f' */
+    void (*write) (FILE *f, size_t size, unsigned seed);
+};
+
+/* All the corpora, terminated by an entry with a NULL name */
+extern const struct corpus CORPORA[];
+
+/* Look up a corpus by name. Returns NULL if there is none. */
+const struct corpus *
+corpus_find (const char *name);
+
+/* Write a whole source file of about 'size' bytes to 'f' */
+void
+corpus_write (const struct corpus *c, FILE *f, size_t size, unsigned seed);
+
+#endif /* _BENCH_CORPUS_H */
@@ -41,6 +41,8 @@ def autogen ():
         For each key in autogen.conf
             Replace %%key%% by value
         Save new file as @path relative to source root
+    For each table generator in GENERATORS
+        Generate the table from its spec file (if it has one)
     """
 
     import os
@@ -74,6 +76,16 @@ def autogen ():
         with open (path, 'w') as f:
             f.write (text)
 
+    for spec, path, generate in GENERATORS:
+        if spec:
+            with open (spec) as f:
+                text = generate (f.read ())
+        else:
+            text = generate (None)
+            spec = "build_misc.py"
+        with open (path, 'w') as f:
+            f.write (_GENERATED_HEADER % spec + text)
+
 @program
 def autogen_clean ():
     """
@@ -91,3 +103,434 @@ def autogen_clean ():
             path = _get_and_remove_first_line (f.read ())[0]
         if os.path.exists (path):
             os.unlink (path)
+
+    for spec, path, generate in GENERATORS:
+        if os.path.exists (path):
+            os.unlink (path)
+
+# Table generators. Each takes the text of a spec file under autogen/ (or None,
+# for tables computed from nothing) and returns C source. autogen() writes the
+# result out; autogen_clean() removes it.
+
+_GENERATED_HEADER = """
+/* WARNING: THIS FILE IS AUTO-GENERATED. If you edit it, you will lose all
+ * changes very quickly. Edit the source in %s, then re-run Make. */
+
+"""
+
+def _spec_lines (text):
+    """
+    Split a spec file into lists of fields, skipping blank lines and comments
+    """
+
+    for line in text.split ('\n'):
+        line = line.partition ('#')[0].split ()
+        if line:
+            yield line
+
+def _c_array (name, ctype, values, per_line = 16, size = None):
+    """
+    Format a list of integers as a static const C array. 'size' is the C
+    expression for its length, if not just the number of values.
+    """
+
+    lines = []
+    for i in range (0, len (values), per_line):
+        lines.append ('    ' + ', '.join (
+            '%d' % v for v in values[i:i + per_line]) + ',')
+    return 'static const %s %s[%s] = {\n%s\n};\n' % (
+        ctype, name, size or len (values), '\n'.join (lines))
+
+def _parse_lexer_spec (text):
+    """
+    Read autogen/lexer.spec. Returns (classes, char_class, ids, types), where
+        classes: class names, numbered from zero; class 0 is OTHER
+        char_class: class number of each byte
+        ids: (spelling, kind, name) for each token ID, numbered from one;
+            kind is 'oper', 'keyword', 'type' or 'word'
+        types: (spelling, size, encoding) for each builtin type, in ID order;
+            size is in bytes, or 0 for pointer-sized
+    """
+
+    escapes = {'\\s': ' ', '\\t': '\t', '\\n': '\n', '\\v': '\v',
+               '\\f': '\f', '\\r': '\r'}
+    classes = ['OTHER']
+    char_class = [0] * 256
+    ids = {'oper': [], 'keyword': [], 'type': [], 'word': []}
+    types = []
+
+    for fields in _spec_lines (text):
+        if fields[0] == 'class':
+            classes.append (fields[1])
+            for chars in fields[2:]:
+                if chars in escapes:
+                    chars = escapes[chars]
+                if len (chars) == 3 and chars[1] == '-':
+                    codes = range (ord (chars[0]), ord (chars[2]) + 1)
+                elif len (chars) == 1:
+                    codes = [ord (chars)]
+                else:
+                    raise Exception ("bad character class member " + chars)
+                for c in codes:
+                    if char_class[c]:
+                        raise Exception ("character %r in two classes"
+                                         % chr (c))
+                    char_class[c] = len (classes) - 1
+        elif fields[0] == 'oper':
+            ids['oper'].append ((fields[1], 'oper', fields[2]))
+        elif fields[0] == 'type':
+            ids['type'].append ((fields[1], 'type', fields[1].upper ()))
+            size = 0 if fields[2] == 'ptr' else int (fields[2])
+            types.append ((fields[1], size, fields[3]))
+        elif fields[0] in ('keyword', 'word'):
+            for word in fields[1:]:
+                ids[fields[0]].append ((word, fields[0], word.upper ()))
+        else:
+            raise Exception ("bad lexer spec line: " + ' '.join (fields))
+
+    # Operators first, so that the DFA's accept table fits in a byte; then
+    # the words, grouped so that each kind is a range of IDs
+    ids = ids['oper'] + ids['keyword'] + ids['type'] + ids['word']
+    if len (ids) > 255:
+        raise Exception ("too many token IDs")
+    names = set ()
+    for spelling, kind, name in ids:
+        if name in names:
+            raise Exception ("token ID name %s used twice" % name)
+        names.add (name)
+
+    return classes, char_class, ids, types
+
+def _gen_token_ids (text):
+    """
+    Generate src/lex/token_ids.h from autogen/lexer.spec: a TOK_* constant
+    for every operator and word the lexer recognises, plus the bounds of
+    each kind of ID
+    """
+
+    classes, char_class, ids, types = _parse_lexer_spec (text)
+    kinds = [kind for spelling, kind, name in ids]
+
+    out = []
+    out.append ('#ifndef _LEX_TOKEN_IDS_H\n#define _LEX_TOKEN_IDS_H 1\n\n')
+    out.append ('/* Token IDs. Every operator, keyword, builtin type name and\n'
+                ' * contextual word has its own; anything else is TOK_NONE. */\n')
+    out.append ('#define TOK_NONE 0\n')
+    for i, (spelling, kind, name) in enumerate (ids):
+        out.append ('#define TOK_%-14s %3d /* %s */\n' % (
+            name, i + 1, spelling.replace ('*/', '* /')))
+    out.append ('\n/* Each kind of ID is a range: first <= id < end */\n')
+    for kind in ('oper', 'keyword', 'type', 'word'):
+        out.append ('#define TOK_FIRST_%s %d\n' % (
+            kind.upper (), kinds.index (kind) + 1))
+        out.append ('#define TOK_END_%s %d\n' % (
+            kind.upper (), len (kinds) - kinds[::-1].index (kind) + 1))
+    out.append ('#define TOK_N_IDS %d\n' % (len (ids) + 1))
+    out.append ('\n#endif /* _LEX_TOKEN_IDS_H */\n')
+    return ''.join (out)
+
+def _gen_lexer_tables (text):
+    """
+    Generate src/lex/lex_tables.h from autogen/lexer.spec:
+        lex_char_class[256]: character class of each byte, CC_*
+        lex_char_value[256]: value of each byte as a digit in any radix up
+            to 36, or LEX_NO_VALUE
+        lex_oper_symbol[256]: each byte's column in the operator DFA (0 for
+            bytes which cannot appear in an operator)
+        lex_oper_dfa[state][symbol]: next DFA state, 0 being the dead state
+            and LEX_OPER_START the start state
+        lex_oper_accept[state]: token ID of the operator recognised on
+            reaching this state, or TOK_NONE
+        LEX_OPER_MAX_LEN: length of the longest operator
+    Words are looked up with the keyword hash - see _gen_keyword_tables ().
+    """
+
+    classes, char_class, ids, types = _parse_lexer_spec (text)
+    opers = [(i + 1, spelling) for i, (spelling, kind, name) in enumerate (ids)
+             if kind == 'oper']
+
+    char_value = [255] * 256
+    for i in range (10):
+        char_value[ord ('0') + i] = i
+    for i in range (26):
+        char_value[ord ('a') + i] = char_value[ord ('A') + i] = 10 + i
+
+    # Operator alphabet: symbol 0 is "anything else"
+    symbols = sorted (set (c for id, spelling in opers for c in spelling))
+    oper_symbol = [0] * 256
+    for i, c in enumerate (symbols):
+        if classes[char_class[ord (c)]] not in ('OPER', 'SLASH'):
+            raise Exception ("operator character %r not in class OPER" % c)
+        oper_symbol[ord (c)] = i + 1
+
+    # The DFA is the trie of operator spellings; maximal munch falls back to
+    # the last accepting state seen. State 0 is dead, state 1 is the start.
+    states = {'': 1}
+    order = ['', '']
+    for id, spelling in opers:
+        for i in range (1, len (spelling) + 1):
+            if spelling[:i] not in states:
+                states[spelling[:i]] = len (order)
+                order.append (spelling[:i])
+    if len (order) > 256:
+        raise Exception ("too many operator DFA states")
+
+    dfa = []
+    accept = [0] * len (order)
+    for id, spelling in opers:
+        accept[states[spelling]] = id
+    for state, prefix in enumerate (order):
+        row = [0] * (len (symbols) + 1)
+        if state:
+            for i, c in enumerate (symbols):
+                row[i + 1] = states.get (prefix + c, 0)
+        dfa.append (row)
+
+    out = []
+    out.append ('#ifndef _LEX_LEX_TABLES_H\n#define _LEX_LEX_TABLES_H 1\n\n')
+    out.append ('#include "token_ids.h"\n\n')
+    out.append ('/* Character classes */\n')
+    for i, name in enumerate (classes):
+        out.append ('#define CC_%s %d\n' % (name, i))
+    out.append ('\n')
+    out.append (_c_array ('lex_char_class', 'unsigned char', char_class))
+    out.append ('\n/* Digit values, in any radix up to 36 */\n')
+    out.append ('#define LEX_NO_VALUE 255\n')
+    out.append (_c_array ('lex_char_value', 'unsigned char', char_value))
+    out.append ('\n/* Operator DFA */\n')
+    out.append ('#define LEX_OPER_START 1\n')
+    out.append ('#define LEX_OPER_SYMBOLS %d\n' % (len (symbols) + 1))
+    out.append ('#define LEX_OPER_STATES %d\n' % len (order))
+    out.append ('#define LEX_OPER_MAX_LEN %d\n'
+                % max (len (spelling) for id, spelling in opers))
+    out.append (_c_array ('lex_oper_symbol', 'unsigned char', oper_symbol))
+    out.append ('static const unsigned char '
+                'lex_oper_dfa[LEX_OPER_STATES][LEX_OPER_SYMBOLS] = {\n')
+    for state, row in enumerate (dfa):
+        out.append ('    /* %-3s */ {%s},\n' % (
+            order[state] if state else '', ', '.join ('%d' % v for v in row)))
+    out.append ('};\n')
+    out.append (_c_array ('lex_oper_accept', 'unsigned char', accept))
+    out.append ('\n#endif /* _LEX_LEX_TABLES_H */\n')
+    return ''.join (out)
+
+def _keyword_hash (word, a, b, size):
+    """
+    The keyword hash: must match KW_HASH in the generated header
+    """
+
+    return (a * ord (word[0]) + b * ord (word[-1]) + len (word)) & (size - 1)
+
+def _gen_keyword_tables (text):
+    """
+    Generate src/keyword_tables.h from autogen/lexer.spec:
+        KW_HASH (word, len): a perfect hash of every word with a token ID -
+            keywords, builtin type names and contextual words. It only looks
+            at the first and last characters and the length, so a lookup is
+            one hash and one compare.
+        kw_table[KW_TABLE_SIZE]: spelling, length and token ID of the word
+            at each hash value (length 0 for an empty slot)
+        kw_keywords[], kw_types[]: NULL-terminated lists of the keywords and
+            builtin type names
+    The multipliers and table size are searched for at build time; the
+    smallest table with no collisions wins.
+    """
+
+    classes, char_class, ids, types = _parse_lexer_spec (text)
+    words = [(spelling, i + 1, kind)
+             for i, (spelling, kind, name) in enumerate (ids)
+             if kind != 'oper']
+
+    size = 1
+    while size < len (words):
+        size *= 2
+    found = None
+    while not found and size <= 4096:
+        for a in range (1, 64):
+            for b in range (1, 64):
+                hashes = set (_keyword_hash (w, a, b, size)
+                              for w, id, kind in words)
+                if len (hashes) == len (words):
+                    found = (a, b)
+                    break
+            if found:
+                break
+        else:
+            size *= 2
+    if not found:
+        raise Exception ("no perfect hash found for keywords")
+    a, b = found
+
+    table = [None] * size
+    for word, id, kind in words:
+        table[_keyword_hash (word, a, b, size)] = (word, id)
+
+    out = []
+    out.append ('#ifndef _KEYWORD_TABLES_H\n#define _KEYWORD_TABLES_H 1\n\n')
+    out.append ('#include "lex/token_ids.h"\n\n')
+    out.append ('/* Perfect hash of all words with token IDs. "word" must be at\n'
+                ' * least one character long. */\n')
+    out.append ('#define KW_TABLE_SIZE %d\n' % size)
+    out.append ('#define KW_HASH(word, len) \\\n'
+                '    ((%d * (unsigned char) (word)[0] + \\\n'
+                '      %d * (unsigned char) (word)[(len) - 1] + \\\n'
+                '      (unsigned) (len)) & (KW_TABLE_SIZE - 1))\n\n' % (a, b))
+    out.append ('static const struct {\n    const char *spelling;\n'
+                '    unsigned char len, id;\n} kw_table[KW_TABLE_SIZE] = {\n')
+    for entry in table:
+        if entry:
+            out.append ('    {"%s", %d, TOK_%s},\n' % (
+                entry[0], len (entry[0]), ids[entry[1] - 1][2]))
+        else:
+            out.append ('    {"", 0, TOK_NONE},\n')
+    out.append ('};\n\n')
+    for kind in ('keyword', 'type'):
+        out.append ('static const char *kw_%ss[] = {\n' % kind)
+        for word, id, k in words:
+            if k == kind:
+                out.append ('    "%s",\n' % word)
+        out.append ('    NULL};\n\n')
+    out.append ('#endif /* _KEYWORD_TABLES_H */\n')
+    return ''.join (out)
+
+def _gen_builtin_types (text):
+    """
+    Generate src/types/builtin_types.h from autogen/lexer.spec: the size and
+    encoding of each builtin type, indexed by token ID - TOK_FIRST_TYPE. A
+    size of 0 means pointer-sized.
+    """
+
+    classes, char_class, ids, types = _parse_lexer_spec (text)
+
+    out = []
+    out.append ('#ifndef _TYPES_BUILTIN_TYPES_H\n'
+                '#define _TYPES_BUILTIN_TYPES_H 1\n\n')
+    out.append ('#include "type.h"\n\n')
+    out.append ('static const struct {\n    unsigned char size;\n'
+                '    enum type_encoding enc;\n'
+                '} builtin_types[TOK_END_TYPE - TOK_FIRST_TYPE] = {\n')
+    for spelling, size, enc in types:
+        out.append ('    /* %-8s */ {%d, %s},\n' % (spelling, size, enc))
+    out.append ('};\n\n#endif /* _TYPES_BUILTIN_TYPES_H */\n')
+    return ''.join (out)
+
+def _gen_pow10_tables (text):
+    """
+    Generate src/lex/pow10_tables.h: the 128-bit significands of the powers of
+    ten from 10^POW10_MIN to 10^POW10_MAX, for the
+    Eisel-Lemire float conversion in src/lex/number.c. Entry [q - POW10_MIN]
+    is {high 64 bits, low 64 bits}; the top bit of the high half is always
+    set. Positive powers are rounded down and negative ones up, as the
+    algorithm expects.
+    """
+
+    lo, hi = -348, 347
+    out = []
+    out.append ('#ifndef _LEX_POW10_TABLES_H\n#define _LEX_POW10_TABLES_H 1\n\n')
+    out.append ('#include <stdint.h>\n\n')
+    out.append ('#define POW10_MIN (%d)\n#define POW10_MAX %d\n\n' % (lo, hi))
+    out.append ('static const uint64_t pow10_significands[%d][2] = {\n'
+                % (hi - lo + 1))
+    for q in range (lo, hi + 1):
+        if q >= 0:
+            v = 10 ** q
+            n = v.bit_length ()
+            m = v >> (n - 128) if n > 128 else v << (128 - n)
+        else:
+            d = 10 ** -q
+            # 2^k / d with exactly 128 bits, rounded up (it is never exact)
+            k = d.bit_length () + 127
+            if ((1 << k) // d).bit_length () < 128:
+                k += 1
+            m = (1 << k) // d + 1
+        assert m.bit_length () == 128
+        out.append ('    {0x%016xu, 0x%016xu}, /* 1e%d */\n' % (
+            m >> 64, m & ((1 << 64) - 1), q))
+    out.append ('};\n\n#endif /* _LEX_POW10_TABLES_H */\n')
+    return ''.join (out)
+
+def _gen_oper_tables (text):
+    """
+    Generate src/parse/oper_tables.h from autogen/operators.spec: the Pratt
+    binding powers of each operator, indexed by token ID (0 for tokens which
+    are not that kind of operator):
+        oper_infix_lbp[], oper_infix_rbp[]: how tightly an infix operator
+            binds its left operand, and the minimum power with which its right
+            operand is parsed. Level k (from 1, loosest) gets 2k and 2k + 1
+            if left associative, or 2k + 1 and 2k if right associative.
+        oper_prefix_bp[]: the minimum power with which a prefix operator's
+            operand is parsed - 2k
+        oper_postfix_bp[]: how tightly a postfix operator binds its operand -
+            2k
+    """
+
+    with open ("autogen/lexer.spec") as f:
+        classes, char_class, ids, types = _parse_lexer_spec (f.read ())
+    id_of = dict ((spelling, i + 1) for i, (spelling, kind, name)
+                  in enumerate (ids))
+    n_ids = len (ids) + 1
+
+    infix_lbp = [0] * n_ids
+    infix_rbp = [0] * n_ids
+    prefix_bp = [0] * n_ids
+    postfix_bp = [0] * n_ids
+
+    level = 0
+    for fields in _spec_lines (text):
+        level += 1
+        if fields[0] == 'infix':
+            if fields[1] not in ('left', 'right'):
+                raise Exception ("bad associativity " + fields[1])
+            opers = fields[2:]
+        elif fields[0] in ('prefix', 'postfix'):
+            opers = fields[1:]
+        else:
+            raise Exception ("bad operator spec line: " + ' '.join (fields))
+
+        for oper in opers:
+            if oper not in id_of:
+                raise Exception ("unknown operator " + oper)
+            i = id_of[oper]
+            if fields[0] == 'infix':
+                if infix_lbp[i] or postfix_bp[i]:
+                    raise Exception ("operator %s declared twice" % oper)
+                right = fields[1] == 'right'
+                infix_lbp[i] = 2 * level + right
+                infix_rbp[i] = 2 * level + (not right)
+            elif fields[0] == 'prefix':
+                if prefix_bp[i]:
+                    raise Exception ("operator %s declared twice" % oper)
+                prefix_bp[i] = 2 * level
+            else:
+                if infix_lbp[i] or postfix_bp[i]:
+                    raise Exception ("operator %s declared twice" % oper)
+                postfix_bp[i] = 2 * level
+
+    if 2 * level + 1 > 255:
+        raise Exception ("too many precedence levels")
+
+    out = []
+    out.append ('#ifndef _PARSE_OPER_TABLES_H\n'
+                '#define _PARSE_OPER_TABLES_H 1\n\n')
+    out.append ('#include "../lex/token_ids.h"\n\n')
+    out.append ('/* Binding powers, by token ID - see parse_expr () */\n')
+    out.append (_c_array ('oper_infix_lbp', 'unsigned char', infix_lbp,
+                          size = 'TOK_N_IDS'))
+    out.append (_c_array ('oper_infix_rbp', 'unsigned char', infix_rbp,
+                          size = 'TOK_N_IDS'))
+    out.append (_c_array ('oper_prefix_bp', 'unsigned char', prefix_bp,
+                          size = 'TOK_N_IDS'))
+    out.append (_c_array ('oper_postfix_bp', 'unsigned char', postfix_bp,
+                          size = 'TOK_N_IDS'))
+    out.append ('\n#endif /* _PARSE_OPER_TABLES_H */\n')
+    return ''.join (out)
+
+# (spec file, generated file, generator)
+GENERATORS = [
+    ("autogen/lexer.spec", "src/lex/token_ids.h", _gen_token_ids),
+    ("autogen/lexer.spec", "src/lex/lex_tables.h", _gen_lexer_tables),
+    ("autogen/lexer.spec", "src/keyword_tables.h", _gen_keyword_tables),
+    ("autogen/lexer.spec", "src/types/builtin_types.h", _gen_builtin_types),
+    (None, "src/lex/pow10_tables.h", _gen_pow10_tables),
+    ("autogen/operators.spec", "src/parse/oper_tables.h", _gen_oper_tables),
+]
@@ -0,0 +1,251 @@
+/* Copyright (c) 2011, Christopher Pavlina. All rights reserved. */
+
+/* alco-check: checks of the compiler's parts which the t*.al tests can't get
+ * at through the command line. Each check builds what it needs from source
+ * text written to a temporary file. Failures are printed, and the exit
+ * status is 1 if there were any. Run it with "make check". */
+
+#include "src/env.h"
+#include "src/error.h"
+#include "src/intern.h"
+#include "src/lex/lex.h"
+#include "src/parse/binast.h"
+#include "src/parse/flat.h"
+#include "src/parse/parse.h"
+#include "src/types/type.h"
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+static int n_failed;
+
+#define CHECK(cond)                                                     \
+    do {                                                                \
+        if (!(cond)) {                                                  \
+            fprintf (stderr, "%s:%d: check failed: %s\n", __FILE__,     \
+                     __LINE__, #cond);                                  \
+            ++n_failed;                                                 \
+        }                                                               \
+    } while (0)
+
+/* Write 'text' to a new temporary file, and return its path, to be
+ * free ()d after unlink ()ing the file */
+static char *
+write_source (const char *text)
+{
+    const char *dir = getenv ("TMPDIR");
+    char *path;
+    FILE *f;
+    int fd;
+
+    if (!dir || !*dir) dir = "/tmp";
+    path = malloc (strlen (dir) + sizeof ("/alco-check-XXXXXX"));
+    if (!path) error_errno ();
+    sprintf (path, "%s/alco-check-XXXXXX", dir);
+    fd = mkstemp (path);
+    if (fd < 0 || !(f = fdopen (fd, "w")))
+        error_message ("%s: %s", path, strerror (errno));
+    if (fputs (text, f) == EOF || fclose (f))
+        error_message ("%s: %s", path, strerror (errno));
+    return path;
+}
+
+/* A binary AST keeps the value of a number literal, and zero for true and
+ * null - even after lexing many numbers in streaming mode, so that their
+ * tokens' slots in the ring have held a number before */
+static void
+check_binast_literals (struct env *env)
+{
+    static const char head[] = "package p;\nvoid f () {\n";
+    static const char number[] = "    a = 12345;\n";
+    static const char tail[] = "    b = true;\n    c = null;\n"
+        "    d = 0.5;\n}\n";
+    char text[sizeof (head) + 100 * sizeof (number) + sizeof (tail)];
+    const struct binast_node *node;
+    struct flat_ast *flat;
+    struct binast bin;
+    struct lex lex;
+    char *path, *data = NULL;
+    size_t size = 0, ints = 0, others = 0;
+    uint32_t i;
+    double r;
+    FILE *f;
+
+    strcpy (text, head);
+    for (i = 0; i < 100; ++i)
+        strcat (text, number);
+    strcat (text, tail);
+    path = write_source (text);
+
+    lexer_init (path, env, &lex);
+    lexer_stream (&lex);
+    flat = parse_file_flat (&lex, env);
+    f = open_memstream (&data, &size);
+    if (!f) error_errno ();
+    CHECK (!binast_write (flat, path, f));
+    if (fclose (f)) error_errno ();
+    flat_free (flat);
+    lexer_free (&lex);
+
+    CHECK (!binast_view (&bin, data, size));
+    for (i = 0; i < bin.header->n_nodes; ++i) {
+        node = &bin.nodes[i];
+        if (node->tag != AST_EXPR || node->kind != EXPR_LITERAL)
+            continue;
+        if (node->token_type == T_INT) {
+            CHECK (node->num == 12345);
+            ++ints;
+        } else if (node->token_type == T_REAL) {
+            memcpy (&r, &node->num, sizeof (r));
+            CHECK (r == 0.5);
+        } else {
+            CHECK (node->num == 0);
+            ++others;
+        }
+    }
+    CHECK (ints == 100 && others == 2);
+
+    free (data);
+    unlink (path);
+    free (path);
+}
+
+/* Whether 'a' and 'b' have the same text, tokens and lines */
+static int
+same_lexing (struct lex *a, struct lex *b)
+{
+    size_t i, line_a, col_a, line_b, col_b;
+
+    if (a->text_len != b->text_len || memcmp (a->text, b->text, a->text_len) ||
+        a->n_tokens != b->n_tokens)
+        return 0;
+    for (i = 0; i < a->n_tokens; ++i) {
+        if (a->tok_types[i] != b->tok_types[i] ||
+            a->tok_ids[i] != b->tok_ids[i] ||
+            a->tok_offsets[i] != b->tok_offsets[i] ||
+            a->tok_lens[i] != b->tok_lens[i] ||
+            a->tok_nums[i].i != b->tok_nums[i].i)
+            return 0;
+        lexer_locate (a, a->tok_offsets[i], &line_a, &col_a);
+        lexer_locate (b, b->tok_offsets[i], &line_b, &col_b);
+        if (line_a != line_b || col_a != col_b)
+            return 0;
+    }
+    return 1;
+}
+
+/* Lex 'text', with its lines worked out if 'lines', then replace its
+ * characters 'start' to 'end' with 'repl' by lexer_edit (), and check that
+ * this gives what lexing the result from scratch does. The diagnostics
+ * printed on the way are returned in '*diags', to be free ()d; 'errors' is
+ * the number of errors the edit should add. */
+static void
+check_edit (struct env *env, const char *text, int lines, size_t start,
+            size_t end, const char *repl, size_t errors, char **diags)
+{
+    struct lex edited, fresh;
+    char *path, *fresh_path;
+    size_t size, old_errors;
+    FILE *f;
+
+    f = open_memstream (diags, &size);
+    if (!f) error_errno ();
+    error_capture (f, NULL);
+
+    path = write_source (text);
+    lexer_init (path, env, &edited);
+    lexer_lex (&edited);
+    if (lines)
+        lexer_locate (&edited, 0, &size, &size);
+    old_errors = edited.n_errors;
+    lexer_edit (&edited, start, end, repl, strlen (repl));
+    CHECK (edited.n_errors == old_errors + errors);
+
+    fresh_path = write_source (edited.text);
+    lexer_init (fresh_path, env, &fresh);
+    lexer_lex (&fresh);
+    CHECK (same_lexing (&edited, &fresh));
+
+    error_capture (NULL, NULL);
+    if (fclose (f)) error_errno ();
+    lexer_free (&edited);
+    lexer_free (&fresh);
+    unlink (path);
+    unlink (fresh_path);
+    free (path);
+    free (fresh_path);
+}
+
+/* Edits relex only the tokens around them, but must leave what a full relex
+ * would */
+static void
+check_lexer_edit (struct env *env)
+{
+    static const char text[] =
+        "package p;\n"
+        "/* a comment */\n"
+        "void f () {\n"
+        "    x >>= 12;\n"
+        "    s = \"a string\";\n"
+        "    y = x + 0x1f;\n"
+        "}\n";
+    static const struct {
+        const char *what, *repl;
+        size_t errors;
+    } edits[] = {
+        /* What to replace, and with what */
+        {"x >>= 12", "x >>= 1.5e3", 0},
+        {">>=", ">", 0},
+        {"0x1f", "0x1f + z", 0},
+        {"/* a comment */", "// a comment */", 0},
+        {"s = ", "/* s = */ ", 0},
+        {"a string", "a \\\" string", 0},
+        {"\"a string\"", "\"a string", 1},
+        {"    y = x + 0x1f;\n", "", 0},
+        {"void", "void\n\n", 0},
+        {"package", "package", 0},
+        {"}\n", "}\nvoid g () { }\n", 0},
+        {"x + 0x1f", "x + \x01 0x1f", 1},
+    };
+    const char *at;
+    char *diags;
+    size_t i;
+    int lines;
+
+    for (i = 0; i < sizeof (edits) / sizeof (*edits); ++i) {
+        at = strstr (text, edits[i].what);
+        for (lines = 0; lines < 2; ++lines) {
+            check_edit (env, text, lines, at - text,
+                        at - text + strlen (edits[i].what), edits[i].repl,
+                        edits[i].errors, &diags);
+            CHECK (!edits[i].errors || strstr (diags, ": error: "));
+            free (diags);
+        }
+    }
+}
+
+int
+main (int argc, char **argv)
+{
+    struct env env;
+
+    (void) argc;
+    error_set_name (argv[0]);
+    types_init ();
+    memset (&env, 0, sizeof (env));
+    env.bits = 64;
+
+    check_binast_literals (&env);
+    check_lexer_edit (&env);
+
+    types_free ();
+    intern_free ();
+    if (n_failed) {
+        fprintf (stderr, "%s: %d checks failed\n", argv[0], n_failed);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,66 @@
+/* Copyright (c) 2011, Christopher Pavlina. All rights reserved. */
+
+#include "arena.h"
+#include "error.h"
+#include <stdlib.h>
+
+/* Size of the first chunk, and the largest size chunks double up to */
+#define FIRST_CHUNK_SIZE 16384
+#define MAX_CHUNK_SIZE   (4 << 20)
+
+/* Alignment of every allocation - enough for anything in the compiler */
+#define ALIGN 16
+
+struct arena_chunk {
+    struct arena_chunk *next;
+    /* The data follows, aligned to ALIGN */
+};
+
+#define CHUNK_HEADER ((sizeof (struct arena_chunk) + ALIGN - 1) & ~(ALIGN - 1))
+
+void
+arena_init (struct arena *arena)
+{
+    arena->chunks = NULL;
+    arena->next = arena->end = NULL;
+    arena->chunk_size = FIRST_CHUNK_SIZE;
+}
+
+void *
+arena_alloc (struct arena *arena, size_t size)
+{
+    struct arena_chunk *chunk;
+    size_t chunk_size;
+    void *p;
+
+    size = (size + ALIGN - 1) & ~(size_t) (ALIGN - 1);
+
+    if ((size_t) (arena->end - arena->next) < size) {
+        // Very big allocations get a chunk to themselves
+        chunk_size = size > arena->chunk_size ? size : arena->chunk_size;
+        chunk = malloc (CHUNK_HEADER + chunk_size);
+        if (!chunk) error_errno ();
+        chunk->next = arena->chunks;
+        arena->chunks = chunk;
+        arena->next = (char *) chunk + CHUNK_HEADER;
+        arena->end = arena->next + chunk_size;
+        if (arena->chunk_size < MAX_CHUNK_SIZE)
+            arena->chunk_size *= 2;
+    }
+
+    p = arena->next;
+    arena->next += size;
+    return p;
+}
+
+void
+arena_free (struct arena *arena)
+{
+    struct arena_chunk *chunk, *next;
+
+    for (chunk = arena->chunks; chunk; chunk = next) {
+        next = chunk->next;
+        free (chunk);
+    }
+    arena_init (arena);
+}
@@ -0,0 +1,34 @@
+/* Copyright (c) 2011, Christopher Pavlina. All rights reserved. */
+
+#ifndef _ARENA_H
+#define _ARENA_H 1
+
+#include <stddef.h>
+
+/* Arena allocator. Memory is handed out from big chunks, and can't be freed
+ * piece by piece - only all at once, by arena_free (). Allocation is a
+ * pointer bump, and things allocated together sit together. Chunks double in
+ * size as the arena grows, so freeing even a big arena is a handful of
+ * free ()s. An arena is not thread-safe; give each thread its own. */
+
+struct arena_chunk;
+
+struct arena {
+    struct arena_chunk *chunks;
+    char *next, *end;
+    size_t chunk_size;
+};
+
+/* Initialise an empty arena. This allocates nothing. */
+void
+arena_init (struct arena *arena);
+
+/* Get 'size' bytes, aligned for any type. Exits on error. */
+void *
+arena_alloc (struct arena *arena, size_t size);
+
+/* Free everything allocated from the arena, and make it empty again */
+void
+arena_free (struct arena *arena);
+
+#endif /* _ARENA_H */
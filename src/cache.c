@@ -0,0 +1,466 @@
+/* Copyright (c) 2011, Christopher Pavlina. All rights reserved. */
+
+#include "cache.h"
+#include "error.h"
+#include "filesystem.h"
+#include "info.h"
+#include "parse/parse.h"
+#include <assert.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/* An entry file is laid out as:
+ *
+ *   struct entry_header
+ *   union token_num   nums[n_tokens]
+ *   uint32_t          offsets[n_tokens]
+ *   uint32_t          lens[n_tokens]
+ *   unsigned char     types[n_tokens]
+ *   unsigned char     ids[n_tokens]
+ *   padding to a multiple of 8 bytes
+ *   the binary AST, to the end of the file
+ *
+ * in the writer's byte order - which is part of the key, along with
+ * everything else that could make an entry mean something else to a
+ * reader. */
+struct entry_header {
+    char magic[4];              /* "ALCC" */
+    uint32_t version;           /* CACHE_VERSION */
+    uint64_t key[2];
+    uint64_t text_len;
+    uint64_t n_tokens;
+};
+
+static const char MAGIC[4] = {'A', 'L', 'C', 'C'};
+
+/* Bytes taken by each token, over all the arrays */
+#define TOKEN_SIZE (sizeof (union token_num) + 2 * sizeof (uint32_t) + 2)
+
+/* Size of 'n' tokens' arrays, padded */
+#define TOKENS_SIZE(n) (((n) * TOKEN_SIZE + 7) & ~(size_t) 7)
+
+/* Temporary files older than this, in seconds, were left by a compiler which
+ * died while writing them */
+#define STALE_TEMP_AGE 3600
+
+/* MurmurHash3's 128-bit x64 variant. It is not cryptographic: nothing stops
+ * a crafted file from colliding with another. Entries are only ever written
+ * by the compiler itself, so the cache trusts whoever can write to it. */
+static uint64_t
+rotl64 (uint64_t x, int r)
+{
+    return (x << r) | (x >> (64 - r));
+}
+
+static uint64_t
+fmix64 (uint64_t k)
+{
+    k ^= k >> 33;
+    k *= 0xff51afd7ed558ccdull;
+    k ^= k >> 33;
+    k *= 0xc4ceb9fe1a85ec53ull;
+    k ^= k >> 33;
+    return k;
+}
+
+static void
+hash128 (const char *data, size_t len, uint64_t seed, uint64_t out[2])
+{
+    const uint64_t c1 = 0x87c37b91114253d5ull, c2 = 0x4cf5ad432745937full;
+    uint64_t h1 = seed, h2 = seed, k1, k2;
+    const unsigned char *tail;
+    size_t i;
+
+    for (i = 0; i + 16 <= len; i += 16) {
+        memcpy (&k1, data + i, 8);
+        memcpy (&k2, data + i + 8, 8);
+
+        k1 *= c1; k1 = rotl64 (k1, 31); k1 *= c2; h1 ^= k1;
+        h1 = rotl64 (h1, 27); h1 += h2; h1 = h1 * 5 + 0x52dce729;
+
+        k2 *= c2; k2 = rotl64 (k2, 33); k2 *= c1; h2 ^= k2;
+        h2 = rotl64 (h2, 31); h2 += h1; h2 = h2 * 5 + 0x38495ab5;
+    }
+
+    /* The last 0 to 15 bytes, little-endian */
+    tail = (const unsigned char *) data + i;
+    k1 = k2 = 0;
+    for (i = len & 15; i > 8; --i)
+        k2 |= (uint64_t) tail[i - 1] << (8 * (i - 9));
+    if ((len & 15) > 8) {
+        k2 *= c2; k2 = rotl64 (k2, 33); k2 *= c1; h2 ^= k2;
+    }
+    for (i = (len & 15) < 8 ? len & 15 : 8; i > 0; --i)
+        k1 |= (uint64_t) tail[i - 1] << (8 * (i - 1));
+    if (len & 15) {
+        k1 *= c1; k1 = rotl64 (k1, 31); k1 *= c2; h1 ^= k1;
+    }
+
+    h1 ^= len; h2 ^= len;
+    h1 += h2; h2 += h1;
+    h1 = fmix64 (h1); h2 = fmix64 (h2);
+    h1 += h2; h2 += h1;
+    out[0] = h1;
+    out[1] = h2;
+}
+
+/* malloc () the path of the file in the cache named for 'key', with
+ * 'suffix' */
+static char *
+entry_path (struct cache *cache, const uint64_t key[2], const char *suffix)
+{
+    size_t size = strlen (cache->dir) + 34 + strlen (suffix) + 1;
+    char *path = malloc (size);
+
+    if (!path) error_errno ();
+    snprintf (path, size, "%s/%016llx%016llx%s", cache->dir,
+              (unsigned long long) key[0], (unsigned long long) key[1],
+              suffix);
+    return path;
+}
+
+/* The files found by scan () */
+struct scan {
+    struct cache *cache;
+    struct scan_file {
+        char *name;
+        size_t size;
+        time_t mtime;
+    } *files;
+    size_t n, mem;
+    time_t now;
+};
+
+static void
+scan_file (const char *name, size_t size, time_t mtime, void *ctx)
+{
+    struct scan *scan = ctx;
+    size_t len = strlen (name);
+    char *path;
+
+    if (len > 4 && !strcmp (name + len - 4, ".tmp") &&
+        mtime < scan->now - STALE_TEMP_AGE) {
+        path = malloc (strlen (scan->cache->dir) + len + 2);
+        if (!path) error_errno ();
+        sprintf (path, "%s/%s", scan->cache->dir, name);
+        remove (path);
+        free (path);
+        return;
+    }
+    if (len <= 4 || strcmp (name + len - 4, ".alc"))
+        return;
+
+    if (scan->n == scan->mem) {
+        struct scan_file *files;
+        scan->mem = scan->mem ? 2 * scan->mem : 64;
+        files = realloc (scan->files, scan->mem * sizeof (*files));
+        if (!files) error_errno ();
+        scan->files = files;
+    }
+    scan->files[scan->n].name = malloc (len + 1);
+    if (!scan->files[scan->n].name) error_errno ();
+    memcpy (scan->files[scan->n].name, name, len + 1);
+    scan->files[scan->n].size = size;
+    scan->files[scan->n].mtime = mtime;
+    ++scan->n;
+}
+
+static int
+compare_mtime (const void *a, const void *b)
+{
+    const struct scan_file *fa = a, *fb = b;
+    return (fa->mtime > fb->mtime) - (fa->mtime < fb->mtime);
+}
+
+/* Add up the size of the entries, removing the least recently used until it
+ * is at most 'target'. Call with the lock held, or before any jobs start.
+ * Returns nonzero with errno set if the directory can't be read. */
+static int
+scan (struct cache *cache, size_t target)
+{
+    struct scan scan;
+    size_t i;
+    char *path;
+
+    memset (&scan, 0, sizeof (scan));
+    scan.cache = cache;
+    scan.now = time (NULL);
+    if (list_files (cache->dir, scan_file, &scan)) {
+        for (i = 0; i < scan.n; ++i)
+            free (scan.files[i].name);
+        free (scan.files);
+        return -1;
+    }
+
+    cache->size = 0;
+    for (i = 0; i < scan.n; ++i)
+        cache->size += scan.files[i].size;
+
+    if (scan.n)
+        qsort (scan.files, scan.n, sizeof (*scan.files), compare_mtime);
+    for (i = 0; i < scan.n; ++i) {
+        if (cache->size > target) {
+            path = malloc (strlen (cache->dir) + strlen (scan.files[i].name) +
+                           2);
+            if (!path) error_errno ();
+            sprintf (path, "%s/%s", cache->dir, scan.files[i].name);
+            if (!remove (path)) {
+                cache->size -= scan.files[i].size;
+                ++cache->stats.evictions;
+            }
+            free (path);
+        }
+        free (scan.files[i].name);
+    }
+    free (scan.files);
+    return 0;
+}
+
+void
+cache_init (struct cache *cache, const char *dir, size_t max_size, int clear,
+            struct env *env)
+{
+    const uint32_t order = BINAST_BYTE_ORDER;
+    char settings[256];
+    uint64_t hash[2];
+    int len;
+
+    memset (cache, 0, sizeof (*cache));
+    cache->dir = dir;
+    cache->max_size = max_size;
+    if (pthread_mutex_init (&cache->lock, NULL))
+        error_errno ();
+    if (make_dir (dir))
+        error_message ("%s: %s", dir, strerror (errno));
+
+    /* Everything which changes what an entry means, byte order included.
+     * The number of token IDs and tags is a cheap guard against forgetting
+     * to bump a version. */
+    len = snprintf (settings, sizeof (settings),
+                    "%s %s cache %d binast %d tokens %d tags %d order %u "
+                    "bits %d boundck %d octalish %d", APPNAME, VERSION,
+                    CACHE_VERSION, BINAST_VERSION, TOK_N_IDS, AST_N_TAGS,
+                    (unsigned) *(const unsigned char *) &order, env->bits,
+                    env->boundck, env->w_octalish);
+    hash128 (settings, len, 0, hash);
+    cache->seed = hash[0] ^ hash[1];
+
+    if (scan (cache, clear ? 0 : max_size ? max_size : (size_t) -1))
+        error_message ("%s: %s", dir, strerror (errno));
+    /* Clearing is not evicting */
+    cache->stats.evictions = 0;
+}
+
+void
+cache_free (struct cache *cache)
+{
+    pthread_mutex_destroy (&cache->lock);
+}
+
+/* Read the entry file at 'path' into 'entry', mapping it if possible. Leave
+ * entry->data NULL on error. */
+static void
+read_entry (struct cache_entry *entry, const char *path)
+{
+    FILE *f = fopen (path, "rb");
+
+    if (!f) return;
+    entry->data = map_file_f (f, &entry->size);
+    entry->mapped = entry->data != NULL;
+    if (!entry->data) {
+        /* malloc () aligns well enough for the tables */
+        entry->size = size_of_f (f);
+        entry->data = malloc (entry->size + 1);
+        if (!entry->data) error_errno ();
+        if (fread (entry->data, 1, entry->size, f) != entry->size) {
+            free (entry->data);
+            entry->data = NULL;
+        }
+    }
+    fclose (f);
+}
+
+/* Check that the entry read into 'entry' is for the text in 'lex', and well
+ * formed; if so, load its tokens into 'lex' and return nonzero */
+static int
+load_entry (struct cache_entry *entry, struct lex *lex)
+{
+    const struct entry_header *h = (const struct entry_header *) entry->data;
+    const union token_num *nums;
+    const uint32_t *offsets, *lens;
+    const unsigned char *types, *ids;
+    size_t n, i, ast_offset;
+
+    if (entry->size < sizeof (*h) ||
+        memcmp (h->magic, MAGIC, sizeof (MAGIC)) ||
+        h->version != CACHE_VERSION ||
+        h->key[0] != entry->key[0] || h->key[1] != entry->key[1] ||
+        h->text_len != lex->text_len ||
+        h->n_tokens > (entry->size - sizeof (*h)) / TOKEN_SIZE)
+        return 0;
+
+    n = h->n_tokens;
+    ast_offset = sizeof (*h) + TOKENS_SIZE (n);
+    if (ast_offset > entry->size ||
+        binast_view (&entry->ast, entry->data + ast_offset,
+                     entry->size - ast_offset))
+        return 0;
+
+    nums = (const union token_num *) (h + 1);
+    offsets = (const uint32_t *) (nums + n);
+    lens = offsets + n;
+    types = (const unsigned char *) (lens + n);
+    ids = types + n;
+    for (i = 0; i < n; ++i) {
+        if (offsets[i] > lex->text_len || lens[i] > lex->text_len - offsets[i]
+            || types[i] < T_STRING || types[i] > T_SPECIAL
+            || ids[i] >= TOK_N_IDS)
+            return 0;
+    }
+
+    lexer_load (lex, n, types, ids, offsets, lens, nums);
+    return 1;
+}
+
+/* Free the entry's data, keeping its key */
+static void
+drop_data (struct cache_entry *entry)
+{
+    if (entry->data && entry->mapped)
+        unmap_file (entry->data, entry->size);
+    else if (entry->data)
+        free (entry->data);
+    entry->data = NULL;
+    entry->size = 0;
+    entry->mapped = 0;
+    memset (&entry->ast, 0, sizeof (entry->ast));
+}
+
+int
+cache_lookup (struct cache *cache, struct lex *lex, struct cache_entry *entry)
+{
+    char *path;
+    int hit;
+
+    assert (lex->text);
+    memset (entry, 0, sizeof (*entry));
+    hash128 (lex->text, lex->text_len, cache->seed, entry->key);
+
+    path = entry_path (cache, entry->key, ".alc");
+    read_entry (entry, path);
+    hit = entry->data && load_entry (entry, lex);
+    if (hit)
+        touch_file (path);
+    else
+        drop_data (entry);
+    free (path);
+
+    pthread_mutex_lock (&cache->lock);
+    if (hit)
+        ++cache->stats.hits;
+    else
+        ++cache->stats.misses;
+    pthread_mutex_unlock (&cache->lock);
+    return hit;
+}
+
+void
+cache_store (struct cache *cache, struct cache_entry *entry, struct lex *lex,
+             struct flat_ast *flat)
+{
+    static const char zeroes[8];
+    struct entry_header h;
+    char *path, *temp, suffix[64];
+    size_t n = lex->n_tokens, size;
+    unsigned n_temp;
+    int failed;
+    FILE *f;
+
+    /* The token arrays must hold every token, in order */
+    assert (!lex->streaming);
+
+    pthread_mutex_lock (&cache->lock);
+    n_temp = cache->n_temps++;
+    pthread_mutex_unlock (&cache->lock);
+
+    path = entry_path (cache, entry->key, ".alc");
+    snprintf (suffix, sizeof (suffix), ".%ld-%u.tmp", (long) getpid (),
+              n_temp);
+    temp = entry_path (cache, entry->key, suffix);
+
+    f = fopen (temp, "wb");
+    if (!f) {
+        free (path);
+        free (temp);
+        return;
+    }
+
+    memset (&h, 0, sizeof (h));
+    memcpy (h.magic, MAGIC, sizeof (MAGIC));
+    h.version = CACHE_VERSION;
+    h.key[0] = entry->key[0];
+    h.key[1] = entry->key[1];
+    h.text_len = lex->text_len;
+    h.n_tokens = n;
+
+    fwrite (&h, sizeof (h), 1, f);
+    fwrite (lex->tok_nums, sizeof (*lex->tok_nums), n, f);
+    fwrite (lex->tok_offsets, sizeof (*lex->tok_offsets), n, f);
+    fwrite (lex->tok_lens, sizeof (*lex->tok_lens), n, f);
+    fwrite (lex->tok_types, sizeof (*lex->tok_types), n, f);
+    fwrite (lex->tok_ids, sizeof (*lex->tok_ids), n, f);
+    fwrite (zeroes, 1, TOKENS_SIZE (n) - n * TOKEN_SIZE, f);
+    failed = binast_write (flat, lex->file, f);
+    failed |= fclose (f) != 0;
+    if (!failed)
+        failed = rename (temp, path);
+    if (failed) {
+        remove (temp);
+        free (path);
+        free (temp);
+        return;
+    }
+
+    /* An entry bigger than the whole cache would only push out the rest */
+    size = size_of (path);
+    if (cache->max_size && size > cache->max_size) {
+        remove (path);
+        free (path);
+        free (temp);
+        return;
+    }
+
+    pthread_mutex_lock (&cache->lock);
+    ++cache->stats.stores;
+    cache->size += size;
+    /* Scanning costs a directory read, so make room for a good many more
+     * entries at once */
+    if (cache->max_size && cache->size > cache->max_size)
+        scan (cache, cache->max_size / 4 * 3);
+    pthread_mutex_unlock (&cache->lock);
+
+    free (path);
+    free (temp);
+}
+
+void
+cache_release (struct cache_entry *entry)
+{
+    drop_data (entry);
+}
+
+void
+cache_print_stats (struct cache *cache, FILE *f)
+{
+    pthread_mutex_lock (&cache->lock);
+    fprintf (f, "%s: %zu hits, %zu misses, %zu stored, %zu evicted; "
+             "%zu KiB", cache->dir, cache->stats.hits, cache->stats.misses,
+             cache->stats.stores, cache->stats.evictions,
+             (cache->size + 1023) / 1024);
+    if (cache->max_size)
+        fprintf (f, " of %zu KiB", (cache->max_size + 1023) / 1024);
+    fputc ('\n', f);
+    pthread_mutex_unlock (&cache->lock);
+}
@@ -0,0 +1,105 @@
+/* Copyright (c) 2011, Christopher Pavlina. All rights reserved. */
+
+#ifndef _CACHE_H
+#define _CACHE_H 1
+
+#include "env.h"
+#include "lex/lex.h"
+#include "parse/flat.h"
+#include "parse/binast.h"
+#include <stdio.h>
+#include <stdint.h>
+#include <pthread.h>
+
+/* On-disk cache of lexed and parsed files (option -cache-dir).
+ *
+ * Entries are content-addressed: each is named for a 128-bit hash of the
+ * source text and of every setting which can change what the lexer and parser
+ * make of it, so a changed file or setting just misses, and entries nobody
+ * asks for any more age out. Nothing has to be invalidated by hand; bump
+ * CACHE_VERSION whenever the lexer or parser starts giving different results
+ * for the same text. An entry holds the token stream and the tree, the latter
+ * as a binary AST (see parse/binast.h), and is used in place, mapped.
+ *
+ * Entries are written to a temporary file and renamed into place, so several
+ * compilers can share a directory. When the entries outgrow the size limit,
+ * the least recently used are removed - a hit touches its entry. One cache
+ * may be used by many jobs (see jobs.h) at once.
+ */
+
+#define CACHE_VERSION 4
+
+struct cache_stats {
+    size_t hits, misses, stores, evictions;
+};
+
+struct cache {
+    const char *dir;
+
+    /* Limit on the total size of the entries, in bytes, or 0 for none */
+    size_t max_size;
+
+    /* Hash of the settings, which seeds every key */
+    uint64_t seed;
+
+    /* Everything below is shared between jobs, under 'lock' */
+    pthread_mutex_t lock;
+
+    /* Total size of the entries, as of the last scan of the directory plus
+     * what has been stored since */
+    size_t size;
+
+    /* Number of temporary files made, to keep their names apart */
+    unsigned n_temps;
+
+    struct cache_stats stats;
+};
+
+/* One file's entry. cache_lookup () fills in the key; on a hit, the tree is
+ * in 'ast' */
+struct cache_entry {
+    uint64_t key[2];
+    struct binast ast;
+
+    /* The whole entry, and whether it is mapped (see map_file_f ()) */
+    char *data;
+    size_t size;
+    int mapped;
+};
+
+/* Open the cache in 'dir', making the directory if need be, for compiling
+ * with 'env'. With a nonzero 'max_size' (in bytes), old entries are removed
+ * to keep the total under it. With 'clear', every entry is removed first.
+ * Exits on error. */
+void
+cache_init (struct cache *cache, const char *dir, size_t max_size, int clear,
+            struct env *env);
+
+/* Close the cache */
+void
+cache_free (struct cache *cache);
+
+/* Look up the file open in 'lex', whose text must have been read (see
+ * lexer_read ()). On a hit, load its tokens into 'lex' (see lexer_load ()),
+ * put its tree in entry->ast and return nonzero; release the entry with
+ * cache_release (). A missing, unreadable or corrupt entry is a miss. Either
+ * way, 'entry' can be given to cache_store () afterwards. */
+int
+cache_lookup (struct cache *cache, struct lex *lex, struct cache_entry *entry);
+
+/* Store the file open in 'lex', after a miss on 'entry'. The file must have
+ * been lexed in full by lexer_lex () and parsed into 'flat'. Failing to write
+ * the entry is not an error; it is just left out. */
+void
+cache_store (struct cache *cache, struct cache_entry *entry, struct lex *lex,
+             struct flat_ast *flat);
+
+/* Release an entry found by cache_lookup () */
+void
+cache_release (struct cache_entry *entry);
+
+/* Print the hit, miss and eviction counts, and the cache's size, to 'f' */
+void
+cache_print_stats (struct cache *cache, FILE *f);
+
+#endif /* _CACHE_H */
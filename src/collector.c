@@ -2,6 +2,7 @@
 
 #include "collector.h"
 #include "error.h"
+#include "intern.h"
 #include <string.h>
 #include <stdlib.h>
 
@@ -74,6 +75,12 @@ coll_get (struct collector *coll)
     return s;
 }
 
+const char *
+coll_get_interned (struct collector *coll)
+{
+    return intern (coll->buffer, coll->buffer_used);
+}
+
 size_t
 coll_len (struct collector *coll)
 {
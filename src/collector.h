@@ -33,6 +33,11 @@ coll_append_s (struct collector *coll, const char *s);
 char *
 coll_get (struct collector *coll);
 
+/* Get the string interned (see intern.h), rather than as a new copy -
+ * complain and exit on error */
+const char *
+coll_get_interned (struct collector *coll);
+
 /* Get the string length */
 size_t
 coll_len (struct collector *coll);
@@ -3,7 +3,7 @@
 #include "config_file.h"
 #include "error.h"
 #include "internal_paths.h"
-#include "free_on_exit.h"
+#include "intern.h"
 
 #include <stdlib.h>
 #include <stdio.h>
@@ -11,15 +11,6 @@
 
 #define LINE_LENGTH 512
 
-/* Try strdup() and fail on OOM */
-static inline char *
-xstrdup (const char *s)
-{
-    char *dup = strdup (s);
-    if (!dup) error_errno ();
-    return dup;
-}
-
 /* Get an entire line into the buffer, not including \n. If the line doesn't
  * fit, complain.
  * buf: buffer to read into
@@ -61,7 +52,8 @@ load_config (struct config_file *cfg)
 {
     FILE *f;
     char const *path;
-    char *key, *value, *temp, *copy;
+    char *key, *value, *temp;
+    const char *copy;
     char line[LINE_LENGTH];
     size_t lineno;
 
@@ -126,8 +118,7 @@ load_config (struct config_file *cfg)
         }
 
         /* Store the value */
-        copy = xstrdup (value);
-        free_on_exit (copy);
+        copy = intern_s (value);
         if (!strcmp (key, "crt1-32")) {
             cfg->crt1_32 = copy;
         } else if (!strcmp (key, "crti-32")) {
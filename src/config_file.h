@@ -10,10 +10,9 @@ struct config_file {
          *llc, *llvm_as, *as, *ld;
 };
 
-/* Load the configuration file. Note that while the strings inside the struct
- * are malloc()ed, since they'll be held for the program's entire existence,
- * there's no reason to bother free()ing. If the file doesn't mention a certain
- * path, the path in the struct will be NULL. */
+/* Load the configuration file. The strings inside the struct are interned (see
+ * intern.h), so they last for the program's entire existence. If the file
+ * doesn't mention a certain path, the path in the struct will be NULL. */
 void
 load_config (struct config_file *cfg);
 
@@ -3,6 +3,8 @@
 #ifndef _ENV_H
 #define _ENV_H 1
 
+#include <stddef.h>
+
 /* Compilation environment. This holds information about compile options and
  * environment settings. */
 
@@ -28,6 +30,13 @@ struct env {
     /* Various warnings */
     int w_octalish;
 
+    /* Number of compile errors to stop a file at, or 0 for no limit */
+    size_t error_limit;
+
+    /* Whether to reorder the fields of every record and class, as @reorder
+     * does (see types/layout.h) */
+    int reorder_fields;
+
     /* Paths */
     char const *crt1_32, *crti_32, *crtn_32, *ldso_32, *runtime_32,
          *crt1_64, *crti_64, *crtn_64, *ldso_64, *runtime_64,
@@ -1,18 +1,77 @@
 /* Copyright (c) 2011, Christopher Pavlina. All rights reserved. */
 
-/* This code is for error reporting. Yes, it uses a global variable - this is
- * the only place in AlCo which does that. */
+/* This code is for error reporting. The program's name is global; it is set
+ * once, before any worker threads start, and only read after that. Where
+ * diagnostics go is kept per thread - see error_capture (). */
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <errno.h>
 #include <stdarg.h>
 #include <string.h>
+#include <setjmp.h>
 #include "lex/lex.h"
+#include "error.h"
 
 /* Name of the running program (argv[0]) */
 static char const *name;
 
+/* This thread's diagnostic stream (NULL for stderr), and where to jump on a
+ * fatal error (NULL to exit) */
+static __thread FILE *capture_stream;
+static __thread jmp_buf *capture_fatal;
+
+/* Number of compile warnings reported on this thread */
+static __thread size_t n_warnings;
+
+#define OUT (capture_stream ? capture_stream : stderr)
+
+void
+error_capture (FILE *stream, jmp_buf *fatal)
+{
+    capture_stream = stream;
+    capture_fatal = fatal;
+}
+
+/* End the compilation after a fatal error */
+static void
+fatal (void)
+{
+    if (capture_fatal)
+        longjmp (*capture_fatal, 1);
+    exit (1);
+}
+
+/* Stop reading with 'lex' after an error. Were its log printed straight away,
+ * that would have been the last diagnostic. */
+static void
+stop (struct lex *lex)
+{
+    if (lex->log && lex->log->n)
+        lex->log->diags[lex->log->n - 1].is_last = 1;
+    if (lex->log && lex->log->stop)
+        longjmp (*lex->log->stop, 1);
+    fatal ();
+}
+
+FILE *
+error_stream (void)
+{
+    return OUT;
+}
+
+void
+error_fail (void)
+{
+    fatal ();
+}
+
+size_t
+error_warnings (void)
+{
+    return n_warnings;
+}
+
 void
 error_set_name (char const *n) {
     name = n;
@@ -20,148 +79,382 @@ error_set_name (char const *n) {
 
 void
 error_errno () {
-    perror (name);
-    exit (1);
+    fprintf (OUT, "%s: %s\n", name, strerror (errno));
+    fatal ();
 }
 
 void
 error_message (const char *fmt, ...)
 {
-    fputs (name, stderr);
-    fputs (": error: ", stderr);
+    fputs (name, OUT);
+    fputs (": error: ", OUT);
     va_list ap;
     va_start (ap, fmt);
-    vfprintf (stderr, fmt, ap);
+    vfprintf (OUT, fmt, ap);
     va_end (ap);
-    fputc ('\n', stderr);
-    exit (1);
+    fputc ('\n', OUT);
+    fatal ();
 }
 
 
 void
 warning_message (const char *fmt, ...) {
-    fputs (name, stderr);
-    fputs (": warning: ", stderr);
+    fputs (name, OUT);
+    fputs (": warning: ", OUT);
     va_list ap;
     va_start (ap, fmt);
-    vfprintf (stderr, fmt, ap);
+    vfprintf (OUT, fmt, ap);
     va_end (ap);
-    fputc ('\n', stderr);
+    fputc ('\n', OUT);
 }
 
-/* Print out line number 'line' from the lexer (zero-based), with a caret at
- * 'col' and an underline running from 'start' to just before 'stop'. */
+/* Print out line number 'line' from the lexer (zero-based) to 'out', with a
+ * caret at 'col' and an underline running from 'start' to just before
+ * 'stop'. */
 static void
-annotate_line (struct lex *lex, size_t line, size_t col, size_t start,
-               size_t stop)
+annotate_line (FILE *out, struct lex *lex, size_t line, size_t col,
+               size_t start, size_t stop)
 {
     char *L = lex->lines[line];
     size_t i;
 
     /* Print line */
     for (i = 0; L[i] && L[i] != '\n'; ++i)
-        fputc (L[i], stderr);
-    fputc ('\n', stderr);
+        fputc (L[i], out);
+    fputc ('\n', out);
 
     /* Annotate */
     for (i = 0; L[i] && L[i] != '\n'; ++i) {
         if (i == col)
-            fputc ('^', stderr);
+            fputc ('^', out);
         else if (i >= start && i < stop && L[i] != '\t')
-            fputc ('~', stderr);
+            fputc ('~', out);
         else if (L[i] == '\t')
-            fputc ('\t', stderr);
+            fputc ('\t', out);
         else
-            fputc (' ', stderr);
+            fputc (' ', out);
     }
-    fputc ('\n', stderr);
+    fputc ('\n', out);
+}
+
+/* Where to write a compile diagnostic from 'lex': its log, if it keeps one,
+ * or straight out. Finish it with end_diag (). */
+static FILE *
+begin_diag (struct lex *lex)
+{
+    struct diag_log *log = lex->log;
+
+    if (!log)
+        return OUT;
+    if (!log->stream) {
+        log->stream = open_memstream (&log->text, &log->text_len);
+        if (!log->stream) error_errno ();
+    }
+    return log->stream;
+}
+
+/* Finish a compile diagnostic from 'lex', filing it in the log with where it
+ * would have been found in streaming mode: the lexer lexes token i as the
+ * parser first asks for it (see lexer_fill ()), so what it finds there - odd,
+ * 2i + 1 - comes after what the parser finds having asked for i tokens or
+ * fewer, and before what it finds having asked for more - even, twice the
+ * number asked for */
+static void
+end_diag (struct lex *lex, int is_error, int is_eof)
+{
+    struct diag_log *log = lex->log;
+    struct diag *d;
+    size_t mem;
+
+    if (!log)
+        return;
+    if (fflush (log->stream)) error_errno ();
+    if (log->n == log->mem) {
+        mem = log->mem ? 2 * log->mem : 16;
+        d = realloc (log->diags, mem * sizeof (*d));
+        if (!d) error_errno ();
+        log->diags = d;
+        log->mem = mem;
+    }
+    d = &log->diags[log->n];
+    d->start = log->n ? d[-1].start + d[-1].len : 0;
+    d->len = log->text_len - d->start;
+    d->is_error = is_error;
+    d->is_eof = is_eof;
+    d->is_last = 0;
+    d->order = lex->lexing ? 2 * lex->lexing - 1 : 2 * lex->asked;
+    d->pos = lexer_tell (lex);
+    ++log->n;
 }
 
 void
-cerror_at (struct lex *lex, struct token *tok, const char *fmt, ...)
+error_log_init (struct diag_log *log)
+{
+    log->diags = NULL;
+    log->n = log->mem = 0;
+    log->stream = NULL;
+    log->text = NULL;
+    log->text_len = 0;
+    log->stop = NULL;
+}
+
+void
+error_log_free (struct diag_log *log)
+{
+    if (log->stream && fclose (log->stream)) error_errno ();
+    free (log->text);
+    free (log->diags);
+}
+
+size_t
+error_log_errors_before (struct lex *lex, size_t start)
+{
+    struct diag_log *log = lex->log;
+    struct diag *d;
+    size_t n = 0, i;
+
+    for (i = 0; log && i < log->n; ++i) {
+        d = &log->diags[i];
+        if (d->order & 1 ? d->order < 2 * (start + 1) : d->pos <= start)
+            n += d->is_error;
+    }
+    return n;
+}
+
+/* How far error_print_logs () has got */
+struct printer {
+    struct lex *lex;
+    /* The next of the lexer's diagnostics in lex->log to print */
+    size_t next;
+    size_t errors;
+};
+
+/* Print diagnostic 'd' from 'log', and count it. Returns nonzero if nothing
+ * more should be printed: once that makes the file's limit, having said so,
+ * or if the reader stopped there. */
+static int
+print_diag (struct printer *p, struct diag_log *log, struct diag *d)
+{
+    size_t limit = p->lex->env->error_limit;
+
+    fwrite (log->text + d->start, 1, d->len, OUT);
+    if (!d->is_error) {
+        ++n_warnings;
+        return 0;
+    }
+    if (++p->errors == limit && !d->is_eof) {
+        fprintf (OUT, "%s: too many errors, stopping now\n", p->lex->file);
+        return 1;
+    }
+    return d->is_last;
+}
+
+/* Print the parser's diagnostic 'd' from 'log', after those of the lexer's
+ * which come before it; or with 'd' NULL, the rest of the lexer's. Returns
+ * nonzero once the file's limit has been reached. */
+static int
+print_parser_diag (struct printer *p, struct diag_log *log, struct diag *d)
 {
+    struct diag_log *file = p->lex->log;
+    struct diag *l;
+
+    for (; file && p->next < file->n; ++p->next) {
+        l = &file->diags[p->next];
+        if (!(l->order & 1))
+            continue;
+        if (d && l->order > d->order)
+            break;
+        if (print_diag (p, file, l))
+            return 1;
+    }
+    return d && print_diag (p, log, d);
+}
+
+/* Print all of the parser's diagnostics in 'log', as print_parser_diag ()
+ * does */
+static int
+print_log (struct printer *p, struct diag_log *log)
+{
+    size_t i;
+
+    if (log->stream && fflush (log->stream)) error_errno ();
+    for (i = 0; i < log->n; ++i) {
+        if (!(log->diags[i].order & 1) &&
+            print_parser_diag (p, log, &log->diags[i]))
+            return 1;
+    }
+    return 0;
+}
+
+size_t
+error_print_logs (struct lex *lex, struct diag_log *parts,
+                  const size_t *starts, size_t n)
+{
+    struct diag_log *file = lex->log;
+    struct printer p;
+    struct diag *d;
+    size_t i, k = 0;
+
+    p.lex = lex;
+    p.next = 0;
+    p.errors = file ? 0 : lex->n_errors;
+
+    /* Each part goes where the file's reader skipped it, after what that had
+     * found by then */
+    if (file && file->stream && fflush (file->stream)) error_errno ();
+    for (i = 0; file && i < file->n; ++i) {
+        d = &file->diags[i];
+        if (d->order & 1)
+            continue;
+        for (; k < n && starts[k] < d->pos; ++k) {
+            if (print_log (&p, &parts[k]))
+                goto done;
+        }
+        if (print_parser_diag (&p, file, d))
+            goto done;
+    }
+    for (; k < n; ++k) {
+        if (print_log (&p, &parts[k]))
+            goto done;
+    }
+    print_parser_diag (&p, NULL, NULL);
+
+done:
+    return file ? p.errors : p.errors - lex->n_errors;
+}
+
+/* Count a compile error about to be reported against 'lex', and return its
+ * number in the file */
+static size_t
+count_error (struct lex *lex)
+{
+    return ++lex->n_errors;
+}
+
+/* Stop after reporting error number 'n' of 'lex', if that was the limit. A
+ * log is only cut off there once it is printed, and the lexer carries on to
+ * the end, as the parser needs all the tokens. */
+static void
+check_limit (struct lex *lex, size_t n)
+{
+    size_t limit = lex->env->error_limit;
+
+    if (limit && n >= limit) {
+        if (!lex->log)
+            fprintf (OUT, "%s: too many errors, stopping now\n", lex->file);
+        else if (lex->lexing)
+            return;
+        stop (lex);
+    }
+}
+
+/* Print a compile error or warning at 'tok': its line, with a caret at the
+ * token's start and the rest of it underlined, or with 'after', just the
+ * caret */
+static void
+report (struct lex *lex, struct token *tok, const char *kind, int after,
+        const char *fmt, va_list ap)
+{
+    FILE *out = begin_diag (lex);
+    size_t line, col;
+    lexer_locate (lex, tok->offset, &line, &col);
+
     // Basic prefix: file:line:col: error:
-    fprintf (stderr, "%s:%zu:%zu: error: ", lex->file,
-            tok->line + 1, tok->col + 1);
+    fprintf (out, "%s:%zu:%zu: %s: ", lex->file, line + 1, col + 1, kind);
 
     // Custom message
+    vfprintf (out, fmt, ap);
+    fputc ('\n', out);
+
+    if (after)
+        annotate_line (out, lex, line, col, 0, 0);
+    else
+        annotate_line (out, lex, line, col, col, col + tok->len);
+    end_diag (lex, kind[0] == 'e', 0);
+}
+
+void
+cerror_at (struct lex *lex, struct token *tok, const char *fmt, ...)
+{
+    size_t n = count_error (lex);
     va_list ap;
     va_start (ap, fmt);
-    vfprintf (stderr, fmt, ap);
+    report (lex, tok, "error", 0, fmt, ap);
     va_end (ap);
-    fputc ('\n', stderr);
-
-    annotate_line (lex, tok->line, tok->col, tok->col,
-                   tok->col + strlen (tok->value));
 
-    exit (1);
+    check_limit (lex, n);
+    lex->error_offset = tok->offset;
+    if (lex->recover)
+        longjmp (*lex->recover, 1);
+    stop (lex);
 }
 
 void
 cerror_after (struct lex *lex, struct token *tok, const char *fmt, ...)
 {
-    // Basic prefix: file:line:col: error:
-    fprintf (stderr, "%s:%zu:%zu: error: ", lex->file,
-            tok->line + 1, tok->col + 1);
-
-    // Custom message
+    size_t n = count_error (lex);
     va_list ap;
     va_start (ap, fmt);
-    vfprintf (stderr, fmt, ap);
+    report (lex, tok, "error", 1, fmt, ap);
     va_end (ap);
-    fputc ('\n', stderr);
 
-    annotate_line (lex, tok->line, tok->col, 0, 0);
+    check_limit (lex, n);
+    lex->error_offset = tok->offset + tok->len;
+    if (lex->recover)
+        longjmp (*lex->recover, 1);
+    stop (lex);
+}
 
-    exit (1);
+void
+cerror_continue (struct lex *lex, struct token *tok, const char *fmt, ...)
+{
+    size_t n = count_error (lex);
+    va_list ap;
+    va_start (ap, fmt);
+    report (lex, tok, "error", 0, fmt, ap);
+    va_end (ap);
+
+    check_limit (lex, n);
 }
 
 void
 cwarning_at (struct lex *lex, struct token *tok, const char *fmt, ...)
 {
-    // Basic prefix: file:line:col: warning:
-    fprintf (stderr, "%s:%zu:%zu: warning: ", lex->file,
-            tok->line + 1, tok->col + 1);
-
-    // Custom message
     va_list ap;
+    if (!lex->log)
+        ++n_warnings;
     va_start (ap, fmt);
-    vfprintf (stderr, fmt, ap);
+    report (lex, tok, "warning", 0, fmt, ap);
     va_end (ap);
-    fputc ('\n', stderr);
-
-    annotate_line (lex, tok->line, tok->col, tok->col,
-                   tok->col + strlen (tok->value));
 }
 
 void
 cwarning_after (struct lex *lex, struct token *tok, const char *fmt, ...)
 {
-    // Basic prefix: file:line:col: error:
-    fprintf (stderr, "%s:%zu:%zu: warning: ", lex->file,
-            tok->line + 1, tok->col + 1);
-
-    // Custom message
     va_list ap;
+    if (!lex->log)
+        ++n_warnings;
     va_start (ap, fmt);
-    vfprintf (stderr, fmt, ap);
+    report (lex, tok, "warning", 1, fmt, ap);
     va_end (ap);
-    fputc ('\n', stderr);
-
-    annotate_line (lex, tok->line, tok->col, 0, 0);
 }
 
 void
 cerror_eof (struct lex *lex, const char *fmt, ...)
 {
-    fprintf (stderr, "%s: unexpected end of file: ", lex->file);
+    FILE *out = begin_diag (lex);
+
+    fprintf (out, "%s: unexpected end of file: ", lex->file);
 
     // Custome message
     va_list ap;
     va_start (ap, fmt);
-    vfprintf (stderr, fmt, ap);
+    vfprintf (out, fmt, ap);
     va_end (ap);
-    fputc ('\n', stderr);
+    fputc ('\n', out);
+    end_diag (lex, 1, 1);
 
-    exit (1);
+    /* There is nothing left to recover with */
+    count_error (lex);
+    stop (lex);
 }
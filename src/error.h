@@ -4,11 +4,90 @@
 #define _MISC_H 1
 
 #include "lex/lex.h"
+#include <stdio.h>
+#include <setjmp.h>
 
 /* Store argv[0] for use in error messages */
 void
 error_set_name (char const *);
 
+/* Send the calling thread's diagnostics to 'stream' instead of stderr, and on
+ * a fatal error, longjmp () to 'fatal' (with value 1) instead of exiting. This
+ * lets worker threads collect each file's diagnostics separately - see
+ * jobs.h. Pass NULLs to go back to the defaults. */
+void
+error_capture (FILE *stream, jmp_buf *fatal);
+
+/* Where the calling thread's diagnostics go: stderr, or the stream given to
+ * error_capture () */
+FILE *
+error_stream (void);
+
+/* End the compilation as a fatal error does, but without a message - for when
+ * the errors have been reported already */
+void
+error_fail (void);
+
+/* Number of compile warnings (cwarning_at () and cwarning_after ()) reported
+ * so far on the calling thread - those kept in a log once printed */
+size_t
+error_warnings (void);
+
+/* Compile diagnostics from one reader of a file, kept to be printed later
+ * rather than printed at once - see struct lex's 'log'. Readers going through
+ * different parts of a file at once each keep their own, and
+ * error_print_logs () puts them back in order. */
+struct diag {
+    /* Where its text is in the log's */
+    size_t start, len;
+    /* Whether it is an error; an unexpected end of file, which ends the
+     * compilation without counting towards the limit; and whether the reader
+     * stopped at it, which would have ended the compilation too */
+    int is_error, is_eof, is_last;
+    /* Where it falls among the file's diagnostics (see error_print_logs ()),
+     * and where the reader was (lexer_tell ()) when it was found */
+    size_t order, pos;
+};
+
+struct diag_log {
+    struct diag *diags;
+    size_t n, mem;
+    /* The diagnostics' text, one after another; NULL until there is some */
+    FILE *stream;
+    char *text;
+    size_t text_len;
+    /* Where the reader jumps, with value 1, when it has to stop: at the end of
+     * the file, or once it has had env->error_limit errors, as none after
+     * those could be printed. NULL to stop as on a fatal error. */
+    jmp_buf *stop;
+};
+
+/* Make an empty log */
+void
+error_log_init (struct diag_log *log);
+
+/* Free a log, printed or not */
+void
+error_log_free (struct diag_log *log);
+
+/* The number of errors in lex->log which a reader going through the whole
+ * file would have found before getting to token 'start' (0 with no log) */
+size_t
+error_log_errors_before (struct lex *lex, size_t start);
+
+/* Print the diagnostics kept in lex->log, by the lexer (see lexer_lex ()) and
+ * a reader of the file which skipped some of it, with those in 'parts', the
+ * 'n' logs kept by other readers of the parts skipped - in order, each
+ * starting at token starts[i]. They come out as they would have with one
+ * reader going through the whole file in streaming mode (see
+ * lexer_stream ()), and stop once env->error_limit errors have been printed,
+ * as they would have then. Either log may be missing: if lex->log is NULL,
+ * the file's own diagnostics have been printed already, and lex->n_errors
+ * counts towards the limit. Returns the number of errors printed. */
+size_t
+error_print_logs (struct lex *lex, struct diag_log *parts,
+                  const size_t *starts, size_t n);
+
 /* Report an error based on errno, then exit. */
 void
 error_errno ();
@@ -21,15 +100,24 @@ error_message (const char *fmt, ...);
 void
 warning_message (const char *fmt, ...);
 
-/* Report a compile error, then exit. printf() usage. */
+/* Report a compile error. printf() usage. If the parser has set a recovery
+ * point (lex->recover), longjmp () there to carry on past it; otherwise,
+ * exit. Either way, exit once the file has had env->error_limit errors. A
+ * reader keeping a log (lex->log) stops as the log says instead. */
 void
 cerror_at (struct lex *lex, struct token *tok, const char *fmt, ...);
 
+/* Report a compile error and return, for the lexer to carry on from. The
+ * file's errors are still counted towards the limit. printf() usage. */
+void
+cerror_continue (struct lex *lex, struct token *tok, const char *fmt, ...);
+
 /* Report a compile warning. printf() usage. */
 void
 cwarning_at (struct lex *lex, struct token *tok, const char *fmt, ...);
 
-/* Report a compile error, then exit. printf() usage. */
+/* Report a compile error just after 'tok', as cerror_at () does. printf()
+ * usage. */
 void
 cerror_after (struct lex *lex, struct token *tok, const char *fmt, ...);
 
@@ -8,6 +8,15 @@
 #include <sys/stat.h>
 #include <unistd.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <dirent.h>
+#include <utime.h>
+
+#ifdef HAVE_MMAP
+#include <sys/mman.h>
+#endif
 
 size_t
 size_of (const char *path)
@@ -32,6 +41,140 @@ size_of_f (FILE *f)
     return sbuf.st_size;
 }
 
+int
+make_dir (const char *path)
+{
+    struct stat sbuf;
+
+    if (!mkdir (path, 0777))
+        return 0;
+    if (errno == EEXIST && !stat (path, &sbuf) && S_ISDIR (sbuf.st_mode))
+        return 0;
+    return -1;
+}
+
+time_t
+mtime_of (const char *path)
+{
+    struct stat sbuf;
+    if (stat (path, &sbuf)) {
+        return 0;
+    }
+    return sbuf.st_mtime;
+}
+
+int
+touch_file (const char *path)
+{
+    return utime (path, NULL);
+}
+
+int
+list_files (const char *dir,
+            void (*fn) (const char *name, size_t size, time_t mtime,
+                        void *ctx),
+            void *ctx)
+{
+    DIR *d;
+    struct dirent *ent;
+    struct stat sbuf;
+    size_t dir_len = strlen (dir);
+    char *path;
+    int errno_temp;
+
+    d = opendir (dir);
+    if (!d) return -1;
+    path = malloc (dir_len + 2 + 256);
+    if (!path) {
+        closedir (d);
+        return -1;
+    }
+
+    errno = 0;
+    while ((ent = readdir (d))) {
+        if (strlen (ent->d_name) >= 256)
+            continue;
+        memcpy (path, dir, dir_len);
+        path[dir_len] = '/';
+        strcpy (path + dir_len + 1, ent->d_name);
+        if (!stat (path, &sbuf) && S_ISREG (sbuf.st_mode))
+            fn (ent->d_name, sbuf.st_size, sbuf.st_mtime, ctx);
+        errno = 0;
+    }
+
+    errno_temp = errno;
+    free (path);
+    closedir (d);
+    errno = errno_temp;
+    return errno ? -1 : 0;
+}
+
+#ifdef HAVE_MMAP
+
+/* Round 'len' plus the NUL up to a whole number of pages */
+static size_t
+map_size (size_t len)
+{
+    size_t page = (size_t) sysconf (_SC_PAGESIZE);
+    return ((len + 1) + page - 1) / page * page;
+}
+
+char *
+map_file_f (FILE *f, size_t *len_ptr)
+{
+    int fd;
+    struct stat sbuf;
+    size_t len;
+    void *base;
+
+    fd = fileno (f);
+    if (fstat (fd, &sbuf) || !S_ISREG (sbuf.st_mode) || sbuf.st_size <= 0)
+        return NULL;
+    len = sbuf.st_size;
+
+    /* Reserve zeroed anonymous memory with room for the NUL, then map the
+     * file over the front of it. The tail of the file's last page reads as
+     * zeroes; if the file fills that page exactly, the anonymous page after
+     * it supplies the NUL instead. */
+    base = mmap (NULL, map_size (len), PROT_READ | PROT_WRITE,
+                 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (base == MAP_FAILED)
+        return NULL;
+    if (mmap (base, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED,
+              fd, 0) == MAP_FAILED) {
+        munmap (base, map_size (len));
+        return NULL;
+    }
+
+    *len_ptr = len;
+    return base;
+}
+
+void
+unmap_file (char *text, size_t len)
+{
+    munmap (text, map_size (len));
+}
+
+#else /* HAVE_MMAP */
+
+char *
+map_file_f (FILE *f, size_t *len_ptr)
+{
+    (void) f;
+    (void) len_ptr;
+    return NULL;
+}
+
+void
+unmap_file (char *text, size_t len)
+{
+    (void) text;
+    (void) len;
+}
+
+#endif /* HAVE_MMAP */
+
 #else
 #error "Bad platform - don't know how to define filesystem functions"
 
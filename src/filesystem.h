@@ -21,9 +21,38 @@
  * Return the size of the open file in bytes. Returns 0 with errno set if the
  * file cannot be accessed. */
 
+/* char *map_file_f (FILE *f, size_t *len_ptr):
+ * Map the entire open file privately into memory, and put its size at
+ * *len_ptr. The mapping is writable (changes are never written back), and is
+ * followed by at least one NUL byte, at [*len_ptr]. Returns NULL if the file
+ * cannot be mapped - this includes pipes, special files and empty files, so
+ * the caller should fall back to reading it. Release with unmap_file (). */
+
+/* void unmap_file (char *text, size_t len):
+ * Release a mapping made by map_file_f (). 'len' is the size it returned. */
+
+/* int make_dir (const char *path):
+ * Create the directory 'path', unless there is one already. Returns nonzero
+ * with errno set on error. */
+
+/* time_t mtime_of (const char *path):
+ * Return the file's modification time. Returns 0 with errno set if the file
+ * cannot be accessed. */
+
+/* int touch_file (const char *path):
+ * Set the file's modification time to now. Returns nonzero with errno set on
+ * error. */
+
+/* int list_files (const char *dir, void (*fn) (const char *name, size_t size,
+ *                 time_t mtime, void *ctx), void *ctx):
+ * Call fn () for each regular file in 'dir', with its name (without the
+ * directory), size and modification time. Files which vanish while the
+ * directory is read are skipped. Returns nonzero with errno set on error. */
+
 #if defined (HAVE_UNISTD_H) && defined (HAVE_ACCESS)
 #include <unistd.h>
 #include <stdio.h>
+#include <time.h>
 
 #define f_access access
 
@@ -33,6 +62,27 @@ size_of (const char *path);
 size_t
 size_of_f (FILE *f);
 
+char *
+map_file_f (FILE *f, size_t *len_ptr);
+
+void
+unmap_file (char *text, size_t len);
+
+int
+make_dir (const char *path);
+
+time_t
+mtime_of (const char *path);
+
+int
+touch_file (const char *path);
+
+int
+list_files (const char *dir,
+            void (*fn) (const char *name, size_t size, time_t mtime,
+                        void *ctx),
+            void *ctx);
+
 #else
 #error "Bad platform - don't know how to define filesystem functions"
 
@@ -0,0 +1,166 @@
+/* Copyright (c) 2011, Christopher Pavlina. All rights reserved. */
+
+#include "intern.h"
+#include "arena.h"
+#include "error.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+
+/* The table is open-addressed, with linear probing. 'string' is NULL in
+ * empty slots. */
+struct slot {
+    const char *string;
+    uint32_t hash, len;
+};
+
+/* Strings are copied into an arena, so interning costs no malloc () per
+ * string */
+static struct arena strings;
+static struct slot *table = NULL;
+static size_t table_size = 0, n_strings = 0;
+
+/* Files are compiled in parallel (see jobs.h), so the table and arena are
+ * locked while they are used */
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* FNV-1a */
+static uint32_t
+hash_string (const char *s, size_t len)
+{
+    uint32_t h = 2166136261u;
+    size_t i;
+
+    for (i = 0; i < len; ++i) {
+        h ^= (unsigned char) s[i];
+        h *= 16777619u;
+    }
+    return h;
+}
+
+/* Double the size of the table */
+static void
+grow_table (void)
+{
+    struct slot *old = table;
+    size_t old_size = table_size, i, j;
+
+    table_size = old_size ? 2 * old_size : 1024;
+    table = calloc (table_size, sizeof (*table));
+    if (!table) error_errno ();
+
+    for (i = 0; i < old_size; ++i) {
+        if (!old[i].string) continue;
+        for (j = old[i].hash & (table_size - 1); table[j].string;
+             j = (j + 1) & (table_size - 1));
+        table[j] = old[i];
+    }
+    free (old);
+}
+
+/* Find the slot for a string: either the slot holding it, or the empty slot
+ * where it would go */
+static struct slot *
+find_slot (const char *s, size_t len, uint32_t hash)
+{
+    size_t i;
+
+    for (i = hash & (table_size - 1); table[i].string;
+         i = (i + 1) & (table_size - 1)) {
+        if (table[i].hash == hash && table[i].len == len &&
+            !memcmp (table[i].string, s, len))
+            break;
+    }
+    return &table[i];
+}
+
+/* Intern 's', using 'copy' as the interned copy if it is new. If 'copy' is
+ * NULL, a copy is made in the arena. */
+static const char *
+do_intern (const char *s, size_t len, const char *copy)
+{
+    struct slot *slot;
+    uint32_t hash;
+    char *mem;
+
+    if (len > UINT32_MAX)
+        error_message ("string too long to intern");
+    hash = hash_string (s, len);
+
+    pthread_mutex_lock (&lock);
+
+    // The first string sets everything up
+    if (!table)
+        arena_init (&strings);
+
+    // Keep the table at most three quarters full
+    if (4 * (n_strings + 1) > 3 * table_size)
+        grow_table ();
+
+    slot = find_slot (s, len, hash);
+    if (slot->string) {
+        copy = slot->string;
+        pthread_mutex_unlock (&lock);
+        return copy;
+    }
+
+    if (!copy) {
+        mem = arena_alloc (&strings, len + 1);
+        memcpy (mem, s, len);
+        mem[len] = 0;
+        copy = mem;
+    }
+    slot->string = copy;
+    slot->hash = hash;
+    slot->len = len;
+    ++n_strings;
+
+    pthread_mutex_unlock (&lock);
+    return copy;
+}
+
+const char *
+intern (const char *s, size_t len)
+{
+    return do_intern (s, len, NULL);
+}
+
+const char *
+intern_s (const char *s)
+{
+    return do_intern (s, strlen (s), NULL);
+}
+
+const char *
+intern_cat (const char *a, const char *b)
+{
+    size_t a_len = strlen (a), b_len = strlen (b);
+    char buf[256], *temp = buf;
+    const char *result;
+
+    if (a_len + b_len > sizeof (buf)) {
+        temp = malloc (a_len + b_len);
+        if (!temp) error_errno ();
+    }
+    memcpy (temp, a, a_len);
+    memcpy (temp + a_len, b, b_len);
+    result = do_intern (temp, a_len + b_len, NULL);
+    if (temp != buf) free (temp);
+    return result;
+}
+
+const char *
+intern_static (const char *s)
+{
+    return do_intern (s, strlen (s), s);
+}
+
+void
+intern_free (void)
+{
+    arena_free (&strings);
+    free (table);
+    table = NULL;
+    table_size = n_strings = 0;
+}
@@ -0,0 +1,40 @@
+/* Copyright (c) 2011, Christopher Pavlina. All rights reserved. */
+
+#ifndef _INTERN_H
+#define _INTERN_H 1
+
+#include <stddef.h>
+
+/* String interning. Identifiers, package names, type names and paths are
+ * interned once, and the same contents always give back the same pointer -
+ * so interned strings can be compared with ==, and each distinct string is
+ * only stored once however many times it appears. Interned strings are
+ * NUL-terminated and live in an arena shared by every file in the
+ * compilation; they stay valid until intern_free (). Interning is
+ * thread-safe. */
+
+/* Intern a string of 'len' characters, not necessarily NUL-terminated. Exits
+ * on error. */
+const char *
+intern (const char *s, size_t len);
+
+/* Intern a NUL-terminated string. Exits on error. */
+const char *
+intern_s (const char *s);
+
+/* Intern the concatenation of two NUL-terminated strings. Exits on error. */
+const char *
+intern_cat (const char *a, const char *b);
+
+/* Intern a NUL-terminated string which lives for the whole program (a string
+ * literal, for example). If the string is not already interned, it is used
+ * as it is rather than copied. Exits on error. */
+const char *
+intern_static (const char *s);
+
+/* Free all interned strings. This is only for leak checking - see
+ * free_on_exit.h. */
+void
+intern_free (void);
+
+#endif /* _INTERN_H */
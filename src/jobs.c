@@ -0,0 +1,148 @@
+/* Copyright (c) 2011, Christopher Pavlina. All rights reserved. */
+
+#include "jobs.h"
+#include "error.h"
+#include <pthread.h>
+#include <setjmp.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+struct job {
+    /* Captured diagnostics */
+    char *diag;
+    size_t diag_len;
+    int failed;
+};
+
+struct pool {
+    struct job *jobs;
+    size_t n_jobs, next_job;
+    unsigned n_workers;
+    pthread_mutex_t lock;
+    void (*fn) (size_t i, unsigned worker, void *ctx);
+    void *ctx;
+};
+
+/* Run job 'i' on worker 'worker' with its diagnostics captured. The job's
+ * state is only touched through 'job', not kept in locals, so that it
+ * survives the longjmp (). */
+static void
+run_job (struct pool *pool, size_t i, unsigned worker)
+{
+    struct job *job = &pool->jobs[i];
+    FILE *stream;
+    jmp_buf fatal;
+
+    stream = open_memstream (&job->diag, &job->diag_len);
+    if (!stream) error_errno ();
+
+    error_capture (stream, &fatal);
+    if (!setjmp (fatal))
+        pool->fn (i, worker, pool->ctx);
+    else
+        job->failed = 1;
+    error_capture (NULL, NULL);
+
+    if (fclose (stream)) error_errno ();
+}
+
+/* The argument of one worker thread */
+struct worker {
+    struct pool *pool;
+    unsigned number;
+};
+
+static void *
+worker (void *arg)
+{
+    struct worker *w = arg;
+    struct pool *pool = w->pool;
+    size_t i;
+
+    while (1) {
+        pthread_mutex_lock (&pool->lock);
+        i = pool->next_job < pool->n_jobs ? pool->next_job++ : pool->n_jobs;
+        pthread_mutex_unlock (&pool->lock);
+        if (i == pool->n_jobs) break;
+        run_job (pool, i, w->number);
+    }
+    return NULL;
+}
+
+size_t
+run_tasks (size_t n, int n_threads,
+           void (*fn) (size_t i, unsigned worker, void *ctx), void *ctx)
+{
+    struct pool pool;
+    struct worker *workers;
+    pthread_t *threads;
+    FILE *out = error_stream ();
+    size_t i, n_failed = 0;
+    int err;
+
+    if (n_threads < 1) n_threads = 1;
+    if ((size_t) n_threads > n) n_threads = n;
+
+    pool.jobs = calloc (n, sizeof (*pool.jobs));
+    threads = malloc (n_threads * sizeof (*threads));
+    workers = malloc (n_threads * sizeof (*workers));
+    if ((n && !pool.jobs) || (n_threads && (!threads || !workers)))
+        error_errno ();
+    pool.n_jobs = n;
+    pool.next_job = 0;
+    pool.fn = fn;
+    pool.ctx = ctx;
+    pthread_mutex_init (&pool.lock, NULL);
+
+    for (i = 0; i < (size_t) n_threads; ++i) {
+        workers[i].pool = &pool;
+        workers[i].number = i;
+        err = pthread_create (&threads[i], NULL, worker, &workers[i]);
+        if (err)
+            error_message ("cannot start worker thread: %s", strerror (err));
+    }
+    for (i = 0; i < (size_t) n_threads; ++i)
+        pthread_join (threads[i], NULL);
+
+    /* Print everything in the order of the tasks */
+    for (i = 0; i < n; ++i) {
+        fwrite (pool.jobs[i].diag, 1, pool.jobs[i].diag_len, out);
+        free (pool.jobs[i].diag);
+        n_failed += pool.jobs[i].failed;
+    }
+
+    pthread_mutex_destroy (&pool.lock);
+    free (workers);
+    free (threads);
+    free (pool.jobs);
+    return n_failed;
+}
+
+/* run_jobs ()'s arguments, for run_tasks () */
+struct file_jobs {
+    const char **paths;
+    void (*fn) (const char *path, void *ctx);
+    void *ctx;
+};
+
+static void
+run_file_job (size_t i, unsigned worker, void *ctx)
+{
+    struct file_jobs *jobs = ctx;
+
+    (void) worker;
+    jobs->fn (jobs->paths[i], jobs->ctx);
+}
+
+size_t
+run_jobs (const char **paths, size_t n, int n_threads,
+          void (*fn) (const char *path, void *ctx), void *ctx)
+{
+    struct file_jobs jobs;
+
+    jobs.paths = paths;
+    jobs.fn = fn;
+    jobs.ctx = ctx;
+    return run_tasks (n, n_threads, run_file_job, &jobs);
+}
@@ -0,0 +1,35 @@
+/* Copyright (c) 2011, Christopher Pavlina. All rights reserved. */
+
+#ifndef _JOBS_H
+#define _JOBS_H 1
+
+#include <stddef.h>
+
+/* Worker pool for compiling independent source files at once (option -j).
+ *
+ * Each job's diagnostics are captured separately (see error_capture ()), and
+ * printed in job order once every job has finished, so the output
+ * is the same however the jobs were scheduled. A fatal error only ends its
+ * own job; the others still run.
+ *
+ * Anything the jobs share must be safe to use from many threads at once.
+ * Build it all before calling run_jobs () and only read it from the jobs, or
+ * lock it (as intern.c does).
+ */
+
+/* Run fn (paths[i], ctx) for each of the 'n' paths, on up to 'n_threads'
+ * threads. 'fn' reports errors as usual, through error.h. Returns the number
+ * of jobs which failed. Exits on error. */
+size_t
+run_jobs (const char **paths, size_t n, int n_threads,
+          void (*fn) (const char *path, void *ctx), void *ctx);
+
+/* Run fn (i, worker, ctx) for each i below 'n', as run_jobs () does. 'worker'
+ * is the number of the thread running the task, below 'n_threads', for
+ * keeping state per thread. The diagnostics go wherever the calling thread's
+ * do (see error_stream ()), so a job may run tasks of its own. */
+size_t
+run_tasks (size_t n, int n_threads,
+           void (*fn) (size_t i, unsigned worker, void *ctx), void *ctx);
+
+#endif /* _JOBS_H */
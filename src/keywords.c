@@ -1,41 +1,37 @@
 /* Copyright (c) 2011, Christopher Pavlina. All rights reserved. */
 
 #include "keywords.h"
+#include "keyword_tables.h"
 #include <string.h>
 
-const char *_KEYWORDS[] = {
-    "class", "extern", "macro",
-    "let", "const", "static", "volatile", "threadlocal", "nomangle",
-    "null", "allowconflict", "global",
-    "record", "switch", "case", "default", "if", "else", "for",
-    "foreach", "do", "while", "return", "as", "true", "false",
-    NULL};
-
-const char *_TYPES[] = {
-    "i8", "i16", "i32", "i64", "ssize", "int",
-    "u8", "u16", "u32", "u64", "size", "unsigned",
-    "f16", "f32", "f64", "float", "double", "var", "void", "bool",
-    NULL};
-
-const char **KEYWORDS = &_KEYWORDS[0];
-const char **TYPES = &_TYPES[0];
+const char **KEYWORDS = &kw_keywords[0];
+const char **TYPES = &kw_types[0];
 
 int
-is_keyword (const char *word, int include_types)
+keyword_id (const char *word, size_t len)
 {
-    size_t i;
+    unsigned h;
+
+    if (!len) return TOK_NONE;
+    h = KW_HASH (word, len);
+    if (kw_table[h].len == len && !memcmp (word, kw_table[h].spelling, len))
+        return kw_table[h].id;
+    return TOK_NONE;
+}
 
-    for (i = 0; KEYWORDS[i]; ++i) {
-        if (!strcmp (KEYWORDS[i], word))
-            return 1;
-    }
+const char *
+keyword_name (const char *word, size_t len, int include_types)
+{
+    int id = keyword_id (word, len);
 
-    if (include_types) {
-        for (i = 0; TYPES[i]; ++i) {
-            if (!strcmp (TYPES[i], word))
-                return 1;
-        }
-    }
+    if (id >= TOK_FIRST_KEYWORD &&
+        id < (include_types ? TOK_END_TYPE : TOK_END_KEYWORD))
+        return kw_table[KW_HASH (word, len)].spelling;
+    return NULL;
+}
 
-    return 0;
+int
+is_keyword (const char *word, size_t len, int include_types)
+{
+    return keyword_name (word, len, include_types) != NULL;
 }
@@ -3,16 +3,36 @@
 #ifndef _KEYWORDS_H
 #define _KEYWORDS_H 1
 
+#include "lex/token_ids.h"
+#include <stddef.h>
+
+/* Keywords, builtin type names and contextual words all come from
+ * autogen/lexer.spec, which also gives each one a token ID. */
+
 /* Array of all keywords, excluding special type names. Ends in NULL */
-const char **KEYWORDS;
+extern const char **KEYWORDS;
 
 /* Array of all special type names. Ends in NULL */
-const char **TYPES;
+extern const char **TYPES;
+
+/* Look up a word of length 'len' (not necessarily NUL-terminated). Return its
+ * token ID if it is a keyword, builtin type name or contextual word, or
+ * TOK_NONE. This is one hash and one compare. */
+int
+keyword_id (const char *word, size_t len);
 
 /* Check whether a words is a keyword.
  * include_types: Whether to include special type names as "keywords"
  */
 int
-is_keyword (const char *word, int include_types);
+is_keyword (const char *word, size_t len, int include_types);
+
+/* Look up a word of length 'len' (not necessarily NUL-terminated) in the
+ * keyword table. Return the table's own copy of the keyword, or NULL if the
+ * word is not a keyword.
+ * include_types: Whether to include special type names as "keywords"
+ */
+const char *
+keyword_name (const char *word, size_t len, int include_types);
 
 #endif /* _KEYWORDS_H */
@@ -1,118 +1,151 @@
 /* Copyright (c) 2011, Christopher Pavlina. All rights reserved. */
 
 #include "lex.h"
-#include "../stringlist.h"
 #include "../filesystem.h"
 #include "../error.h"
-#include "../collector.h"
+#include "../keywords.h"
+#include "../types/builtin_types.h"
+#include "scan.h"
+#include "number.h"
+#include "lex_tables.h"
 #include <errno.h>
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
 #include <assert.h>
+#include <float.h>
 
 void
 lexer_init (char const *file, struct env *env, struct lex *lex)
 {
     lex->file = file;
     lex->env = env;
-    lex->tokens = NULL;
+    lex->tok_types = NULL;
+    lex->tok_ids = NULL;
+    lex->tok_offsets = NULL;
+    lex->tok_lens = NULL;
+    lex->tok_nums = NULL;
     lex->n_tokens = 0;
+    lex->tokens_mem = 0;
+    lex->tok_mask = (size_t) -1;
     lex->token_idx = 0;
+    lex->split_idx = lex->split_len = 0;
+    lex->streaming = 0;
+    lex->pos = 0;
     lex->text = NULL;
     lex->text_len = 0;
+    lex->text_mapped = 0;
     lex->lines = NULL;
+    lex->n_lines = 0;
+    lex->n_errors = 0;
+    lex->recover = NULL;
+    lex->error_offset = 0;
+    lex->asked = lex->lexing = 0;
+    lex->log = NULL;
 }
 
 void
 lexer_free (struct lex *lex)
 {
-    size_t i;
-
-    if (lex->tokens) {
-        for (i = 0; i < lex->n_tokens; ++i) {
-            if (lex->tokens[i].value) free (lex->tokens[i].value);
-        }
-        free (lex->tokens);
-    }
-    if (lex->text)
+    if (lex->tok_types)
+        free (lex->tok_types);
+    if (lex->tok_ids)
+        free (lex->tok_ids);
+    if (lex->tok_offsets)
+        free (lex->tok_offsets);
+    if (lex->tok_lens)
+        free (lex->tok_lens);
+    if (lex->tok_nums)
+        free (lex->tok_nums);
+    if (lex->text && lex->text_mapped)
+        unmap_file (lex->text, lex->text_len);
+    else if (lex->text)
         free (lex->text);
     if (lex->lines)
         free (lex->lines);
 }
 
-/* Get the entire contents of the file into a character array. The array will
- * be put at *text_ptr (and should be released with free()); the size will be
+/* Read the rest of an unmappable file (a pipe, for example) into a
+ * malloc()ed character array, which will be put at *text_ptr; the size will be
  * put at *text_sz_ptr. This function guarantees a NUL character at the end of
- * the array, at (*text_ptr)[*text_sz_ptr]. */
-#define CHUNK_SIZE 512
-static void
-get_text (char **text_ptr, size_t *text_sz_ptr, const char *file)
+ * the array, at (*text_ptr)[*text_sz_ptr]. Returns nonzero with errno set on
+ * error. */
+#define CHUNK_SIZE 4096
+static int
+read_text (char **text_ptr, size_t *text_sz_ptr, FILE *f)
 {
-    FILE *f = NULL;
-    char buffer[CHUNK_SIZE];
     char *new_text;
     size_t text_buf_sz, n_read;
-    int errno_temp;
-
-    f = fopen (file, "r");
-    if (!f) goto err;
 
     // text_buf_sz should be equal to the size of the file plus one, unless we
     // were given something funny like a named pipe
     text_buf_sz = size_of_f (f) + 1;
-    if (text_buf_sz == 1 && errno) {
-        // Bizarre - stat() error after successful fopen()
-        goto err;
-    }
+    if (text_buf_sz < CHUNK_SIZE + 1)
+        text_buf_sz = CHUNK_SIZE + 1;
 
     *text_ptr = malloc (text_buf_sz);
-    if (!*text_ptr) goto err;
+    if (!*text_ptr) return 1;
     *text_sz_ptr = 0;
 
     while (1) {
-        n_read = fread (buffer, 1, CHUNK_SIZE, f);
-        errno_temp = errno;
-        if (*text_sz_ptr + n_read > (text_buf_sz - 1)) {
+        if (*text_sz_ptr + CHUNK_SIZE > text_buf_sz - 1) {
             new_text = realloc (*text_ptr, 2 * (text_buf_sz - 1) + 1);
-            if (!new_text) goto err;
+            if (!new_text) return 1;
             *text_ptr = new_text;
             text_buf_sz = (text_buf_sz - 1) * 2 + 1;
         }
-        memcpy (*text_ptr + *text_sz_ptr, buffer, n_read);
+        // Read straight into the buffer - there is always room for a chunk
+        n_read = fread (*text_ptr + *text_sz_ptr, 1, CHUNK_SIZE, f);
         *text_sz_ptr += n_read;
 
         if (feof (f)) break;
-        else if (ferror (f)) {
-            errno = errno_temp;
-            goto err;
-        }
+        else if (ferror (f)) return 1;
     }
     (*text_ptr)[*text_sz_ptr] = 0;
+    return 0;
+}
+#undef CHUNK_SIZE
 
-    fclose (f);
-    f = NULL;
-    return;
+/* Get the entire contents of the file into lex->text. Regular files are
+ * mapped into memory, so the lexer runs directly over the page cache; anything
+ * else is read into a buffer. Either way, there is a NUL character at the end
+ * of the text, at lex->text[lex->text_len]. Exits on error. */
+static void
+get_text (struct lex *lex)
+{
+    FILE *f;
+    int errno_temp;
+
+    f = fopen (lex->file, "r");
+    if (!f) error_errno ();
+
+    lex->text = map_file_f (f, &lex->text_len);
+    if (lex->text) {
+        lex->text_mapped = 1;
+    } else if (read_text (&lex->text, &lex->text_len, f)) {
+        errno_temp = errno;
+        if (lex->text) free (lex->text);
+        lex->text = NULL;
+        fclose (f);
+        errno = errno_temp;
+        error_errno ();
+    }
 
-err:
-    errno_temp = errno;
-    if (*text_ptr) free (*text_ptr);
-    if (f) fclose (f);
-    errno = errno_temp;
-    error_errno ();
+    fclose (f);
 }
 
-/* Fill in the 'lines' array */
+/* Fill in the 'lines' array. This is only done when it is first needed. */
 static void
 mark_lines (struct lex *lex)
 {
-    size_t pos, count = 1;
+    char *p, *end = lex->text + lex->text_len;
+    size_t count = 1;
+
+    /* First, count the number of newlines. memchr() is much faster than a
+     * byte loop on big files. */
+    for (p = lex->text; (p = memchr (p, '\n', end - p)); ++p)
+        ++count;
 
-    /* First, count the number of newlines */
-    for (pos = 0; pos < lex->text_len; ++pos) {
-        if (lex->text[pos] == '\n') ++count;
-    }
-  
     /* Allocate the array */
     lex->lines = malloc (count * sizeof (*lex->lines));
     if (!lex->lines) error_errno ();
@@ -120,385 +153,355 @@ mark_lines (struct lex *lex)
     /* Fill in the array */
     lex->lines[0] = lex->text;
     count = 1;
-    for (pos = 0; pos < lex->text_len; ++pos) {
-        if (lex->text[pos] == '\n') {
-            /* Note that we can set the line at pos+1 - get_text() ensures a
-             * final NUL. */
-            lex->lines[count] = &lex->text[pos + 1];
-            ++count;
-        }
+    for (p = lex->text; (p = memchr (p, '\n', end - p)); ++p) {
+        /* Note that we can set the line at p+1 - get_text() ensures a
+         * final NUL. */
+        lex->lines[count] = p + 1;
+        ++count;
     }
+    lex->n_lines = count;
 }
 
-static void
-lexer_read_text (struct lex *lex)
+/* Allocate the token arrays, with room for 'tokens_mem' tokens. Returns
+ * nonzero with errno set on error. */
+static int
+alloc_tokens (struct lex *lex, size_t tokens_mem)
 {
-    int errno_temp;
+    lex->tokens_mem = tokens_mem;
+    lex->tok_types = malloc (lex->tokens_mem * sizeof (*lex->tok_types));
+    lex->tok_ids = malloc (lex->tokens_mem * sizeof (*lex->tok_ids));
+    lex->tok_offsets = malloc (lex->tokens_mem * sizeof (*lex->tok_offsets));
+    lex->tok_lens = malloc (lex->tokens_mem * sizeof (*lex->tok_lens));
+    lex->tok_nums = malloc (lex->tokens_mem * sizeof (*lex->tok_nums));
+    return !lex->tok_types || !lex->tok_ids || !lex->tok_offsets ||
+        !lex->tok_lens || !lex->tok_nums;
+}
+
+void
+lexer_read (struct lex *lex)
+{
+    if (lex->text)
+        return;
 
     // Get the text into the text array. This will exit if there is an error
-    get_text (&lex->text, &lex->text_len, lex->file);
-    mark_lines (lex);
+    get_text (lex);
+    if (lex->text_len > UINT32_MAX)
+        error_message ("%s: file too large", lex->file);
+}
+
+/* Read the text, unless lexer_read () already has, and allocate the token
+ * arrays, with room for 'tokens_mem' tokens */
+static void
+lexer_read_text (struct lex *lex, size_t tokens_mem)
+{
+    int errno_temp;
 
-    // text_len is an upper bound for n_tokens
-    lex->tokens = malloc (lex->text_len * sizeof (*lex->tokens));
-    if (!lex->tokens) {
+    lexer_read (lex);
+    if (alloc_tokens (lex, tokens_mem)) {
         errno_temp = errno;
-        free (lex->text);
+        if (lex->text_mapped)
+            unmap_file (lex->text, lex->text_len);
+        else
+            free (lex->text);
+        lex->text = NULL;
         errno = errno_temp;
         error_errno ();
     }
 }
 
+/* Append a token with type 'type' and ID 'id', running from lex->text[first]
+ * for 'len' characters, to the token stream */
+static void
+add_token (struct lex *lex, int type, int id, size_t first, size_t len)
+{
+    size_t new_mem, slot;
+
+    // In streaming mode the arrays are a ring, and lexer_fill () makes sure
+    // there is always a free slot
+    if (!lex->streaming && lex->n_tokens == lex->tokens_mem) {
+        new_mem = 2 * lex->tokens_mem;
+        lex->tok_types = realloc (lex->tok_types,
+                                  new_mem * sizeof (*lex->tok_types));
+        lex->tok_ids = realloc (lex->tok_ids,
+                                new_mem * sizeof (*lex->tok_ids));
+        lex->tok_offsets = realloc (lex->tok_offsets,
+                                    new_mem * sizeof (*lex->tok_offsets));
+        lex->tok_lens = realloc (lex->tok_lens,
+                                 new_mem * sizeof (*lex->tok_lens));
+        lex->tok_nums = realloc (lex->tok_nums,
+                                 new_mem * sizeof (*lex->tok_nums));
+        if (!lex->tok_types || !lex->tok_ids || !lex->tok_offsets ||
+            !lex->tok_lens || !lex->tok_nums)
+            error_errno ();
+        lex->tokens_mem = new_mem;
+    }
+    slot = lex->n_tokens & lex->tok_mask;
+    lex->tok_types[slot] = type;
+    lex->tok_ids[slot] = id;
+    lex->tok_offsets[slot] = first;
+    lex->tok_lens[slot] = len;
+    /* consume_number () puts in a number's value; anything else has none, and
+     * must not keep the value of whichever token had the slot before */
+    lex->tok_nums[slot].i = 0;
+    ++lex->n_tokens;
+}
+
+/* Complain about the character at lex->text[pos]. Lexing carries on; the
+ * caller decides whether the character is kept or skipped. */
 static void
-unexpected_char (struct lex *lex, char ch, size_t nline, size_t ncol,
-                 const char *suffix)
+unexpected_char (struct lex *lex, size_t pos, const char *suffix)
 {
-    char char_as_string[2] = {ch, 0};
-    struct token temp = {nline, ncol, 0, char_as_string};
-    cerror_at (lex, &temp, "unexpected character '\\x%02x'%s", ch, suffix);
+    char ch = lex->text[pos];
+    struct token temp = {&lex->text[pos], pos, 1, 0, TOK_NONE, {0}};
+    cerror_continue (lex, &temp, "unexpected character '\\x%02x'%s", ch,
+                     suffix);
 }
 
 static void
-consume_string (struct lex *lex, struct collector *coll,
-                size_t *nline, size_t *ncol, size_t *pos)
+consume_string (struct lex *lex, size_t *pos)
 {
-    size_t first_col = *ncol;
+    size_t first = *pos;
     int in_escape = 0, found_end = 0;
     char ch;
 
-    for (; *pos < lex->text_len; ++*pos, ++*ncol) {
+    for (; *pos < lex->text_len; ++*pos) {
         ch = lex->text[*pos];
+        /* A string can't run past the end of its line */
+        if (ch == '\n')
+            break;
         if (ch < ' ' || ch > '~') {
-            unexpected_char (lex, ch, *nline, *ncol, "");
+            unexpected_char (lex, *pos, "");
         }
-        coll_append (coll, ch);
-        if (ch == '"' && !in_escape && *ncol != first_col) {
+        if (ch == '"' && !in_escape && *pos != first) {
             found_end = 1;
             break;
         }
-        if (ch == '\\') in_escape = !in_escape;
+        /* An escape only covers the one character after the backslash */
+        in_escape = (ch == '\\' && !in_escape);
     }
 
     if (!found_end) {
-        struct token temp = {*nline, first_col, 0, "\""};
-        cerror_at (lex, &temp, "unexpected end of line while parsing string");
+        /* Leave it out; the parser will find something missing */
+        struct token temp = {&lex->text[first], first, 1, 0, TOK_NONE, {0}};
+        cerror_continue (lex, &temp,
+                         "unexpected end of line while parsing string");
+        return;
     }
 
-    struct token tok = {*nline, first_col, T_STRING, coll_get (coll)};
-    coll_clear (coll);
-    lex->tokens[lex->n_tokens] = tok;
-    ++lex->n_tokens;
+    /* Step over the closing quote; it is part of the token */
+    ++*pos;
+    add_token (lex, T_STRING, TOK_NONE, first, *pos - first);
 }
 
-static void
-consume_oper (struct lex *lex, struct collector *coll,
-                          size_t *nline, size_t *ncol, size_t *pos)
-{
-    char c1, c2, c3;
-    char const *oper = NULL;
-    c1 = lex->text[*pos];
-    c2 = (c1 ? lex->text[*pos + 1] : 0);
-    c3 = (c2 ? lex->text[*pos + 2] : 0);
-
-    switch (c1) {
-    case '/':
-        switch (c2) {
-        case '=': oper = "/="; break;
-        default:  oper = "/";
-        } break;
-    case '+':
-        switch (c2) {
-        case '+': oper = "++"; break;
-        case '=': oper = "+="; break;
-        default:  oper = "+";
-        } break;
-    case '-':
-        switch (c2) {
-        case '-': oper = "--"; break;
-        case '=': oper = "-="; break;
-        default:  oper = "-";
-        } break;
-    case '~':
-        oper = "~"; break;
-    case '*':
-        switch (c2) {
-        case '=': oper = "*="; break;
-        default:  oper = "*";
-        } break;
-    case '%':
-        switch (c2) {
-        case '%':
-            switch (c3) {
-            case '=': oper = "%%="; break;
-            default:  oper = "%%";
-            } break;
-        case '=': oper = "%="; break;
-        default:  oper = "%";
-        } break;
-    case '<':
-        switch (c2) {
-        case '<':
-            switch (c3) {
-            case '=': oper = "<<="; break;
-            default:  oper = "<<"; break;
-            } break;
-        case '=': oper = "<="; break;
-        default:  oper = "<";
-        } break;
-    case '>':
-        switch (c2) {
-        case '>':
-            switch (c3) {
-            case '=': oper = ">>="; break;
-            default:  oper = ">>"; break;
-            } break;
-        case '=': oper = ">="; break;
-        default:  oper = ">";
-        } break;
-    case '&':
-        switch (c2) {
-        case '&': oper = "&&"; break;
-        case '=': oper = "&="; break;
-        default:  oper = "&";
-        } break;
-    case '^':
-        switch (c2) {
-        case '=': oper = "^="; break;
-        default:  oper = "^";
-        } break;
-    case '|':
-        switch (c2) {
-        case '|': oper = "||"; break;
-        case '=': oper = "|="; break;
-        default:  oper = "|";
-        } break;
-    case '!':
-        switch (c2) {
-        case '=':
-            switch (c3) {
-            case '=': oper = "!=="; break;
-            default: oper = "!="; break;
-            } break;
-        default:  oper = "!"; break;
-        } break;
-    case '=':
-        switch (c2) {
-        case '=':
-            switch (c3) {
-            case '=': oper = "==="; break;
-            default:  oper = "=="; break;
-            } break;
-        default:  oper = "=";
-        } break;
-    case '(':
-        oper = "("; break;
-    case ')':
-        oper = ")"; break;
-    case '[':
-        oper = "["; break;
-    case ']':
-        oper = "]"; break;
-    case '{':
-        oper = "{"; break;
-    case '}':
-        oper = "}"; break;
-    case ',':
-        oper = ","; break;
-    case ':':
-        switch (c2) {
-        case '=': oper = ":="; break;
-        default:  oper = ":"; break;
-        } break;
-    case ';':
-        oper = ";"; break;
-    case '.':
-        if (c2 == '.' && c3 == '.') {
-            oper = "..."; break;
-        } else {
-            oper = "."; break;
+/* Match the longest operator at the start of 'text', looking at no more than
+ * 'max' characters. Return its token ID, with its length in *len_ptr, or
+ * TOK_NONE if there is none. */
+static int
+match_oper (const char *text, size_t max, size_t *len_ptr)
+{
+    unsigned state = LEX_OPER_START;
+    size_t i;
+    int id = TOK_NONE;
+
+    /* Run the operator DFA until it dies, remembering the last operator seen
+     * on the way */
+    for (i = 0; state && i < max; ++i) {
+        state = lex_oper_dfa[state][lex_oper_symbol[(unsigned char) text[i]]];
+        if (lex_oper_accept[state]) {
+            id = lex_oper_accept[state];
+            *len_ptr = i + 1;
         }
-    case '?':
-        oper = "?"; break;
     }
+    return id;
+}
 
-    if (!oper) {
-        unexpected_char (lex, c1, *nline, *ncol, "");
+static void
+consume_oper (struct lex *lex, size_t *pos)
+{
+    size_t len = 0;
+    int id;
+
+    id = match_oper (&lex->text[*pos], lex->text_len - *pos, &len);
+    if (id == TOK_NONE) {
+        unexpected_char (lex, *pos, "");
+        ++*pos;
+        return;
     }
 
-    // Use the collector as a strdup - it has standard error handling
-    coll_append_s (coll, oper);
-    struct token tok = {*nline, *ncol, T_OPER, coll_get (coll)};
-    *ncol += coll_len (coll);
-    *pos += coll_len (coll);
-    coll_clear (coll);
-    lex->tokens[lex->n_tokens] = tok;
-    ++lex->n_tokens;
+    add_token (lex, T_OPER, id, *pos, len);
+    *pos += len;
 }
 
-static void consume_block_comment (struct lex *lex, struct collector *coll,
-                                   size_t *nline, size_t *ncol, size_t *pos)
+static void consume_block_comment (struct lex *lex, size_t *pos)
 {
     /* This function is designed to be started just after the opening marker.
      * It runs to the closing marker, recursing to process nesting.
      * Complain if we hit the end of the file. */
 
     /* Mark the starting point, for any possible error message */
-    size_t first_col = *ncol, first_line = *nline;
+    size_t first = *pos - 2;
+    size_t first_line, first_col;
 
     while (*pos < lex->text_len) {
+        /* Markers start with * or /, so skip straight to the next of those */
+        *pos = scan_comment_mark (lex->text, *pos, lex->text_len);
+        if (*pos >= lex->text_len)
+            break;
+
         if (lex->text[*pos] == '/' && lex->text[*pos + 1] == '*') {
             /* Nested comment */
-            *ncol += 2;
             *pos += 2;
-            consume_block_comment (lex, coll, nline, ncol, pos);
+            consume_block_comment (lex, pos);
 
         } else if (lex->text[*pos] == '*' && lex->text[*pos + 1] == '/') {
-            *ncol += 2;
             *pos += 2;
             return;
 
-        } else if (lex->text[*pos] == '\n') {
-            ++*nline;
-            *ncol = 0;
-            ++*pos;
-
         } else {
-            ++*ncol;
             ++*pos;
         }
     }
 
-    cerror_eof (lex, "comment started at %d:%d", first_line + 1,
+    lexer_locate (lex, first, &first_line, &first_col);
+    cerror_eof (lex, "comment started at %zu:%zu", first_line + 1,
                 first_col + 1);
 }
 
-static void consume_oper_or_comment (struct lex *lex, struct collector *coll,
-                                     size_t *nline, size_t *ncol, size_t *pos)
+static void consume_oper_or_comment (struct lex *lex, size_t *pos)
 {
     if (lex->text[*pos] == '/' && lex->text[*pos + 1] == '/') {
         // Line comment - skip the rest of the line
-        for (; *pos < lex->text_len; ++*pos) {
-            if (lex->text[*pos] == '\n') {
-                break;
-            } else {
-                ++*ncol;
-            }
-        }
+        *pos = scan_line_end (lex->text, *pos, lex->text_len);
 
     } else if (lex->text[*pos] == '/' && lex->text[*pos + 1] == '*') {
         // Block comment
         *pos += 2;
-        *ncol += 2;
-        consume_block_comment (lex, coll, nline, ncol, pos);
+        consume_block_comment (lex, pos);
 
     } else
-        consume_oper (lex, coll, nline, ncol, pos);
+        consume_oper (lex, pos);
 }
 
-static void consume_extrastandard (struct lex *lex, struct collector *coll,
-                                   size_t *nline, size_t *ncol, size_t *pos)
+static void consume_extrastandard (struct lex *lex, size_t *pos)
 {
-    int break_for = 0;
-    size_t first_col = *ncol;
-
-    for (; *pos < lex->text_len; ++*pos, ++*ncol) {
-        char ch = lex->text[*pos];
-        if (*ncol == first_col || *ncol == (first_col + 1)) {
-            if (ch != '$') {
-                char char_as_string[2] = {ch, 0};
-                struct token temp = {*nline, *ncol, 0, char_as_string};
-                cerror_at (lex, &temp, "extrastandard identifier must start "
-                           "with $$");
-            }
-            coll_append (coll, ch);
-            continue;
-        }
-        switch (ch) {
-        case '0': case '1': case '2': case '3': case '4': case '5':
-        case '6': case '7': case '8': case '9':
-            // Not valid as the first character after $$
-            if (*ncol == first_col + 2) {
-                unexpected_char (lex, ch, *nline, *ncol, "");
-            }
-            coll_append (coll, ch);
-            break;
-        case '_': case 'A': case 'B': case 'C': case 'D': case 'E': case 'F':
-        case 'G': case 'H': case 'I': case 'J': case 'K': case 'L': case 'M':
-        case 'N': case 'O': case 'P': case 'Q': case 'R': case 'S': case 'T':
-        case 'U': case 'V': case 'W': case 'X': case 'Y': case 'Z': case 'a':
-        case 'b': case 'c': case 'd': case 'e': case 'f': case 'g': case 'h':
-        case 'i': case 'j': case 'k': case 'l': case 'm': case 'n': case 'o':
-        case 'p': case 'q': case 'r': case 's': case 't': case 'u': case 'v':
-        case 'w': case 'x': case 'y': case 'z':
-            coll_append (coll, ch);
-            break;
-        default:
-            break_for = 1;
-            break;
+    size_t first = *pos;
+
+    // Called on the first $; the second must follow it. If it doesn't, skip
+    // just the $, and lex what follows as usual.
+    ++*pos;
+    if (*pos < lex->text_len) {
+        if (lex->text[*pos] != '$') {
+            struct token temp = {&lex->text[*pos], *pos, 1, 0, TOK_NONE, {0}};
+            cerror_continue (lex, &temp, "extrastandard identifier must "
+                             "start with $$");
+            return;
         }
-        if (break_for) break;
+        ++*pos;
+
+        // Not valid as the first character after $$
+        if (lex_char_class[(unsigned char) lex->text[*pos]] == CC_DIGIT)
+            unexpected_char (lex, *pos, "");
+
+        *pos = scan_word (lex->text, *pos, lex->text_len);
     }
-    struct token tok = {*nline, first_col, T_EXTRA, coll_get (coll)};
-    coll_clear (coll);
-    lex->tokens[lex->n_tokens] = tok;
-    ++lex->n_tokens;
+    add_token (lex, T_EXTRA, TOK_NONE, first, *pos - first);
 }
 
-static void consume_word (struct lex *lex, struct collector *coll,
-                          size_t *nline, size_t *ncol, size_t *pos)
+static void consume_word (struct lex *lex, size_t *pos)
 {
-    int break_for = 0;
-    int has_at = 0;
-    size_t first_col = *ncol;
+    size_t first = *pos;
+
+    if (lex->text[*pos] == '@') {
+        ++*pos;
+        // A digit is not valid straight after the @. Don't worry about words
+        // starting with a digit - they are picked up as numbers instead.
+        if (lex_char_class[(unsigned char) lex->text[*pos]] == CC_DIGIT)
+            unexpected_char (lex, *pos, "");
+    }
 
-    for (; *pos < lex->text_len; ++*pos, ++*ncol) {
-        char ch = lex->text[*pos];
-        switch (ch) {
-        case '@':
-            // Only valid as the first character
-            if (*ncol != first_col) {
-                unexpected_char (lex, ch, *nline, *ncol, "");
-            }
-            has_at = 1;
-            coll_append (coll, ch);
-            break;
-        case '0': case '1': case '2': case '3': case '4': case '5':
-        case '6': case '7': case '8': case '9':
-            // Not valid as the first character. Don't worry about the
-            // !has_at case, because if the first character were a digit,
-            // this wouldn't have been picked up as a word anyway
-            if (has_at) {
-                if (*ncol == first_col + 1) {
-                    unexpected_char (lex, ch, *nline, *ncol, "");
-                }
-            }
-            coll_append (coll, ch);
-            break;
-        case '_': case 'A': case 'B': case 'C': case 'D': case 'E': case 'F':
-        case 'G': case 'H': case 'I': case 'J': case 'K': case 'L': case 'M':
-        case 'N': case 'O': case 'P': case 'Q': case 'R': case 'S': case 'T':
-        case 'U': case 'V': case 'W': case 'X': case 'Y': case 'Z': case 'a':
-        case 'b': case 'c': case 'd': case 'e': case 'f': case 'g': case 'h':
-        case 'i': case 'j': case 'k': case 'l': case 'm': case 'n': case 'o':
-        case 'p': case 'q': case 'r': case 's': case 't': case 'u': case 'v':
-        case 'w': case 'x': case 'y': case 'z':
-            coll_append (coll, ch);
-            break;
-        default:
-            break_for = 1;
-            break;
+    // The rest of the word is letters, digits and underscores
+    *pos = scan_word (lex->text, *pos, lex->text_len);
+
+    // @ is only valid as the first character
+    if (lex->text[*pos] == '@')
+        unexpected_char (lex, *pos, "");
+
+    add_token (lex, T_WORD, keyword_id (&lex->text[first], *pos - first),
+               first, *pos - first);
+}
+
+/* Work out the value of the number lex->text[first] to lex->text[end], which
+ * consume_number () has found to be of 'type' in 'radix', and check that it
+ * fits its typespec. Names which are not integer or real types are left for
+ * the later phases to complain about. */
+static union token_num
+decode_number (struct lex *lex, int type, int radix, size_t first, size_t end)
+{
+    const char *text = &lex->text[first], *spec;
+    size_t len = end - first, prefix = (radix == 10) ? 0 : 2, digits_len;
+    int id, bits = 64, enc = -1, overflow;
+    uint64_t max;
+    union token_num num;
+    struct token temp = {text, first, len, type, TOK_NONE, {0}};
+
+    spec = memchr (text, ':', len);
+    digits_len = spec ? (size_t) (spec - text) : len;
+    if (spec) {
+        id = keyword_id (spec + 1, len - digits_len - 1);
+        if (id >= TOK_FIRST_TYPE && id < TOK_END_TYPE) {
+            bits = 8 * builtin_types[id - TOK_FIRST_TYPE].size;
+            enc = builtin_types[id - TOK_FIRST_TYPE].enc;
+            if (!bits)
+                bits = lex->env->bits;
         }
-        if (break_for) break;
+    } else if (radix == 10 && (text[digits_len - 1] | 0x20) == 'f') {
+        --digits_len;
     }
-    struct token tok = {*nline, first_col, T_WORD, coll_get (coll)};
-    coll_clear (coll);
-    lex->tokens[lex->n_tokens] = tok;
-    ++lex->n_tokens;
+
+    if (type == T_INT || prefix) {
+        if (number_parse_int (text + prefix, digits_len - prefix, radix,
+                              &num.i)) {
+            cerror_continue (lex, &temp, "number too large");
+            num.i = 0;
+            return num;
+        }
+    }
+
+    if (type == T_INT) {
+        /* Literals are never negative - the minus sign is an operator - so a
+         * signed type has to take the magnitude of its minimum, as in
+         * -128:i8 */
+        if (enc == UINT)
+            max = bits < 64 ? ((uint64_t) 1 << bits) - 1 : UINT64_MAX;
+        else if (enc == SINT)
+            max = (uint64_t) 1 << (bits - 1);
+        else
+            max = UINT64_MAX;
+        if (num.i > max)
+            cerror_continue (lex, &temp, "integer too large for its type");
+        return num;
+    }
+
+    if (prefix)
+        num.r = (double) num.i;
+    else
+        num.r = number_parse_real (text, digits_len);
+
+    /* A narrower float rounds anything from halfway between its largest
+     * value and the next power of two up to infinity */
+    if (enc == FLOAT && bits == 16)
+        overflow = num.r >= 65520.0;
+    else if (enc == FLOAT && bits == 32)
+        overflow = num.r >= 0x1.ffffffp127;
+    else
+        overflow = num.r > DBL_MAX;
+    if (overflow)
+        cerror_continue (lex, &temp, "real too large for its type");
+    return num;
 }
 
 static void
-consume_number (struct lex *lex, struct collector *coll,
-                size_t *nline, size_t *ncol, size_t *pos)
+consume_number (struct lex *lex, size_t *pos)
 {
     /* This is the number consumer. It handles all numbers except for character
      * values (those are, after all, technically u8 and u32 values). Numbers
@@ -513,7 +516,8 @@ consume_number (struct lex *lex, struct collector *coll,
      */
 
     int radix = 10, charval, type = T_INT;
-    size_t first_col = *ncol;
+    size_t first = *pos, errors = lex->n_errors;
+    union token_num num = {0};
     enum {prepoint, postpoint, exponent, expofirstdig, expomoredigs,
           intonly, typespec, muststop} state = prepoint;
 
@@ -528,26 +532,20 @@ consume_number (struct lex *lex, struct collector *coll,
             break;
         }
         if (radix != 10) {
-            coll_append (coll, '0');
-            coll_append (coll, lex->text[*pos + 1]);
             *pos += 2;
-            *ncol += 2;
             state = intonly;
         }
     }
 
-/* Macro: take a character and return the value, or -1 if invalid.
- * Currently Alpha doesn't accept any radix above 16, but this macro does. */
-#define CHARVAL(c)                                                      \
-    ((c >= '0' && c <= '9') ? (c - '0')                                 \
-     : (c >= 'a' && c <= 'z') ? (c - 'a' + 10)                          \
-     : (c >= 'A' && c <= 'Z') ? (c - 'A' + 10)                          \
-     : -1)
-#define STOPCHAR(c)                                                     \
-    ((c < '0' || c > '9') && (c < 'a' || c > 'f') && (c < 'A' || c > 'F'))
-
-    for (; *pos < lex->text_len; ++*pos, ++*ncol) {
+/* Digit values come from lex_char_value[], which gives every letter and digit
+ * its value in radix 36 and everything else LEX_NO_VALUE. Currently Alpha
+ * doesn't accept any radix above 16, but the table does. A character which
+ * is not a hex digit ends the number. */
+#define STOPCHAR(c) (lex_char_value[(unsigned char) (c)] >= 16)
+
+    for (; *pos < lex->text_len; ++*pos) {
         char ch = lex->text[*pos];
+        charval = lex_char_value[(unsigned char) ch];
         switch (state) {
         case prepoint:
             /* Before a decimal point, we can accept the following things:
@@ -559,30 +557,24 @@ consume_number (struct lex *lex, struct collector *coll,
              */
             switch (ch) {
             case '.':
-                coll_append (coll, ch);
                 type = T_REAL;
                 state = postpoint;
                 break;
             case ':':
-                coll_append (coll, ch);
                 state = typespec;
                 break;
             case 'e': case 'E':
-                coll_append (coll, ch);
                 type = T_REAL;
                 state = exponent;
                 break;
             case 'f': case 'F':
-                coll_append (coll, ch);
                 type = T_REAL;
                 state = muststop;
                 break;
             default:
                 if (STOPCHAR (ch)) goto out;
-                charval = CHARVAL (ch);
-                if (charval == -1 || charval >= 10)
-                    unexpected_char (lex, ch, *nline, *ncol, "");
-                coll_append (coll, ch);
+                if (charval >= 10)
+                    unexpected_char (lex, *pos, "");
             }
             break;
         case postpoint:
@@ -593,19 +585,15 @@ consume_number (struct lex *lex, struct collector *coll,
              */
             switch (ch) {
             case 'e': case 'E':
-                coll_append (coll, ch);
                 state = exponent;
                 break;
             case 'f': case 'F':
-                coll_append (coll, ch);
                 state = muststop;
                 break;
             default:
                 if (STOPCHAR (ch)) goto out;
-                charval = CHARVAL (ch);
-                if (charval == -1 || charval >= 10)
-                    unexpected_char (lex, ch, *nline, *ncol, "");
-                coll_append (coll, ch);
+                if (charval >= 10)
+                    unexpected_char (lex, *pos, "");
             }
             break;
         case exponent:
@@ -615,14 +603,11 @@ consume_number (struct lex *lex, struct collector *coll,
              */
             switch (ch) {
             case '+': case '-':
-                coll_append (coll, ch);
                 state = expofirstdig;
                 break;
             default:
-                charval = CHARVAL (ch);
-                if (charval == -1 || charval >= 10)
-                    unexpected_char (lex, ch, *nline, *ncol, "");
-                coll_append (coll, ch);
+                if (charval >= 10)
+                    unexpected_char (lex, *pos, "");
                 state = expomoredigs;
             }
             break;
@@ -631,10 +616,8 @@ consume_number (struct lex *lex, struct collector *coll,
              * following things:
              * digits: switch to expomoredigs
              */
-            charval = CHARVAL (ch);
-            if (charval == -1 || charval >= 10)
-                unexpected_char (lex, ch, *nline, *ncol, "");
-            coll_append (coll, ch);
+            if (charval >= 10)
+                unexpected_char (lex, *pos, "");
             state = expomoredigs;
             break;
         case expomoredigs:
@@ -645,40 +628,32 @@ consume_number (struct lex *lex, struct collector *coll,
              * ':': switch to typespec
              */
             if (ch == 'f') {
-                coll_append (coll, ch);
                 state = muststop;
                 break;
             } else if (ch == ':') {
-                coll_append (coll, ch);
                 state = typespec;
                 break;
             }
             if (STOPCHAR (ch)) {
                 goto out;
             }
-            charval = CHARVAL (ch);
-            if (charval == -1 || charval >= 10)
-                unexpected_char (lex, ch, *nline, *ncol, "");
-            coll_append (coll, ch);
+            if (charval >= 10)
+                unexpected_char (lex, *pos, "");
             break;
         case intonly:
             /* This state is used when we know for a fact that we can only have
              * int stuff. Allow digits in the radix, as well as a switch to
              * typespec. */
             if (ch == ':') {
-                coll_append (coll, ch);
                 state = typespec;
                 break;
             } else if (STOPCHAR (ch)) {
                 goto out;
             }
-            charval = CHARVAL (ch);
-            if (charval == -1)
-                unexpected_char (lex, ch, *nline, *ncol, "");
+            if (charval == LEX_NO_VALUE)
+                unexpected_char (lex, *pos, "");
             else if (charval >= radix)
-                unexpected_char (lex, ch, *nline, *ncol, " in this radix");
-            else
-                coll_append (coll, ch);
+                unexpected_char (lex, *pos, " in this radix");
             break;
 
         case typespec:
@@ -686,8 +661,8 @@ consume_number (struct lex *lex, struct collector *coll,
              * f{16,32,64}, float, double, {i,u}{8,16,32,64}, int, unsigned,
              * size, ssize. We don't validate them here; we'll take any
              * alphanum. */
-            /* Lazy shortcut: CHARVAL() returns >=0 for alphanum */
-            if (CHARVAL (ch) >= 0) {
+            /* Lazy shortcut: every alphanum has a digit value */
+            if (charval != LEX_NO_VALUE) {
                 if (lex->text[*pos - 1] == ':' &&
                     (ch == 'f' || ch == 'd')) {
                     /* Detect typespecs :f.* and :d.* - the only valid names
@@ -696,7 +671,6 @@ consume_number (struct lex *lex, struct collector *coll,
                     type = T_REAL;
                 }
 
-                coll_append (coll, ch);
                 break;
             } else
                 goto out;
@@ -706,7 +680,7 @@ consume_number (struct lex *lex, struct collector *coll,
              * of a number (this stops things like 3.2f9); finish otherwise.
              */
             if (!STOPCHAR (ch))
-                unexpected_char (lex, ch, *nline, *ncol, "");
+                unexpected_char (lex, *pos, "");
             goto out;
         default:
             assert (!"INVALID STATE IN LOOP");
@@ -715,101 +689,438 @@ consume_number (struct lex *lex, struct collector *coll,
 out:
     ;
 
-#undef CHARVAL
+#undef STOPCHAR
 
-    struct token tok = {*nline, first_col, type, coll_get (coll)};
-    coll_clear (coll);
-    lex->tokens[lex->n_tokens] = tok;
-    ++lex->n_tokens;
+    /* A malformed number has been complained about already; don't go on
+     * to complain about its value */
+    if (lex->n_errors == errors)
+        num = decode_number (lex, type, radix, first, *pos);
+    add_token (lex, type, TOK_NONE, first, *pos - first);
+    lex->tok_nums[(lex->n_tokens - 1) & lex->tok_mask] = num;
 }
 
-void
-lexer_lex (struct lex *lex)
+/* Lex from lex->pos up to and including the next token. Return zero, having
+ * added no token, at the end of the text. */
+static int
+lex_one (struct lex *lex)
 {
-    lexer_read_text (lex);
-    struct collector coll;
-    size_t nline = 0, ncol = 0, pos = 0;
-
-    coll_init (&coll);
-
-    while (pos < lex->text_len) {
-        switch (lex->text[pos]) {
-        case ' ': case 0x09: case 0x0b: case 0x0c: case 0x0d:
-            /* Whitespace */
-            ++pos;
-            ++ncol;
+    size_t pos = lex->pos, n_tokens = lex->n_tokens;
+
+    while (pos < lex->text_len && lex->n_tokens == n_tokens) {
+        switch (lex_char_class[(unsigned char) lex->text[pos]]) {
+        case CC_SPACE:
+            /* Whitespace. Lines are only worked out if a diagnostic needs
+             * them - see lexer_locate (). */
+            pos = scan_space (lex->text, pos, lex->text_len);
             continue;
 
-        case 0x0a:
-            /* Newline */
-            ++nline;
-            ++pos;
-            ncol = 0;
+        case CC_DIGIT:
+            consume_number (lex, &pos);
             break;
 
-        case '0': case '1': case '2': case '3': case '4': case '5':
-        case '6': case '7': case '8': case '9':
-            consume_number (lex, &coll, &nline, &ncol, &pos);
+        case CC_WORD: case CC_AT:
+            consume_word (lex, &pos);
             break;
 
-        case '@': case '_': case 'A': case 'B': case 'C': case 'D':
-        case 'E': case 'F': case 'G': case 'H': case 'I': case 'J':
-        case 'K': case 'L': case 'M': case 'N': case 'O': case 'P':
-        case 'Q': case 'R': case 'S': case 'T': case 'U': case 'V':
-        case 'W': case 'X': case 'Y': case 'Z': case 'a': case 'b':
-        case 'c': case 'd': case 'e': case 'f': case 'g': case 'h':
-        case 'i': case 'j': case 'k': case 'l': case 'm': case 'n':
-        case 'o': case 'p': case 'q': case 'r': case 's': case 't':
-        case 'u': case 'v': case 'w': case 'x': case 'y': case 'z':
-            consume_word (lex, &coll, &nline, &ncol, &pos);
+        case CC_DOLLAR:
+            consume_extrastandard (lex, &pos);
             break;
 
-        case '$':
-            consume_extrastandard (lex, &coll, &nline, &ncol, &pos);
+        case CC_SLASH:
+            consume_oper_or_comment (lex, &pos);
             break;
 
-        case '/':
-            consume_oper_or_comment (lex, &coll, &nline, &ncol, &pos);
+        case CC_OPER:
+            consume_oper (lex, &pos);
             break;
 
-        case '+': case '-': case '~': case '*': case '%': case '<':
-        case '>': case '&': case '^': case '|': case '!': case '=':
-        case '(': case ')': case '[': case ']': case '{': case '}':
-        case ',': case ';': case ':': case '.': case '?':
-            consume_oper (lex, &coll, &nline, &ncol, &pos);
+        case CC_QUOTE:
+            consume_string (lex, &pos);
             break;
 
-        case '"':
-            consume_string (lex, &coll, &nline, &ncol, &pos);
+        default:
+            unexpected_char (lex, pos, "");
+            ++pos;
+        }
+    }
+
+    lex->pos = pos;
+    return lex->n_tokens != n_tokens;
+}
+
+void
+lexer_lex (struct lex *lex)
+{
+    // Tokens are stored with 32-bit offsets. Start with a guess of one token
+    // per eight characters; add_token () grows the arrays as needed.
+    lexer_read_text (lex, lex->text_len / 8 + 16);
+    lex->tok_mask = (size_t) -1;
+
+    do
+        lex->lexing = lex->n_tokens + 1;
+    while (lex_one (lex));
+    lex->lexing = 0;
+}
+
+void
+lexer_stream (struct lex *lex)
+{
+    lexer_read_text (lex, LEX_RING);
+    lex->tok_mask = LEX_RING - 1;
+    lex->streaming = 1;
+}
+
+void
+lexer_load (struct lex *lex, size_t n, const unsigned char *types,
+            const unsigned char *ids, const uint32_t *offsets,
+            const uint32_t *lens, const union token_num *nums)
+{
+    lexer_read_text (lex, n ? n : 1);
+    lex->tok_mask = (size_t) -1;
+
+    memcpy (lex->tok_types, types, n * sizeof (*lex->tok_types));
+    memcpy (lex->tok_ids, ids, n * sizeof (*lex->tok_ids));
+    memcpy (lex->tok_offsets, offsets, n * sizeof (*lex->tok_offsets));
+    memcpy (lex->tok_lens, lens, n * sizeof (*lex->tok_lens));
+    memcpy (lex->tok_nums, nums, n * sizeof (*lex->tok_nums));
+    lex->n_tokens = n;
+    lex->pos = lex->text_len;
+}
+
+/* Patch lex->lines, which point into 'old_text', for an edit replacing
+ * old_text[start] to old_text[end] with 'len' characters of 'text', giving
+ * 'new_text'. Lines wholly before or after the edit are only moved. */
+static void
+patch_lines (struct lex *lex, const char *old_text, const char *new_text,
+             size_t start, size_t end, const char *text, size_t len)
+{
+    size_t lo, hi, n_new = 0, i, n;
+    char **lines;
+
+    for (i = 0; i < len; ++i)
+        n_new += text[i] == '\n';
+
+    /* Lines from lo to hi start after newlines inside the replaced text */
+    for (lo = 1; lo < lex->n_lines && lex->lines[lo] <= old_text + start;
+         ++lo);
+    for (hi = lo; hi < lex->n_lines && lex->lines[hi] <= old_text + end; ++hi);
+
+    n = lo + n_new + (lex->n_lines - hi);
+    if (n > lex->n_lines) {
+        lines = realloc (lex->lines, n * sizeof (*lex->lines));
+        if (!lines) error_errno ();
+        lex->lines = lines;
+    }
+    memmove (&lex->lines[lo + n_new], &lex->lines[hi],
+             (lex->n_lines - hi) * sizeof (*lex->lines));
+
+    for (i = 0; i < lo; ++i)
+        lex->lines[i] = (char *) new_text + (lex->lines[i] - old_text);
+    for (n_new = lo, i = 0; i < len; ++i) {
+        if (text[i] == '\n')
+            lex->lines[n_new++] = (char *) new_text + start + i + 1;
+    }
+    for (i = n_new; i < n; ++i)
+        lex->lines[i] = (char *) new_text + (lex->lines[i] - old_text) +
+            len - (end - start);
+    lex->n_lines = n;
+}
+
+size_t
+lexer_edit (struct lex *lex, size_t start, size_t end, const char *text,
+            size_t len)
+{
+    struct lex tmp;
+    char *new_text;
+    size_t new_len, n_old = lex->n_tokens, a, j, m, n, restart, offset,
+        old_offset;
+
+    assert (!lex->streaming);
+    assert (start <= end && end <= lex->text_len);
+
+    new_len = lex->text_len - (end - start) + len;
+    if (new_len > UINT32_MAX)
+        error_message ("%s: file too large", lex->file);
+
+    /* Splice the text, NUL and all */
+    new_text = malloc (new_len + 1);
+    if (!new_text) error_errno ();
+    memcpy (new_text, lex->text, start);
+    memcpy (new_text + start, text, len);
+    memcpy (new_text + start + len, lex->text + end, lex->text_len - end + 1);
+    if (lex->lines)
+        patch_lines (lex, lex->text, new_text, start, end, text, len);
+    if (lex->text_mapped)
+        unmap_file (lex->text, lex->text_len);
+    else
+        free (lex->text);
+    lex->text = new_text;
+    lex->text_len = new_len;
+    lex->text_mapped = 0;
+
+    /* Keep every token which ends far enough before the edit that the lexer
+     * never looked at the edited text to find its end - the operator DFA may
+     * read LEX_OPER_MAX_LEN characters ahead. Lexing restarts after the last
+     * one; a token can't start inside a string or comment, so this is always
+     * a safe place to start. */
+    for (a = n_old; a > 0; --a) {
+        if (lex->tok_offsets[a - 1] + lex->tok_lens[a - 1] + LEX_OPER_MAX_LEN
+            <= start)
             break;
+    }
+    restart = a ? lex->tok_offsets[a - 1] + lex->tok_lens[a - 1] : 0;
 
-        default:
-            unexpected_char (lex, lex->text[pos], nline, ncol, "");
+    /* Lex into a scratch stream until a new token starts, past the edit, where
+     * an old one did. The text from there on is the same, so the tokens from
+     * there on are too. */
+    tmp = *lex;
+    if (alloc_tokens (&tmp, 16))
+        error_errno ();
+    tmp.n_tokens = 0;
+    tmp.pos = restart;
+
+    j = a;
+    while (1) {
+        if (!lex_one (&tmp)) {
+            j = n_old;
+            break;
+        }
+        offset = tmp.tok_offsets[tmp.n_tokens - 1];
+        if (offset < start + len)
+            continue;
+        old_offset = offset - len + (end - start);
+        while (j < n_old && lex->tok_offsets[j] < old_offset)
+            ++j;
+        if (j < n_old && lex->tok_offsets[j] == old_offset) {
+            --tmp.n_tokens;
+            break;
         }
     }
+    m = tmp.n_tokens;
+
+    /* Errors found on the way are the file's, as are the lines, if one of
+     * them was what needed them first */
+    lex->n_errors = tmp.n_errors;
+    if (!lex->lines) {
+        lex->lines = tmp.lines;
+        lex->n_lines = tmp.n_lines;
+    }
+
+    /* Put the new tokens in place of old tokens a to j */
+    n = a + m + (n_old - j);
+    if (n > lex->tokens_mem) {
+        lex->tok_types = realloc (lex->tok_types,
+                                  n * sizeof (*lex->tok_types));
+        lex->tok_ids = realloc (lex->tok_ids, n * sizeof (*lex->tok_ids));
+        lex->tok_offsets = realloc (lex->tok_offsets,
+                                    n * sizeof (*lex->tok_offsets));
+        lex->tok_lens = realloc (lex->tok_lens, n * sizeof (*lex->tok_lens));
+        lex->tok_nums = realloc (lex->tok_nums, n * sizeof (*lex->tok_nums));
+        if (!lex->tok_types || !lex->tok_ids || !lex->tok_offsets ||
+            !lex->tok_lens || !lex->tok_nums)
+            error_errno ();
+        lex->tokens_mem = n;
+    }
+
+#define SPLICE(array)                                                   \
+    do {                                                                \
+        memmove (&lex->array[a + m], &lex->array[j],                    \
+                 (n_old - j) * sizeof (*lex->array));                   \
+        memcpy (&lex->array[a], tmp.array, m * sizeof (*lex->array));   \
+    } while (0)
+
+    SPLICE (tok_types);
+    SPLICE (tok_ids);
+    SPLICE (tok_offsets);
+    SPLICE (tok_lens);
+    SPLICE (tok_nums);
 
-    coll_free (&coll);
+#undef SPLICE
+
+    for (j = a + m; j < n; ++j)
+        lex->tok_offsets[j] = lex->tok_offsets[j] - (end - start) + len;
+    lex->n_tokens = n;
+    lex->token_idx = 0;
+    lex->split_len = 0;
+
+    free (tmp.tok_types);
+    free (tmp.tok_ids);
+    free (tmp.tok_offsets);
+    free (tmp.tok_lens);
+    free (tmp.tok_nums);
+    return m;
+}
+
+/* Note that token number 'i' has been asked for, and in streaming mode, make
+ * sure it has been lexed, if it exists. Tokens are lexed no further ahead than
+ * asked for, so that the lexer's diagnostics come out in order with the
+ * parser's; the ring buffer only has to go back as far as the oldest token
+ * which lexer_last () can still ask for. */
+static void
+lexer_fill (struct lex *lex, size_t i)
+{
+    size_t oldest;
+
+    if (i >= lex->asked)
+        lex->asked = i + 1;
+    if (!lex->streaming || i < lex->n_tokens)
+        return;
+
+    oldest = lex->token_idx < 2 ? 0 : lex->token_idx - 2;
+    while (lex->n_tokens <= i && lex->n_tokens - oldest < LEX_RING &&
+           lex_one (lex));
+}
+
+/* Unpack token number 'i' into its slot in lex->views */
+static struct token *
+get_view (struct lex *lex, size_t i)
+{
+    struct token *tok = &lex->views[i % LEX_VIEWS];
+    size_t slot = i & lex->tok_mask;
+
+    tok->offset = lex->tok_offsets[slot];
+    tok->len = lex->tok_lens[slot];
+    tok->type = lex->tok_types[slot];
+    tok->id = lex->tok_ids[slot];
+    tok->num = lex->tok_nums[slot];
+    if (i == lex->split_idx && lex->split_len) {
+        size_t len = 0;
+        tok->offset += lex->split_len;
+        tok->len -= lex->split_len;
+        tok->id = match_oper (&lex->text[tok->offset], tok->len, &len);
+    }
+    tok->value = &lex->text[tok->offset];
+    return tok;
 }
 
 struct token *
 lexer_next (struct lex *lex)
 {
+    lexer_fill (lex, lex->token_idx);
     if (lex->token_idx >= lex->n_tokens)
         return NULL;
-    return &lex->tokens[lex->token_idx++];
+    return get_view (lex, lex->token_idx++);
 }
 
 struct token *
 lexer_peek (struct lex *lex)
 {
+    lexer_fill (lex, lex->token_idx);
     if (lex->token_idx >= lex->n_tokens)
         return NULL;
-    return &lex->tokens[lex->token_idx];
+    return get_view (lex, lex->token_idx);
+}
+
+struct token *
+lexer_peek_ahead (struct lex *lex, size_t n)
+{
+    size_t i = lex->token_idx + n;
+
+    assert (n <= LEX_VIEWS - 3);
+    lexer_fill (lex, i);
+    if (i >= lex->n_tokens)
+        return NULL;
+    return get_view (lex, i);
 }
 
 struct token *
 lexer_last (struct lex *lex)
 {
     if (lex->token_idx < 2) return NULL;
-    return &lex->tokens[lex->token_idx - 2];
+    return get_view (lex, lex->token_idx - 2);
+}
+
+size_t
+lexer_tell (struct lex *lex)
+{
+    return lex->token_idx;
+}
+
+void
+lexer_seek (struct lex *lex, size_t i)
+{
+    assert (!lex->streaming && i <= lex->n_tokens);
+    lex->token_idx = i;
+    lex->asked = i;
+    /* Going back over a split token, it is read whole again */
+    if (i < lex->split_idx)
+        lex->split_len = 0;
+}
+
+void
+lexer_back (struct lex *lex)
+{
+    assert (lex->token_idx > 0);
+    --lex->token_idx;
+    if (lex->token_idx < lex->split_idx)
+        lex->split_len = 0;
+}
+
+size_t
+lexer_skip_block (struct lex *lex)
+{
+    size_t i = lex->token_idx, depth = 0;
+
+    assert (!lex->streaming);
+    for (; i < lex->n_tokens; ++i) {
+        if (lex->tok_ids[i] == TOK_LBRACE)
+            ++depth;
+        else if (lex->tok_ids[i] == TOK_RBRACE && depth && !--depth)
+            break;
+    }
+    if (i == lex->n_tokens)
+        return 0;
+    lex->token_idx = i + 1;
+    if (lex->asked < i + 1)
+        lex->asked = i + 1;
+    return i + 1;
+}
+
+void
+lexer_fork (struct lex *lex, struct lex *cursor)
+{
+    assert (!lex->streaming);
+    if (!lex->lines) mark_lines (lex);
+    *cursor = *lex;
+    cursor->token_idx = 0;
+    cursor->split_len = 0;
+    cursor->recover = NULL;
+    cursor->n_errors = 0;
+    cursor->asked = cursor->lexing = 0;
+    cursor->log = NULL;
+}
+
+void
+lexer_split (struct lex *lex)
+{
+    size_t i;
+
+    assert (lex->token_idx > 0);
+    i = --lex->token_idx;
+    if (i != lex->split_idx)
+        lex->split_len = 0;
+    assert (lex->tok_lens[i & lex->tok_mask] > lex->split_len + 1);
+    lex->split_idx = i;
+    ++lex->split_len;
+}
+
+void
+lexer_locate (struct lex *lex, size_t offset, size_t *line, size_t *col)
+{
+    size_t lo = 0, hi, mid;
+    const char *p = &lex->text[offset];
+
+    if (!lex->lines) mark_lines (lex);
+
+    /* Find the last line starting at or before 'p' */
+    hi = lex->n_lines;
+    while (hi - lo > 1) {
+        mid = lo + (hi - lo) / 2;
+        if (lex->lines[mid] <= p)
+            lo = mid;
+        else
+            hi = mid;
+    }
+    *line = lo;
+    *col = p - lex->lines[lo];
 }
@@ -8,21 +8,75 @@
 #include "../stringlist.h"
 #include "token.h"
 #include <stdio.h>
+#include <stdint.h>
+#include <setjmp.h>
 
 /* Lexer structs and functions. */
 
+/* Number of tokens handed out by lexer_next () and friends which stay valid at
+ * once */
+#define LEX_VIEWS 16
+
+/* Size of the token ring buffer in streaming mode. Must be a power of two,
+ * and bigger than the three tokens the parser can look at: lexer_last (), the
+ * current token and lexer_peek (). */
+#define LEX_RING 256
+
 struct lex {
   char const *file;
   struct env *env;
 
-  struct token *tokens;
-  size_t n_tokens;
+  /* The token stream, packed: token i is in slot s = (i & tok_mask), and has
+   * type tok_types[s] and ID tok_ids[s]; its text is lex->text[tok_offsets[s]]
+   * for tok_lens[s] characters, and a number's value is tok_nums[s] (zero
+   * for other tokens). Normally tok_mask is all ones and the arrays hold
+   * every token; in streaming mode they are a ring of LEX_RING slots. */
+  unsigned char *tok_types;
+  unsigned char *tok_ids;
+  uint32_t *tok_offsets;
+  uint32_t *tok_lens;
+  union token_num *tok_nums;
+  size_t n_tokens, tokens_mem, tok_mask;
   size_t token_idx;
 
+  /* Token number 'split_idx' is read as if its first 'split_len' characters
+   * were not there (see lexer_split ()); the tokens themselves stay as they
+   * were lexed, for other readers. 'split_len' is 0 if no token is split. */
+  size_t split_idx, split_len;
+
+  /* Whether tokens are lexed on demand (see lexer_stream ()), and if so, how
+   * far into the text the lexer has got */
+  int streaming;
+  size_t pos;
+
+  /* Unpacked copies of recently requested tokens - see lexer_next () */
+  struct token views[LEX_VIEWS];
+
   char *text;
   size_t text_len;
+  /* Whether 'text' is a file mapping (see map_file_f ()) rather than a
+   * malloc()ed buffer */
+  int text_mapped;
 
+  /* Start of each line, or NULL if not yet needed */
   char **lines;
+  size_t n_lines;
+
+  /* Compile errors reported through this reader so far; where the parser
+   * wants to pick up after the next one, or NULL to stop there (see
+   * cerror_at ()); and where in the text the last one was found */
+  size_t n_errors;
+  jmp_buf *recover;
+  size_t error_offset;
+
+  /* How many tokens this reader has asked for, counting lookahead - in
+   * streaming mode, how far the lexer has had to get (see lexer_fill ()) -
+   * and, while lexer_lex () lexes token i, i + 1 (0 otherwise). With these, a
+   * diagnostic can be kept in 'log' rather than printed, and printed later in
+   * the order a streaming reader would have found it in (see
+   * error_print_logs ()). 'log' is NULL to print at once. */
+  size_t asked, lexing;
+  struct diag_log *log;
 };
 
 /* Initialise the lexer.
@@ -37,11 +91,52 @@ lexer_init (char const *file, struct env *env, struct lex *lex);
 void
 lexer_free (struct lex *lex);
 
-/* Run the lexer. May exit with errors. */
+/* Run the lexer over the whole file. Bad characters are reported and
+ * skipped, and counted in lex->n_errors; may exit if the file can't be
+ * read, or there are too many. With a log (lex->log), they are kept there,
+ * and the lexer goes on to the end of the file. */
 void
 lexer_lex (struct lex *lex);
 
-/* Get the next token. */
+/* Start the lexer in streaming mode: rather than lexing the whole file up
+ * front, lexer_next () and lexer_peek () lex tokens as they are needed, into a
+ * fixed-size ring buffer. Token memory is then bounded however big the file
+ * is. Errors are handled as by lexer_lex (). */
+void
+lexer_stream (struct lex *lex);
+
+/* Read the file's text into lex->text without lexing it, so that it can be
+ * looked up in the cache (see cache.h) first. lexer_lex (), lexer_stream ()
+ * and lexer_load () do this themselves if it has not been done. May exit with
+ * errors. */
+void
+lexer_read (struct lex *lex);
+
+/* Use 'n' tokens lexed from the same text before - by lexer_lex (), on an
+ * earlier run - instead of lexing it again. The arrays are copied. Afterwards
+ * the lexer is as lexer_lex () would leave it. The caller must check that the
+ * tokens fit the text. May exit with errors. */
+void
+lexer_load (struct lex *lex, size_t n, const unsigned char *types,
+            const unsigned char *ids, const uint32_t *offsets,
+            const uint32_t *lens, const union token_num *nums);
+
+/* Edit a file lexed by lexer_lex () (not in streaming mode): replace the text
+ * from lex->text[start] up to lex->text[end] with 'len' characters of 'text',
+ * and update the tokens and lines to match. Only the tokens from just
+ * before the edit up to where the new tokens line up with the old ones again
+ * are lexed; the rest are kept, moved along. The text is copied, so pointers
+ * into it - tokens from lexer_next () and friends included - are invalid
+ * afterwards. lexer_next () starts from the first token again. Returns the
+ * number of tokens lexed. Errors are handled as by lexer_lex (), and add to
+ * lex->n_errors. */
+size_t
+lexer_edit (struct lex *lex, size_t start, size_t end, const char *text,
+            size_t len);
+
+/* Get the next token, or NULL at the end of the file. The token is unpacked
+ * into a small ring of slots, so it is only valid until LEX_VIEWS more tokens
+ * have been requested; copy it to keep it. */
 struct token *
 lexer_next (struct lex *lex);
 
@@ -49,8 +144,56 @@ lexer_next (struct lex *lex);
 struct token *
 lexer_peek (struct lex *lex);
 
+/* Peek 'n' tokens past the next one, or get NULL if the file ends first;
+ * lexer_peek_ahead (lex, 0) is lexer_peek (lex). 'n' must be at most
+ * LEX_VIEWS - 3, so that the tokens from lexer_last (), lexer_next () and
+ * lexer_peek () stay valid. Works in streaming mode too. */
+struct token *
+lexer_peek_ahead (struct lex *lex, size_t n);
+
 /* Get the previous token. */
 struct token *
 lexer_last (struct lex *lex);
 
+/* The number of the token lexer_next () will return next. */
+size_t
+lexer_tell (struct lex *lex);
+
+/* Go to token number 'i', as given by lexer_tell (), so that lexer_next ()
+ * returns it next, as if the reader had only got that far. Not in streaming
+ * mode. */
+void
+lexer_seek (struct lex *lex, size_t i);
+
+/* Back up one token, so that lexer_next () returns the token it last
+ * returned again. Works in streaming mode too. */
+void
+lexer_back (struct lex *lex);
+
+/* Skip from the { which lexer_next () would return past its matching }, going
+ * by token IDs alone. Returns the number of the token after the }, or 0 if
+ * there is no matching } (the file ends first); the position is unchanged
+ * then. Not in streaming mode. */
+size_t
+lexer_skip_block (struct lex *lex);
+
+/* Make 'cursor' a second reader of the tokens in 'lex', which must have been
+ * lexed by lexer_lex (), starting at token 0. It shares the text and tokens,
+ * so only 'lex' is freed, after every cursor is done with; one thread can
+ * read each. A cursor counts its own errors, and has no log. */
+void
+lexer_fork (struct lex *lex, struct lex *cursor);
+
+/* Split the token most recently returned by lexer_next () after its first
+ * character, and back up so that the remainder is returned next. This lets
+ * the type parser close nested arguments, as in map<int, list<int>>. Only
+ * this reader sees the split; the token stream is left as lexed, so cursors,
+ * the cache and later seeks read the whole token. */
+void
+lexer_split (struct lex *lex);
+
+/* Work out the (zero-based) line and column of lex->text[offset]. */
+void
+lexer_locate (struct lex *lex, size_t offset, size_t *line, size_t *col);
+
 #endif /* _LEX_LEX_H */
@@ -0,0 +1,214 @@
+/* Copyright (c) 2011, Christopher Pavlina. All rights reserved. */
+
+#include "number.h"
+#include "pow10_tables.h"
+#include <float.h>
+#include <stdlib.h>
+#include <string.h>
+
+int
+number_parse_int (const char *text, size_t len, int radix, uint64_t *value)
+{
+    uint64_t v = 0, digit;
+    size_t i;
+
+    for (i = 0; i < len; ++i) {
+        if (text[i] >= '0' && text[i] <= '9')
+            digit = text[i] - '0';
+        else
+            digit = (text[i] | 0x20) - 'a' + 10;
+        if (v > (UINT64_MAX - digit) / radix)
+            return 1;
+        v = v * radix + digit;
+    }
+    *value = v;
+    return 0;
+}
+
+/* High 64 bits of a * b, with the low 64 in *lo */
+static uint64_t
+mul64 (uint64_t a, uint64_t b, uint64_t *lo)
+{
+#ifdef __SIZEOF_INT128__
+    unsigned __int128 p = (unsigned __int128) a * b;
+    *lo = (uint64_t) p;
+    return (uint64_t) (p >> 64);
+#else
+    uint64_t a_lo = a & 0xffffffffu, a_hi = a >> 32;
+    uint64_t b_lo = b & 0xffffffffu, b_hi = b >> 32;
+    uint64_t ll = a_lo * b_lo, lh = a_lo * b_hi;
+    uint64_t hl = a_hi * b_lo, hh = a_hi * b_hi;
+    uint64_t mid = (ll >> 32) + (lh & 0xffffffffu) + (hl & 0xffffffffu);
+    *lo = (mid << 32) | (ll & 0xffffffffu);
+    return hh + (lh >> 32) + (hl >> 32) + (mid >> 32);
+#endif
+}
+
+static int
+leading_zeros (uint64_t v)
+{
+#ifdef __GNUC__
+    return __builtin_clzll (v);
+#else
+    int n = 0;
+    while (!(v & ((uint64_t) 1 << 63))) {
+        v <<= 1;
+        ++n;
+    }
+    return n;
+#endif
+}
+
+/* Eisel-Lemire: convert man * 10^exp10 (man nonzero) to a double in *result.
+ * exp10 must be in the range of pow10_tables.h. Returns zero, leaving the job
+ * to strtod (), if the answer can't be determined this way. This follows Go's
+ * strconv, which is in turn from Lemire's "Number Parsing at a Gigabyte per
+ * Second" (2021). */
+static int
+eisel_lemire (uint64_t man, int exp10, double *result)
+{
+    const uint64_t *pow;
+    uint64_t x_hi, x_lo, y_hi, y_lo, merged_hi, merged_lo;
+    uint64_t ret_man, ret_exp2, msb, bits;
+    int clz, log2_10;
+
+    pow = pow10_significands[exp10 - POW10_MIN];
+
+    // Normalise, and estimate the binary exponent: 217706 / 2^16 is log2 (10)
+    clz = leading_zeros (man);
+    man <<= clz;
+    log2_10 = 217706 * exp10;
+    log2_10 = log2_10 >= 0 ? log2_10 >> 16 : -((-log2_10 + 0xffff) >> 16);
+    ret_exp2 = (uint64_t) (log2_10 + 64 + 1023) - clz;
+
+    x_hi = mul64 (man, pow[0], &x_lo);
+
+    // If the low bits of the product are all ones, the truncated part of the
+    // power of ten might carry into them; bring in the rest of it
+    if ((x_hi & 0x1ff) == 0x1ff && x_lo + man < man) {
+        y_hi = mul64 (man, pow[1], &y_lo);
+        merged_hi = x_hi;
+        merged_lo = x_lo + y_hi;
+        if (merged_lo < x_lo)
+            ++merged_hi;
+        if ((merged_hi & 0x1ff) == 0x1ff && merged_lo + 1 == 0 &&
+            y_lo + man < man)
+            return 0;
+        x_hi = merged_hi;
+        x_lo = merged_lo;
+    }
+
+    // Shift down to 54 bits
+    msb = x_hi >> 63;
+    ret_man = x_hi >> (msb + 9);
+    ret_exp2 -= 1 ^ msb;
+
+    // Exactly halfway between two doubles: can't tell which way to round
+    if (x_lo == 0 && (x_hi & 0x1ff) == 0 && (ret_man & 3) == 1)
+        return 0;
+
+    // Round to 53 bits
+    ret_man += ret_man & 1;
+    ret_man >>= 1;
+    if (ret_man >> 53) {
+        ret_man >>= 1;
+        ++ret_exp2;
+    }
+
+    // Subnormals, infinities: leave them to strtod ()
+    if (ret_exp2 - 1 >= 0x7ff - 1)
+        return 0;
+
+    bits = ret_exp2 << 52 | (ret_man & 0x000fffffffffffffu);
+    memcpy (result, &bits, sizeof (*result));
+    return 1;
+}
+
+/* The fallback, for the rare cases which need arbitrary precision */
+static double
+parse_real_slow (const char *text, size_t len)
+{
+    char buf[64], *copy = buf;
+    double result;
+
+    // The text is not NUL-terminated, and is followed by the rest of the file
+    if (len >= sizeof (buf)) {
+        copy = malloc (len + 1);
+        if (!copy)
+            abort ();
+    }
+    memcpy (copy, text, len);
+    copy[len] = 0;
+    result = strtod (copy, NULL);
+    if (copy != buf)
+        free (copy);
+    return result;
+}
+
+double
+number_parse_real (const char *text, size_t len)
+{
+    static const double exact_pow10[] = {
+        1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11, 1e12,
+        1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+    };
+
+    uint64_t man = 0;
+    long exp10 = 0, exponent = 0;
+    int n_digits = 0, seen_point = 0, truncated = 0, exp_neg = 0;
+    size_t i;
+    double result;
+
+    // Collect up to 19 significant digits - as many as always fit in man
+    for (i = 0; i < len; ++i) {
+        if (text[i] == '.') {
+            seen_point = 1;
+            continue;
+        } else if (text[i] < '0' || text[i] > '9') {
+            break;
+        }
+        if (n_digits == 0 && text[i] == '0') {
+            exp10 -= seen_point;
+        } else if (n_digits < 19) {
+            man = man * 10 + (text[i] - '0');
+            ++n_digits;
+            exp10 -= seen_point;
+        } else {
+            truncated |= text[i] != '0';
+            exp10 += !seen_point;
+        }
+    }
+
+    if (i < len) {
+        // Exponent. Clamp it: anything this big is zero or infinity anyway.
+        ++i;
+        if (text[i] == '+' || text[i] == '-')
+            exp_neg = text[i++] == '-';
+        for (; i < len; ++i) {
+            if (exponent < 100000)
+                exponent = exponent * 10 + (text[i] - '0');
+        }
+        exp10 += exp_neg ? -exponent : exponent;
+    }
+
+    if (man == 0)
+        return 0.0;
+
+    if (!truncated) {
+#if FLT_EVAL_METHOD == 0
+        // Both man and the power of ten are exact doubles, so one IEEE
+        // operation rounds correctly
+        if (man <= ((uint64_t) 1 << 53) && exp10 >= -22 && exp10 <= 22) {
+            if (exp10 >= 0)
+                return (double) man * exact_pow10[exp10];
+            else
+                return (double) man / exact_pow10[-exp10];
+        }
+#endif
+        if (exp10 >= POW10_MIN && exp10 <= POW10_MAX &&
+            eisel_lemire (man, (int) exp10, &result))
+            return result;
+    }
+
+    return parse_real_slow (text, len);
+}
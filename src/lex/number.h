@@ -0,0 +1,30 @@
+/* Copyright (c) 2011, Christopher Pavlina. All rights reserved. */
+
+#ifndef _LEX_NUMBER_H
+#define _LEX_NUMBER_H 1
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Conversion of numeric literals to binary. The lexer has already checked the
+ * syntax, so these only see well-formed text, without any radix prefix or
+ * type suffix. */
+
+/* Convert 'len' digits in 'radix' (2 to 36) to an integer in *value. Returns
+ * nonzero if the value does not fit in 64 bits. */
+int
+number_parse_int (const char *text, size_t len, int radix, uint64_t *value);
+
+/* Convert a decimal real - digits, optionally a point and more digits, and
+ * optionally an exponent (e or E, a sign, digits) - to the nearest double.
+ * Out-of-range values give infinity or zero, as strtod () does.
+ *
+ * Most literals are converted with the Eisel-Lemire algorithm: one 64x128-bit
+ * multiply by a power of ten from pow10_tables.h, which is enough to round
+ * correctly unless the result lies almost exactly halfway between two
+ * doubles. Those, and literals with more than 19 significant digits, go to
+ * strtod (). */
+double
+number_parse_real (const char *text, size_t len);
+
+#endif /* _LEX_NUMBER_H */
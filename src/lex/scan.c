@@ -0,0 +1,252 @@
+/* Copyright (c) 2011, Christopher Pavlina. All rights reserved. */
+
+#include "scan.h"
+
+#if defined (__GNUC__) && (defined (__x86_64__) || defined (__i386__))
+#define SCAN_X86 1
+#include <immintrin.h>
+#endif
+
+/* Scalar kernels. These define what the vector kernels must do, and finish
+ * off the last few bytes of the text for them. */
+
+static size_t
+scalar_space (const char *text, size_t pos, size_t len)
+{
+    for (; pos < len; ++pos) {
+        switch (text[pos]) {
+        case ' ': case 0x09: case 0x0a: case 0x0b: case 0x0c: case 0x0d:
+            continue;
+        default:
+            return pos;
+        }
+    }
+    return len;
+}
+
+static size_t
+scalar_line_end (const char *text, size_t pos, size_t len)
+{
+    for (; pos < len; ++pos) {
+        if (text[pos] == '\n')
+            return pos;
+    }
+    return len;
+}
+
+static size_t
+scalar_comment_mark (const char *text, size_t pos, size_t len)
+{
+    for (; pos < len; ++pos) {
+        if (text[pos] == '*' || text[pos] == '/')
+            return pos;
+    }
+    return len;
+}
+
+static size_t
+scalar_word (const char *text, size_t pos, size_t len)
+{
+    char ch;
+
+    for (; pos < len; ++pos) {
+        ch = text[pos];
+        if (!((ch >= 'a' && ch <= 'z') || (ch >= 'A' && ch <= 'Z') ||
+              (ch >= '0' && ch <= '9') || ch == '_'))
+            return pos;
+    }
+    return len;
+}
+
+#ifdef SCAN_X86
+
+/* Each vector kernel works out a mask with a bit set for every byte in the
+ * block which ends the run, and stops at the lowest one. Blocks are only
+ * loaded while they lie entirely inside the text - a mapped file may end at a
+ * page boundary - so the scalar kernel finishes the tail. */
+#define DEFINE_SCAN(isa, name, width, vec, load, mask_fn, tail_fn)      \
+    __attribute__ ((target (isa))) static size_t                        \
+    name (const char *text, size_t pos, size_t len)                     \
+    {                                                                   \
+        unsigned mask;                                                  \
+        while (pos + width <= len) {                                    \
+            mask = mask_fn (load ((const vec *) (text + pos)));         \
+            if (mask)                                                   \
+                return pos + __builtin_ctz (mask);                      \
+            pos += width;                                               \
+        }                                                               \
+        return tail_fn (text, pos, len);                                \
+    }
+
+/* Unsigned range test: a byte is in [lo, lo + n] iff (v - lo) <= n */
+#define SSE2_IN_RANGE(v, lo, n)                                         \
+    _mm_cmpeq_epi8 (_mm_min_epu8 (_mm_sub_epi8 ((v), _mm_set1_epi8 (lo)), \
+                                  _mm_set1_epi8 (n)),                   \
+                    _mm_sub_epi8 ((v), _mm_set1_epi8 (lo)))
+#define AVX2_IN_RANGE(v, lo, n)                                         \
+    _mm256_cmpeq_epi8 (_mm256_min_epu8 (_mm256_sub_epi8 ((v),           \
+                                            _mm256_set1_epi8 (lo)),     \
+                                        _mm256_set1_epi8 (n)),          \
+                       _mm256_sub_epi8 ((v), _mm256_set1_epi8 (lo)))
+
+__attribute__ ((target ("sse2"))) static inline unsigned
+sse2_space_mask (__m128i v)
+{
+    __m128i space = _mm_or_si128 (_mm_cmpeq_epi8 (v, _mm_set1_epi8 (' ')),
+                                  SSE2_IN_RANGE (v, 0x09, 4));
+    return ~_mm_movemask_epi8 (space) & 0xffff;
+}
+
+__attribute__ ((target ("sse2"))) static inline unsigned
+sse2_line_end_mask (__m128i v)
+{
+    return _mm_movemask_epi8 (_mm_cmpeq_epi8 (v, _mm_set1_epi8 ('\n')));
+}
+
+__attribute__ ((target ("sse2"))) static inline unsigned
+sse2_comment_mark_mask (__m128i v)
+{
+    return _mm_movemask_epi8 (
+        _mm_or_si128 (_mm_cmpeq_epi8 (v, _mm_set1_epi8 ('*')),
+                      _mm_cmpeq_epi8 (v, _mm_set1_epi8 ('/'))));
+}
+
+__attribute__ ((target ("sse2"))) static inline unsigned
+sse2_word_mask (__m128i v)
+{
+    /* Folding in 0x20 maps A-Z onto a-z, and nothing else onto a-z */
+    __m128i lower = _mm_or_si128 (v, _mm_set1_epi8 (0x20));
+    __m128i word = _mm_or_si128 (
+        _mm_or_si128 (SSE2_IN_RANGE (lower, 'a', 25), SSE2_IN_RANGE (v, '0', 9)),
+        _mm_cmpeq_epi8 (v, _mm_set1_epi8 ('_')));
+    return ~_mm_movemask_epi8 (word) & 0xffff;
+}
+
+__attribute__ ((target ("avx2"))) static inline unsigned
+avx2_space_mask (__m256i v)
+{
+    __m256i space = _mm256_or_si256 (
+        _mm256_cmpeq_epi8 (v, _mm256_set1_epi8 (' ')),
+        AVX2_IN_RANGE (v, 0x09, 4));
+    return ~(unsigned) _mm256_movemask_epi8 (space);
+}
+
+__attribute__ ((target ("avx2"))) static inline unsigned
+avx2_line_end_mask (__m256i v)
+{
+    return _mm256_movemask_epi8 (_mm256_cmpeq_epi8 (v, _mm256_set1_epi8 ('\n')));
+}
+
+__attribute__ ((target ("avx2"))) static inline unsigned
+avx2_comment_mark_mask (__m256i v)
+{
+    return _mm256_movemask_epi8 (
+        _mm256_or_si256 (_mm256_cmpeq_epi8 (v, _mm256_set1_epi8 ('*')),
+                         _mm256_cmpeq_epi8 (v, _mm256_set1_epi8 ('/'))));
+}
+
+__attribute__ ((target ("avx2"))) static inline unsigned
+avx2_word_mask (__m256i v)
+{
+    __m256i lower = _mm256_or_si256 (v, _mm256_set1_epi8 (0x20));
+    __m256i word = _mm256_or_si256 (
+        _mm256_or_si256 (AVX2_IN_RANGE (lower, 'a', 25),
+                         AVX2_IN_RANGE (v, '0', 9)),
+        _mm256_cmpeq_epi8 (v, _mm256_set1_epi8 ('_')));
+    return ~(unsigned) _mm256_movemask_epi8 (word);
+}
+
+DEFINE_SCAN ("sse2", sse2_space, 16, __m128i, _mm_loadu_si128,
+             sse2_space_mask, scalar_space)
+DEFINE_SCAN ("sse2", sse2_line_end, 16, __m128i, _mm_loadu_si128,
+             sse2_line_end_mask, scalar_line_end)
+DEFINE_SCAN ("sse2", sse2_comment_mark, 16, __m128i, _mm_loadu_si128,
+             sse2_comment_mark_mask, scalar_comment_mark)
+DEFINE_SCAN ("sse2", sse2_word, 16, __m128i, _mm_loadu_si128,
+             sse2_word_mask, scalar_word)
+
+DEFINE_SCAN ("avx2", avx2_space, 32, __m256i, _mm256_loadu_si256,
+             avx2_space_mask, scalar_space)
+DEFINE_SCAN ("avx2", avx2_line_end, 32, __m256i, _mm256_loadu_si256,
+             avx2_line_end_mask, scalar_line_end)
+DEFINE_SCAN ("avx2", avx2_comment_mark, 32, __m256i, _mm256_loadu_si256,
+             avx2_comment_mark_mask, scalar_comment_mark)
+DEFINE_SCAN ("avx2", avx2_word, 32, __m256i, _mm256_loadu_si256,
+             avx2_word_mask, scalar_word)
+
+#undef DEFINE_SCAN
+#undef SSE2_IN_RANGE
+#undef AVX2_IN_RANGE
+
+#endif /* SCAN_X86 */
+
+/* The kernels in use */
+static struct {
+    size_t (*space) (const char *, size_t, size_t);
+    size_t (*line_end) (const char *, size_t, size_t);
+    size_t (*comment_mark) (const char *, size_t, size_t);
+    size_t (*word) (const char *, size_t, size_t);
+} kernels = {scalar_space, scalar_line_end, scalar_comment_mark, scalar_word};
+
+int
+scan_select (int max_level)
+{
+#ifdef SCAN_X86
+    __builtin_cpu_init ();
+    if (max_level >= SCAN_AVX2 && __builtin_cpu_supports ("avx2")) {
+        kernels.space = avx2_space;
+        kernels.line_end = avx2_line_end;
+        kernels.comment_mark = avx2_comment_mark;
+        kernels.word = avx2_word;
+        return SCAN_AVX2;
+    }
+    if (max_level >= SCAN_SSE2 && __builtin_cpu_supports ("sse2")) {
+        kernels.space = sse2_space;
+        kernels.line_end = sse2_line_end;
+        kernels.comment_mark = sse2_comment_mark;
+        kernels.word = sse2_word;
+        return SCAN_SSE2;
+    }
+#else
+    (void) max_level;
+#endif
+    kernels.space = scalar_space;
+    kernels.line_end = scalar_line_end;
+    kernels.comment_mark = scalar_comment_mark;
+    kernels.word = scalar_word;
+    return SCAN_SCALAR;
+}
+
+#ifdef __GNUC__
+/* Choose the kernels before main () runs, so that no thread ever sees them
+ * change */
+__attribute__ ((constructor)) static void
+scan_init (void)
+{
+    scan_select (SCAN_AVX2);
+}
+#endif
+
+size_t
+scan_space (const char *text, size_t pos, size_t len)
+{
+    return kernels.space (text, pos, len);
+}
+
+size_t
+scan_line_end (const char *text, size_t pos, size_t len)
+{
+    return kernels.line_end (text, pos, len);
+}
+
+size_t
+scan_comment_mark (const char *text, size_t pos, size_t len)
+{
+    return kernels.comment_mark (text, pos, len);
+}
+
+size_t
+scan_word (const char *text, size_t pos, size_t len)
+{
+    return kernels.word (text, pos, len);
+}
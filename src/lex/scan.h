@@ -0,0 +1,44 @@
+/* Copyright (c) 2011, Christopher Pavlina. All rights reserved. */
+
+#ifndef _LEX_SCAN_H
+#define _LEX_SCAN_H 1
+
+#include <stddef.h>
+
+/* Fast scanning kernels for the lexer. Each takes the text, a starting
+ * position and the length of the text, and returns the position of the first
+ * character at or after 'pos' which ends the run - or 'len' if the run goes to
+ * the end of the text. On x86, SSE2 and AVX2 versions look at 16 or 32 bytes
+ * at a time; the best one the CPU supports is chosen at startup. The results
+ * are always the same as the scalar versions'. */
+
+/* Skip whitespace: space, \t, \n, \v, \f, \r */
+size_t
+scan_space (const char *text, size_t pos, size_t len);
+
+/* Find the end of a line comment: the next \n */
+size_t
+scan_line_end (const char *text, size_t pos, size_t len);
+
+/* Inside a block comment, find the next character which could start a
+ * comment marker - a * or a / */
+size_t
+scan_comment_mark (const char *text, size_t pos, size_t len);
+
+/* Skip identifier characters: letters, digits and _ */
+size_t
+scan_word (const char *text, size_t pos, size_t len);
+
+/* Kernel levels, for scan_select () */
+#define SCAN_SCALAR 0
+#define SCAN_SSE2   1
+#define SCAN_AVX2   2
+
+/* Choose the kernels, using nothing above 'max_level' even if the CPU
+ * supports it. This is done automatically at startup with SCAN_AVX2; call it
+ * again (before any threads start) to benchmark or test the slower ones.
+ * Returns the level chosen. */
+int
+scan_select (int max_level);
+
+#endif /* _LEX_SCAN_H */
@@ -8,17 +8,27 @@ static const char *TYPES[] = {"-------", "STRING", "WORD", "INT",
                               "REAL", "OPER", "EXTRA", "SPECIAL"};
 
 void
-print_token (FILE *stream, struct token *token)
+print_token (FILE *stream, struct lex *lex, struct token *token)
 {
-    fprintf (stream, "%-7s %3zux%3zu %s\n", TYPES[token->type],
-            token->line + 1, token->col + 1, token->value);
+    size_t line, col;
+
+    lexer_locate (lex, token->offset, &line, &col);
+    fprintf (stream, "%-7s %3zux%3zu %.*s\n", TYPES[token->type],
+            line + 1, col + 1, (int) token->len, token->value);
+}
+
+/* Compare the token's value with a NUL-terminated string */
+static int
+value_is (struct token *token, const char *value)
+{
+  return !strncmp (token->value, value, token->len) && !value[token->len];
 }
 
 int
 token_is_v (struct token *token, const char *value)
 {
   if (!token) return 0;
-  return !strcmp (token->value, value);
+  return value_is (token, value);
 }
 
 int
@@ -32,5 +42,20 @@ int
 token_is (struct token *token, int type, const char *value)
 {
   if (!token) return 0;
-  return (token->type == type) && !strcmp (token->value, value);
+  return (token->type == type) && value_is (token, value);
+}
+
+int
+token_is_id (struct token *token, int id)
+{
+  if (!token) return 0;
+  return token->id == id;
+}
+
+int
+token_is_keyword (struct token *token, int include_types)
+{
+  if (!token) return 0;
+  return (token->id >= TOK_FIRST_KEYWORD &&
+          token->id < (include_types ? TOK_END_TYPE : TOK_END_KEYWORD));
 }
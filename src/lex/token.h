@@ -4,6 +4,8 @@
 #define _LEX_TOKEN_H 1
 
 #include <stdio.h>
+#include <stdint.h>
+#include "token_ids.h"
 
 #define T_STRING  1
 #define T_WORD    2
@@ -13,16 +15,34 @@
 #define T_EXTRA   6
 #define T_SPECIAL 7
 
+struct lex;
+
+/* The value of a number token, decoded by the lexer: 'i' for T_INT, 'r' for
+ * T_REAL */
+union token_num {
+    uint64_t i;
+    double r;
+};
+
+/* A token, unpacked from the lexer's token stream. 'value' points into the
+ * lexer's text and is NOT NUL-terminated - it is 'len' bytes long, so print it
+ * with "%.*s". The token's line and column are not stored; lexer_locate ()
+ * works them out from 'offset' when needed. 'id' is the token's TOK_* ID
+ * if it is an operator or a word with one (see token_ids.h), else TOK_NONE.
+ * 'num' is the value of a T_INT or T_REAL token, so nothing after the lexer
+ * has to convert the text again, and zero for any other. */
 struct token {
-    size_t line, col;
-    int type;
-    char *value;
+    const char *value;
+    uint32_t offset, len;
+    unsigned char type;
+    unsigned char id;
+    union token_num num;
 };
 
 /* Print a token */
-void print_token (FILE *stream, struct token *token);
+void print_token (FILE *stream, struct lex *lex, struct token *token);
 
-/* Check if a token has a certain value. NULL-safe. */
+/* Check if a token's value is equal to a NUL-terminated string. NULL-safe. */
 int token_is_v (struct token *token, const char *value);
 
 /* Check if a token has a certain type. NULL-safe. */
@@ -31,4 +51,13 @@ int token_is_t (struct token *token, int type);
 /* Check if a token has a certain type and value. NULL-safe. */
 int token_is (struct token *token, int type, const char *value);
 
+/* Check if a token has a certain TOK_* ID. This is just an integer compare,
+ * so the parsers use it rather than token_is (). NULL-safe. */
+int token_is_id (struct token *token, int id);
+
+/* Check if a token is a keyword.
+ * include_types: Whether to include builtin type names as "keywords"
+ * NULL-safe. */
+int token_is_keyword (struct token *token, int include_types);
+
 #endif /* _LEX_TOKEN_H */
@@ -3,6 +3,7 @@
 #include <stdio.h>
 #include <string.h>
 #include <assert.h>
+#include <errno.h>
 
 #include "default_paths.h"
 #include "read_args.h"
@@ -12,7 +13,14 @@
 #include "filesystem.h"
 #include "lex/lex.h"
 #include "parse/parse.h"
+#include "parse/binast.h"
+#include "cache.h"
+#include "package.h"
 #include "free_on_exit.h"
+#include "intern.h"
+#include "jobs.h"
+#include "types/type.h"
+#include "types/layout.h"
 
 static void
 construct_env (struct args *args, struct env *env)
@@ -49,6 +57,8 @@ construct_env (struct args *args, struct env *env)
     env->debug = args->debug;
 
     env->w_octalish = args->w_octalish;
+    env->error_limit = args->error_limit;
+    env->reorder_fields = args->reorder_fields;
 }
 
 static void
@@ -170,18 +180,158 @@ dump_paths(struct env *env)
     dump_path ("ld", env->ld);
 }
 
+/* What every compile_file () job shares */
+struct compile {
+    struct env *env;
+    /* The cache, or NULL for none */
+    struct cache *cache;
+    /* Imports waiting to be resolved */
+    struct packages *packages;
+    /* Threads to parse each file's function bodies on (see
+     * parse_function_bodies ()), when there are more jobs than files */
+    int body_threads;
+};
+
+/* Lex and parse the file in 'lex', which must not be lexed yet, with its
+ * function bodies parsed on c->body_threads threads. Exit on error, with the
+ * lexer freed */
+static struct ast *
+parse_parallel (struct lex *lex, struct compile *c)
+{
+    struct ast *ast;
+
+    ast = parse_file_parallel (lex, c->env, c->body_threads);
+    if (!ast) {
+        lexer_free (lex);
+        error_fail ();
+    }
+    return ast;
+}
+
+/* Pass on the imports of file 'path', parsed into 'ast', and if it is a
+ * package, write its interface. 'flat' is the flattened tree, or NULL to
+ * flatten it here; either way, the tree is freed. */
+static void
+finish_file (const char *path, struct compile *c, struct ast *ast,
+             struct flat_ast *flat)
+{
+    size_t i;
+
+    for (i = 0; i < ast->o.file.n_imports; ++i)
+        packages_import (c->packages, path, ast->o.file.imports[i]);
+
+    if (ast->o.file.is_executable && !flat) {
+        free_ast (ast);
+        return;
+    }
+    if (!flat) {
+        flat = flat_build (ast);
+        flat->tree = ast;
+    }
+    if (!ast->o.file.is_executable)
+        packages_write_interface (c->packages, flat, path);
+    flat_free (flat);
+}
+
+/* Lex and parse one source file, unless it is in the cache. */
+static void
+compile_cached (const char *path, struct compile *c)
+{
+    const struct binast_node *node;
+    const char *name;
+    struct cache_entry entry;
+    struct flat_ast *flat;
+    struct ast *ast;
+    struct lex lex;
+    size_t warnings, i;
+
+    lexer_init (path, c->env, &lex);
+    lexer_read (&lex);
+    if (cache_lookup (c->cache, &lex, &entry)) {
+        /* Nothing after the parser yet, so the tree is only looked at */
+        node = &entry.ast.nodes[0];
+        for (i = 0; node->params != BINAST_NONE && i < node->n_params; ++i) {
+            name = binast_string (&entry.ast,
+                                  entry.ast.params[node->params + i].name);
+            packages_import (c->packages, path, intern_s (name));
+        }
+
+        /* A package's interface is written from the tree. The tokens are
+         * loaded, so if it is out of date, that is only a parse away. */
+        name = binast_string (&entry.ast, node->name);
+        if (!(node->flags & BINAST_EXECUTABLE) &&
+            !packages_interface_fresh (c->packages, name, path)) {
+            flat = parse_file_flat (&lex, c->env);
+            packages_write_interface (c->packages, flat, path);
+            flat_free (flat);
+        }
+        cache_release (&entry);
+        lexer_free (&lex);
+        return;
+    }
+
+    /* The entry keeps the tokens, so lex them all at once. That goes through
+     * parse_parallel () even on one thread, so that the diagnostics come out
+     * as from compile_file () whatever -j is. */
+    warnings = error_warnings ();
+    ast = parse_parallel (&lex, c);
+    flat = flat_build (ast);
+    flat->tree = ast;
+    /* A hit would lose the file's warnings, so don't store it */
+    if (error_warnings () == warnings)
+        cache_store (c->cache, &entry, &lex, flat);
+    finish_file (path, c, flat->tree, flat);
+    lexer_free (&lex);
+}
+
+/* Lex and parse one source file. With -j, this runs as a job (see jobs.h), so
+ * it must only read the shared environment. */
+static void
+compile_file (const char *path, void *ctx)
+{
+    struct compile *c = ctx;
+    struct lex lex;
+    struct ast *ast;
+
+    if (c->cache) {
+        compile_cached (path, c);
+        return;
+    }
+
+    lexer_init (path, c->env, &lex);
+    if (c->body_threads > 1) {
+        ast = parse_parallel (&lex, c);
+    } else {
+        /* The parser only reads forwards, so tokens can be lexed as it asks
+         * for them */
+        lexer_stream (&lex);
+        ast = parse_file (&lex, c->env);
+    }
+    finish_file (path, c, ast, NULL);
+    lexer_free (&lex);
+}
+
 int main
 (int argc, char **argv)
 {
     struct args args;
     struct env env;
-    size_t i;
+    struct compile compile;
+    struct cache cache;
+    struct packages packages;
+    size_t i, failed = 0;
     /* List of booleans corresponding to sources: is this a .al file? */
     char al_files[LIST_ARG_MAX] = {0};
+    /* The .al files */
+    const char *al_paths[LIST_ARG_MAX];
+    size_t n_al = 0;
 
     /* Error handling code needs to know my name */
     error_set_name (argv[0]);
 
+    /* The standard types' names must be interned before anything else is */
+    types_init ();
+
     /* Read arguments */
     if (read_args (&args, argc, argv))
         return args.exit_code;
@@ -224,37 +374,150 @@ int main
         
     check_paths(&args, &env);
 
-    /* Compile */
-    /* Run lex and parse on each file. */
+    /* Gather the .al files */
     for (i = 0; i < LIST_ARG_MAX; ++i) {
+        if (al_files[i])
+            al_paths[n_al++] = args.sources[i];
+    }
+
+    /* Options -tokens, -ast and -pre-ast dump the first file, then quit.
+     * There is no type checking yet, so -ast and -pre-ast dump the same
+     * tree. */
+    if (n_al && (args.tokens_only || args.ast_only || args.pre_ast_only)) {
         struct lex lex;
-        if (!al_files[i]) continue;
-        lexer_init(args.sources[i], &env, &lex);
-        lexer_lex(&lex);
+        lexer_init(al_paths[0], &env, &lex);
+        /* Option -skip-bodies: only skim the file, which needs it lexed
+         * whole */
+        if (args.skip_bodies && !args.tokens_only)
+            lexer_lex(&lex);
+        else
+            lexer_stream(&lex);
 
         if (args.tokens_only) {
             /* Option -tokens: dump tokens */
-            size_t i;
-            for (i = 0; i < lex.n_tokens; ++i)
-                print_token(stdout, &lex.tokens[i]);
+            struct token *token;
+            while ((token = lexer_next (&lex)))
+                print_token(stdout, &lex, token);
+            if (lex.n_errors)
+                error_fail ();
+        } else if (args.ast_binary) {
+            /* Option -ast=binary: write the flattened tree */
+            struct flat_ast *flat;
+            FILE *f = stdout;
+            if (args.skip_bodies) {
+                struct ast *ast = parse_file_lazy (&lex, &env);
+                flat = flat_build (ast);
+                flat->tree = ast;
+            } else {
+                flat = parse_file_flat (&lex, &env);
+            }
+            if (args.output) {
+                f = fopen (args.output, "wb");
+                if (!f) error_message ("%s: %s", args.output,
+                                       strerror (errno));
+            }
+            if (binast_write (flat, al_paths[0], f))
+                error_message ("%s: %s", args.output ? args.output
+                               : "stdout", strerror (errno));
+            if (f != stdout && fclose (f))
+                error_message ("%s: %s", args.output, strerror (errno));
+            flat_free (flat);
+        } else {
+            struct ast *ast = args.skip_bodies ? parse_file_lazy (&lex, &env)
+                : parse_file (&lex, &env);
+            print_ast (ast, stdout);
+            free_ast (ast);
+        }
+        lexer_free (&lex);
+        types_free ();
+        intern_free ();
+        do_free_on_exit ();
+        return 0;
+    }
+
+    /* Option -deps: list each file's imports, skimming over the function
+     * bodies, then quit */
+    if (args.deps_only) {
+        for (i = 0; i < n_al; ++i) {
+            struct lex lex;
+            struct ast *ast;
+            size_t j;
+            lexer_init (al_paths[i], &env, &lex);
+            lexer_lex (&lex);
+            ast = parse_file_lazy (&lex, &env);
+            printf ("%s:", al_paths[i]);
+            for (j = 0; j < ast->o.file.n_imports; ++j)
+                printf (" %s", ast->o.file.imports[j]);
+            putchar ('\n');
+            free_ast (ast);
             lexer_free (&lex);
-            do_free_on_exit ();
-            return 0;
         }
+        types_free ();
+        intern_free ();
+        do_free_on_exit ();
+        return 0;
+    }
 
-        struct ast *ast = parse_file (&lex, &env);
-        if (args.pre_ast_only) {
-            print_ast (ast, stdout);
+    /* Option -dump-layouts: lay out each file's records and classes,
+     * skimming over the function bodies, then quit */
+    if (args.dump_layouts) {
+        for (i = 0; i < n_al; ++i) {
+            struct lex lex;
+            struct ast *ast;
+            struct layouts layouts;
+            lexer_init (al_paths[i], &env, &lex);
+            lexer_lex (&lex);
+            ast = parse_file_lazy (&lex, &env);
+            layouts_compute (&layouts, ast, &lex, &env);
+            printf ("%s%s:\n", i ? "\n" : "", al_paths[i]);
+            layouts_print (&layouts, stdout);
+            layouts_free (&layouts);
             free_ast (ast);
             lexer_free (&lex);
-            do_free_on_exit ();
-            return 0;
         }
+        types_free ();
+        intern_free ();
+        do_free_on_exit ();
+        return 0;
+    }
 
-        free_ast (ast);
-        lexer_free (&lex);
+    /* Compile */
+    packages_init (&packages, (const char *const *) args.pkg_dirs);
+    compile.env = &env;
+    compile.cache = NULL;
+    compile.packages = &packages;
+    /* Jobs left over once every file has one go to their function bodies */
+    compile.body_threads = n_al && (size_t) args.jobs > n_al
+        ? (int) (args.jobs / n_al) : 1;
+    if (args.cache_dir) {
+        cache_init (&cache, args.cache_dir, args.cache_size << 20,
+                    args.cache_clear, &env);
+        compile.cache = &cache;
+    }
+
+    /* Run lex and parse on each file - in parallel, with -j */
+    if (args.jobs > 1) {
+        failed = run_jobs (al_paths, n_al, args.jobs, compile_file, &compile);
+    } else {
+        for (i = 0; i < n_al; ++i)
+            compile_file (al_paths[i], &compile);
+    }
+
+    if (compile.cache) {
+        if (args.cache_stats)
+            cache_print_stats (&cache, stderr);
+        cache_free (&cache);
     }
+    if (failed)
+        return 1;
+
+    /* Every file is parsed, and every package's interface written, so the
+     * imports can be found now */
+    packages_resolve (&packages);
+    packages_free (&packages);
 
+    types_free ();
+    intern_free ();
     do_free_on_exit ();
 
     return 0;
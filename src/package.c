@@ -0,0 +1,225 @@
+/* Copyright (c) 2011, Christopher Pavlina. All rights reserved. */
+
+#include "package.h"
+#include "error.h"
+#include "filesystem.h"
+#include "parse/parse.h"
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+void
+packages_init (struct packages *pkgs, const char *const *dirs)
+{
+    memset (pkgs, 0, sizeof (*pkgs));
+    pkgs->dirs = dirs;
+    if (pthread_mutex_init (&pkgs->lock, NULL))
+        error_errno ();
+}
+
+void
+packages_free (struct packages *pkgs)
+{
+    size_t i;
+
+    for (i = 0; i < pkgs->n_loaded; ++i) {
+        binast_close (&pkgs->loaded[i].iface);
+        free ((char *) pkgs->loaded[i].path);
+    }
+    free (pkgs->loaded);
+    free (pkgs->imports);
+    pthread_mutex_destroy (&pkgs->lock);
+}
+
+/* malloc () the path of package 'name's interface in 'dir', which is 'len'
+ * characters long - or in the current directory, if 'len' is zero */
+static char *
+interface_path (const char *dir, size_t len, const char *name)
+{
+    char *path = malloc (len + strlen (name) + sizeof (PACKAGE_SUFFIX) + 1);
+
+    if (!path) error_errno ();
+    if (len)
+        sprintf (path, "%.*s/%s%s", (int) len, dir, name, PACKAGE_SUFFIX);
+    else
+        sprintf (path, "%s%s", name, PACKAGE_SUFFIX);
+    return path;
+}
+
+/* Length of the directory part of 'path', without the last slash */
+static size_t
+dir_len (const char *path)
+{
+    const char *slash = strrchr (path, '/');
+    return slash ? (size_t) (slash - path) + (slash == path) : 0;
+}
+
+/* malloc () the path package 'name's interface is written to, from file
+ * 'source': in the first -P directory, or else beside the file */
+static char *
+output_path (struct packages *pkgs, const char *source, const char *name)
+{
+    if (pkgs->dirs && *pkgs->dirs)
+        return interface_path (*pkgs->dirs, strlen (*pkgs->dirs), name);
+    return interface_path (source, dir_len (source), name);
+}
+
+void
+packages_write_interface (struct packages *pkgs, struct flat_ast *flat,
+                          const char *source)
+{
+    const char *name = FLAT_PAYLOAD (flat, 0, file)->name;
+    char *path, *temp;
+    unsigned n_temp;
+    FILE *f;
+
+    pthread_mutex_lock (&pkgs->lock);
+    n_temp = pkgs->n_temps++;
+    pthread_mutex_unlock (&pkgs->lock);
+
+    /* Importers may be reading the old one, so replace it in one go */
+    path = output_path (pkgs, source, name);
+    temp = malloc (strlen (path) + 32);
+    if (!temp) error_errno ();
+    sprintf (temp, "%s.%ld-%u.tmp", path, (long) getpid (), n_temp);
+
+    /* The file itself compiled, so only its importers can miss this */
+    f = fopen (temp, "wb");
+    if (!f) {
+        warning_message ("cannot write interface %s: %s", path,
+                         strerror (errno));
+    } else if (binast_write_interface (flat, source, PACKAGE_INLINE_MAX, f) |
+               (fclose (f) != 0) || rename (temp, path)) {
+        warning_message ("cannot write interface %s: %s", path,
+                         strerror (errno));
+        remove (temp);
+    }
+    free (temp);
+    free (path);
+}
+
+int
+packages_interface_fresh (struct packages *pkgs, const char *name,
+                          const char *source)
+{
+    char *path = output_path (pkgs, source, name);
+    time_t mtime = mtime_of (path), source_mtime = mtime_of (source);
+
+    free (path);
+    return mtime && source_mtime && mtime > source_mtime;
+}
+
+void
+packages_import (struct packages *pkgs, const char *file, const char *name)
+{
+    pthread_mutex_lock (&pkgs->lock);
+    if (pkgs->n_imports == pkgs->imports_mem) {
+        struct package_import *imports;
+        pkgs->imports_mem = pkgs->imports_mem ? 2 * pkgs->imports_mem : 16;
+        imports = realloc (pkgs->imports,
+                           pkgs->imports_mem * sizeof (*imports));
+        if (!imports) {
+            pthread_mutex_unlock (&pkgs->lock);
+            error_errno ();
+        }
+        pkgs->imports = imports;
+    }
+    pkgs->imports[pkgs->n_imports].file = file;
+    pkgs->imports[pkgs->n_imports].name = name;
+    ++pkgs->n_imports;
+    pthread_mutex_unlock (&pkgs->lock);
+}
+
+/* Find package 'name's interface for 'file': in the first -P directory
+ * which has it, or else beside the file. malloc ()s the path; returns NULL
+ * if there is none. */
+static char *
+find_interface (struct packages *pkgs, const char *file, const char *name)
+{
+    const char *const *dir;
+    char *path;
+
+    for (dir = pkgs->dirs; dir && *dir; ++dir) {
+        path = interface_path (*dir, strlen (*dir), name);
+        if (!f_access (path, R_OK))
+            return path;
+        free (path);
+    }
+    path = interface_path (file, dir_len (file), name);
+    if (!f_access (path, R_OK))
+        return path;
+    free (path);
+    return NULL;
+}
+
+void
+packages_resolve (struct packages *pkgs)
+{
+    struct package_import *import;
+    struct package *pkg;
+    const struct binast_node *node;
+    size_t i;
+
+    for (i = 0; i < pkgs->n_imports; ++i) {
+        import = &pkgs->imports[i];
+        if (packages_find (pkgs, import->name))
+            continue;
+
+        if (pkgs->n_loaded == pkgs->loaded_mem) {
+            struct package *loaded;
+            pkgs->loaded_mem = pkgs->loaded_mem ? 2 * pkgs->loaded_mem : 16;
+            loaded = realloc (pkgs->loaded,
+                              pkgs->loaded_mem * sizeof (*loaded));
+            if (!loaded) error_errno ();
+            pkgs->loaded = loaded;
+        }
+        pkg = &pkgs->loaded[pkgs->n_loaded];
+        pkg->name = import->name;
+        pkg->path = find_interface (pkgs, import->file, import->name);
+        if (!pkg->path)
+            error_message ("%s: cannot find package %s", import->file,
+                           import->name);
+
+        binast_open (pkg->path, &pkg->iface);
+        node = &pkg->iface.nodes[0];
+        if (node->tag != AST_FILE || !(node->flags & BINAST_INTERFACE) ||
+            node->name == BINAST_NONE ||
+            strcmp (pkg->iface.string_data + pkg->iface.strings[node->name],
+                    pkg->name))
+            error_message ("%s: not the interface of package %s", pkg->path,
+                           pkg->name);
+        ++pkgs->n_loaded;
+    }
+    pkgs->n_imports = 0;
+}
+
+const struct package *
+packages_find (struct packages *pkgs, const char *name)
+{
+    size_t i;
+
+    /* Names are interned */
+    for (i = 0; i < pkgs->n_loaded; ++i) {
+        if (pkgs->loaded[i].name == name)
+            return &pkgs->loaded[i];
+    }
+    return NULL;
+}
+
+uint32_t
+package_function (const struct package *pkg, const char *name)
+{
+    const struct binast *bin = &pkg->iface;
+    const char *fn_name;
+    uint32_t i;
+
+    for (i = bin->nodes[0].first_child; i != BINAST_NONE;
+         i = bin->nodes[i].next_sibling) {
+        fn_name = binast_string (bin, bin->nodes[i].name);
+        if (bin->nodes[i].tag == AST_FUNCTION && fn_name &&
+            !strcmp (fn_name, name))
+            return i;
+    }
+    return BINAST_NONE;
+}
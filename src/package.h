@@ -0,0 +1,99 @@
+/* Copyright (c) 2011, Christopher Pavlina. All rights reserved. */
+
+#ifndef _PACKAGE_H
+#define _PACKAGE_H 1
+
+#include "parse/flat.h"
+#include "parse/binast.h"
+#include <stdint.h>
+#include <pthread.h>
+
+/* Package interfaces.
+ *
+ * Compiling a package writes its interface, NAME.ali, into the first -P
+ * directory, or beside the source if there is none: the records and classes,
+ * the function signatures, and the bodies small enough to inline, as a binary
+ * AST (see binast_write_interface ()). A file which
+ * says "import NAME;" loads the interface - from the first -P directory which
+ * has it, or else from the file's own directory - with one mapping; nothing
+ * of the package is lexed or parsed again.
+ *
+ * Imports are resolved once every file has been parsed, so a package and the
+ * files importing it can be compiled in one run, in any order, with -j. Each
+ * interface is loaded once, however many files import it.
+ */
+
+/* Keep the bodies of functions of at most this many nodes */
+#define PACKAGE_INLINE_MAX 64
+
+#define PACKAGE_SUFFIX ".ali"
+
+/* A loaded interface */
+struct package {
+    /* Interned */
+    const char *name;
+    const char *path;
+    struct binast iface;
+};
+
+struct packages {
+    /* The -P directories, followed by NULL */
+    const char *const *dirs;
+
+    /* Everything below is shared between jobs, under 'lock' */
+    pthread_mutex_t lock;
+
+    /* Imports waiting for packages_resolve () */
+    struct package_import {
+        const char *file;
+        const char *name;
+    } *imports;
+    size_t n_imports, imports_mem;
+
+    struct package *loaded;
+    size_t n_loaded, loaded_mem;
+
+    /* Number of temporary files made, to keep their names apart */
+    unsigned n_temps;
+};
+
+/* Start with no packages, searching 'dirs' (NULL-terminated) */
+void
+packages_init (struct packages *pkgs, const char *const *dirs);
+
+/* Unload every package */
+void
+packages_free (struct packages *pkgs);
+
+/* Write the interface of the package file 'source', parsed into 'flat'. A
+ * package is one file, for now. If it can't be written, warn: the file is
+ * still compiled, and only importers will notice. */
+void
+packages_write_interface (struct packages *pkgs, struct flat_ast *flat,
+                          const char *source);
+
+/* Whether the interface of package 'name', from file 'source', where
+ * packages_write_interface () would put it, is newer than the source */
+int
+packages_interface_fresh (struct packages *pkgs, const char *name,
+                          const char *source);
+
+/* Note that file 'file' imports package 'name' (interned). Both strings must
+ * last until packages_resolve (). */
+void
+packages_import (struct packages *pkgs, const char *file, const char *name);
+
+/* Load every package imported so far, if it isn't already. Exits if one
+ * can't be found, or isn't a package interface. */
+void
+packages_resolve (struct packages *pkgs);
+
+/* A package loaded by packages_resolve (), or NULL */
+const struct package *
+packages_find (struct packages *pkgs, const char *name);
+
+/* The node of function 'name' in a package's interface, or BINAST_NONE */
+uint32_t
+package_function (const struct package *pkg, const char *name);
+
+#endif /* _PACKAGE_H */
@@ -2,94 +2,248 @@
 
 #include "parse.h"
 #include "../error.h"
+#include "../intern.h"
+#include "../types/type.h"
 #include <stdlib.h>
 #include <string.h>
-
-static const size_t DEFAULT_CHILDREN_MEM[] = {
-  /* file */         16,
-    /* class */      16,
-    /* function */    1, /* single child - the scope */
-    /* st_break */    0,
-    /* st_continue */ 0,
-    /* st_vardecl */  1, /* usually one variable per declaration */
-    /* st_new */      2,
-    /* st_delete */   1,
-    /* st_do_while */ 2, /* condition and scope */
-    /* st_while */    2, /* condition and scope */
-    /* st_for */      4, /* initialiser, condition, increment, scope */
-    /* st_if */       3, /* condition, true, false */
-    /* st_return */   1,
-    /* expr */        2,
-    /* scope */      16 };
+#include <assert.h>
 
 struct ast *
-new_ast (enum ast_tag type)
+new_ast (struct ast_arena *arena, enum ast_tag type)
 {
   struct ast *s;
 
-  s = malloc (sizeof (*s));
-  if (!s) error_errno ();
+  s = arena_alloc (&arena->mem, sizeof (*s));
   memset (s, 0, sizeof (*s));
-
   s->tag = type;
-  s->children = malloc (DEFAULT_CHILDREN_MEM[type] * sizeof (*s->children));
-  if (!s->children) {
-    free (s);
-    error_errno ();
-  }
-  
-  s->n_children = 0;
-  s->children_mem = DEFAULT_CHILDREN_MEM[type];
 
   return s;
 }
 
+size_t
+ast_begin (struct ast_arena *arena)
+{
+  return arena->stack_len;
+}
+
 void
-ast_add (struct ast *parent, struct ast *child)
+ast_add (struct ast_arena *arena, struct ast *child)
 {
-  if (parent->n_children + 1 > parent->children_mem) {
-    struct ast **new_children;
-    size_t new_sz = (2 * parent->children_mem) * sizeof (*parent->children);
-    new_children = realloc (parent->children, new_sz);
-    if (!new_children) error_errno ();
-    parent->children = new_children;
-    parent->children_mem *= 2;
+  if (arena->stack_len == arena->stack_mem) {
+    struct ast **new_stack;
+    size_t new_mem = arena->stack_mem ? 2 * arena->stack_mem : 64;
+    new_stack = realloc (arena->stack, new_mem * sizeof (*arena->stack));
+    if (!new_stack) error_errno ();
+    arena->stack = new_stack;
+    arena->stack_mem = new_mem;
   }
-  parent->children[parent->n_children] = child;
-  ++parent->n_children;
-  child->parent = parent;
+  arena->stack[arena->stack_len++] = child;
 }
 
 void
-free_ast (struct ast *ast)
+ast_finish (struct ast_arena *arena, struct ast *parent, size_t mark)
 {
-  void (*free_fns[]) (struct ast *) =
-    { free_file, NULL, NULL, NULL, NULL,
-      NULL, NULL, NULL, NULL, NULL,
-      NULL, NULL, NULL, NULL, NULL };
-  size_t i;
-
-  free_fns[ast->tag] (ast);
-  for (i = 0; i < ast->n_children; ++i) {
-    free_ast (ast->children[i]);
+  size_t i, n = arena->stack_len - mark;
+
+  parent->n_children = n;
+  parent->children = NULL;
+  if (n) {
+    parent->children = arena_alloc (&arena->mem,
+                                    n * sizeof (*parent->children));
+    memcpy (parent->children, &arena->stack[mark],
+            n * sizeof (*parent->children));
+    for (i = 0; i < n; ++i)
+      parent->children[i]->parent = parent;
   }
-  free (ast);
+  arena->stack_len = mark;
 }
 
+/* One node being walked by ast_visit (): the node, and the next child to
+ * visit */
+struct visit_frame {
+  struct ast *ast;
+  size_t next;
+};
+
 void
-print_ast (struct ast *ast, FILE *dest)
+ast_visit (struct ast *ast, const struct ast_visitor *visitor, void *data)
 {
-  _print_ast (ast, dest, 0);
-  fputc ('\n', dest);
+  struct visit_frame *stack, *top;
+  size_t len = 0, mem = 64;
+  struct ast *child;
+
+  stack = malloc (mem * sizeof (*stack));
+  if (!stack) error_errno ();
+
+  stack[len].ast = ast;
+  stack[len].next = 0;
+  if (visitor->pre[ast->tag] &&
+      visitor->pre[ast->tag] (ast, 0, data) == AST_SKIP)
+    stack[len].next = ast->n_children;
+  ++len;
+
+  while (len) {
+    top = &stack[len - 1];
+    if (top->next == top->ast->n_children) {
+      if (visitor->post[top->ast->tag])
+        visitor->post[top->ast->tag] (top->ast, len - 1, data);
+      --len;
+      continue;
+    }
+
+    child = top->ast->children[top->next++];
+    if (len == mem) {
+      struct visit_frame *new_stack;
+      mem *= 2;
+      new_stack = realloc (stack, mem * sizeof (*stack));
+      if (!new_stack) error_errno ();
+      stack = new_stack;
+    }
+    stack[len].ast = child;
+    stack[len].next = 0;
+    if (visitor->pre[child->tag] &&
+        visitor->pre[child->tag] (child, len, data) == AST_SKIP)
+      stack[len].next = child->n_children;
+    ++len;
+  }
+
+  free (stack);
+}
+
+struct token *
+parse_expect (struct lex *lex, int id, const char *what)
+{
+  struct token *token = lexer_next (lex);
+
+  if (!token)
+    cerror_eof (lex, "expected %s", what);
+  else if (!token_is_id (token, id))
+    cerror_after (lex, lexer_last (lex), "expected %s", what);
+  return token;
+}
+
+const char *
+parse_name (struct lex *lex, const char *what)
+{
+  struct token *token = lexer_next (lex);
+
+  if (!token)
+    cerror_eof (lex, "expected %s", what);
+  else if (!token_is_t (token, T_WORD) || token_is_keyword (token, 1))
+    cerror_at (lex, token, "expected %s", what);
+  return intern (token->value, token->len);
+}
+
+void
+parse_sync (struct lex *lex, int nested)
+{
+  struct token *token;
+  size_t depth = 0;
+
+  /* Start from the token the error was found at, if it has been read */
+  if (lexer_tell (lex)) {
+    lexer_back (lex);
+    if (lexer_peek (lex)->offset < lex->error_offset)
+      lexer_next (lex);
+  }
+
+  while ((token = lexer_peek (lex))) {
+    if (token_is_id (token, TOK_RBRACE)) {
+      if (!depth && nested)
+        return;
+      lexer_next (lex);
+      if (depth <= 1)
+        return;
+      --depth;
+      continue;
+    }
+    lexer_next (lex);
+    if (token_is_id (token, TOK_LBRACE))
+      ++depth;
+    else if (token_is_id (token, TOK_SEMI) && !depth)
+      return;
+  }
+}
+
+void
+free_ast (struct ast *ast)
+{
+  assert (ast->tag == AST_FILE);
+  free_file (ast);
+}
+
+void
+print_start (struct ast *ast, size_t depth, FILE *dest)
+{
+  size_t ind;
+
+  if (depth && ast != ast->parent->children[0])
+    fputc ('\n', dest);
+  for (ind = 0; ind < 2 * depth; ++ind) fputc (' ', dest);
+}
+
+void
+print_type (struct type *type, FILE *dest)
+{
+  char buf[256], *name = buf;
+  size_t len = type_format (type, buf, sizeof (buf));
+
+  if (len >= sizeof (buf)) {
+    name = malloc (len + 1);
+    if (!name) error_errno ();
+    type_format (type, name, len + 1);
+  }
+  fputs (name, dest);
+  if (name != buf)
+    free (name);
 }
 
+static void
+print_close (struct ast *ast, size_t depth, void *data)
+{
+  (void) ast;
+  (void) depth;
+  fputc (')', (FILE *) data);
+}
+
+static const struct ast_visitor PRINT_VISITOR = {
+  .pre = {
+    [AST_FILE] = print_file,
+    [AST_CLASS] = print_class,
+    [AST_FIELD] = print_field,
+    [AST_FUNCTION] = print_function,
+    [AST_ST_BREAK] = print_statement,
+    [AST_ST_CONTINUE] = print_statement,
+    [AST_ST_VARDECL] = print_st_vardecl,
+    [AST_ST_DO_WHILE] = print_statement,
+    [AST_ST_WHILE] = print_statement,
+    [AST_ST_FOR] = print_statement,
+    [AST_ST_IF] = print_statement,
+    [AST_ST_RETURN] = print_statement,
+    [AST_EXPR] = print_expr,
+    [AST_SCOPE] = print_statement
+  },
+  .post = {
+    [AST_FILE] = print_close,
+    [AST_CLASS] = print_close,
+    [AST_FIELD] = print_close,
+    [AST_FUNCTION] = print_close,
+    [AST_ST_BREAK] = print_close,
+    [AST_ST_CONTINUE] = print_close,
+    [AST_ST_VARDECL] = print_close,
+    [AST_ST_DO_WHILE] = print_close,
+    [AST_ST_WHILE] = print_close,
+    [AST_ST_FOR] = print_close,
+    [AST_ST_IF] = print_close,
+    [AST_ST_RETURN] = print_close,
+    [AST_EXPR] = print_close,
+    [AST_SCOPE] = print_close
+  }
+};
+
 void
-_print_ast (struct ast *ast, FILE *dest, int indent)
+print_ast (struct ast *ast, FILE *dest)
 {
-  void (*print_fns[]) (struct ast *, FILE *, int) =
-    { print_file, NULL, NULL, NULL, NULL,
-      NULL, NULL, NULL, NULL, NULL,
-      NULL, NULL, NULL, NULL, NULL };
-  
-  print_fns[ast->tag] (ast, dest, indent);
+  ast_visit (ast, &PRINT_VISITOR, dest);
+  fputc ('\n', dest);
 }
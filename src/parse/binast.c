@@ -0,0 +1,445 @@
+/* Copyright (c) 2011, Christopher Pavlina. All rights reserved. */
+
+#include "binast.h"
+#include "../error.h"
+#include "../filesystem.h"
+#include "../intern.h"
+#include "../types/type.h"
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const char MAGIC[4] = {'A', 'L', 'S', 'T'};
+
+/* The string table being built. Every string written is interned, so strings
+ * are told apart by pointer, in an open-addressed hash table of indices. */
+struct strings {
+  const char **list;
+  size_t n, mem;
+  uint32_t *table;               /* index + 1, or 0 for an empty slot */
+  size_t table_size;
+  size_t data_size;
+};
+
+static size_t
+hash_pointer (const char *s, size_t table_size)
+{
+  uintptr_t v = (uintptr_t) s;
+
+  v ^= v >> 17;
+  v *= 0x9e3779b1u;
+  return (v ^ (v >> 15)) & (table_size - 1);
+}
+
+static void
+strings_grow (struct strings *st)
+{
+  size_t i, j, new_size = st->table_size ? 2 * st->table_size : 256;
+  uint32_t *table = calloc (new_size, sizeof (*table));
+
+  if (!table) error_errno ();
+  for (i = 0; i < st->n; ++i) {
+    j = hash_pointer (st->list[i], new_size);
+    while (table[j]) j = (j + 1) & (new_size - 1);
+    table[j] = i + 1;
+  }
+  free (st->table);
+  st->table = table;
+  st->table_size = new_size;
+}
+
+/* Index of interned string 's' in the table, adding it if need be */
+static uint32_t
+string_index (struct strings *st, const char *s)
+{
+  size_t j;
+
+  if (!s) return BINAST_NONE;
+  if (2 * (st->n + 1) > st->table_size)
+    strings_grow (st);
+
+  j = hash_pointer (s, st->table_size);
+  while (st->table[j]) {
+    if (st->list[st->table[j] - 1] == s)
+      return st->table[j] - 1;
+    j = (j + 1) & (st->table_size - 1);
+  }
+
+  if (st->n == st->mem) {
+    const char **list;
+    st->mem = st->mem ? 2 * st->mem : 256;
+    list = realloc (st->list, st->mem * sizeof (*list));
+    if (!list) error_errno ();
+    st->list = list;
+  }
+  if (st->n >= BINAST_NONE || st->data_size > UINT32_MAX - strlen (s) - 1)
+    error_message ("AST too large");
+  st->list[st->n] = s;
+  st->table[j] = ++st->n;
+  st->data_size += strlen (s) + 1;
+  return st->n - 1;
+}
+
+/* A type's full name, interned */
+static uint32_t
+type_index (struct strings *st, struct type *type)
+{
+  char buf[256], *name = buf;
+  size_t len;
+  uint32_t i;
+
+  if (!type) return BINAST_NONE;
+  len = type_format (type, buf, sizeof (buf));
+  if (len >= sizeof (buf)) {
+    name = malloc (len + 1);
+    if (!name) error_errno ();
+    type_format (type, name, len + 1);
+  }
+  i = string_index (st, intern (name, len));
+  if (name != buf)
+    free (name);
+  return i;
+}
+
+/* Make room for one more parameter */
+static void
+add_param (struct binast_param **params, size_t *n_params, size_t *params_mem)
+{
+  struct binast_param *new_params;
+
+  if (*n_params < *params_mem)
+    return;
+  *params_mem = *params_mem ? 2 * *params_mem : 64;
+  new_params = realloc (*params, *params_mem * sizeof (**params));
+  if (!new_params) error_errno ();
+  *params = new_params;
+}
+
+/* Fill in the fields of 'node' which come from flat node 'i's payload */
+static void
+write_payload (struct flat_ast *flat, uint32_t i, struct binast_node *node,
+               struct strings *st, struct binast_param **params,
+               size_t *n_params, size_t *params_mem)
+{
+  struct token *token = &flat->tokens[i];
+  struct file *file;
+  struct class *class;
+  struct function *function;
+  struct st_for *st_for;
+  struct expr *expr;
+  size_t j;
+
+  switch (flat->nodes[i].tag) {
+  case AST_FILE:
+    file = FLAT_PAYLOAD (flat, i, file);
+    node->name = string_index (st, file->name);
+    if (file->is_executable)
+      node->flags |= BINAST_EXECUTABLE;
+    if (file->n_imports) {
+      node->params = *n_params;
+      node->n_params = file->n_imports;
+    }
+    for (j = 0; j < file->n_imports; ++j) {
+      add_param (params, n_params, params_mem);
+      (*params)[*n_params].type = BINAST_NONE;
+      (*params)[*n_params].name = string_index (st, file->imports[j]);
+      ++*n_params;
+    }
+    break;
+
+  case AST_CLASS:
+    class = FLAT_PAYLOAD (flat, i, class);
+    node->name = string_index (st, class->name);
+    node->flags |= (class->is_record ? BINAST_RECORD : 0) |
+      (class->is_reorder ? BINAST_REORDER : 0);
+    break;
+
+  case AST_FIELD:
+    node->name = string_index (st, FLAT_PAYLOAD (flat, i, field)->name);
+    node->type = type_index (st, FLAT_PAYLOAD (flat, i, field)->type);
+    if (FLAT_PAYLOAD (flat, i, field)->is_hot)
+      node->flags |= BINAST_HOT;
+    break;
+
+  case AST_FUNCTION:
+    function = FLAT_PAYLOAD (flat, i, function);
+    node->name = string_index (st, function->name);
+    node->type = type_index (st, function->ret);
+    node->flags |= (function->is_extern ? BINAST_EXTERN : 0) |
+      (function->is_variadic ? BINAST_VARIADIC : 0) |
+      (function->is_lazy ? BINAST_NO_BODY : 0);
+    node->params = *n_params;
+    node->n_params = function->n_params;
+    for (j = 0; j < function->n_params; ++j) {
+      add_param (params, n_params, params_mem);
+      (*params)[*n_params].type = type_index (st, function->params[j].type);
+      (*params)[*n_params].name = string_index (st, function->params[j].name);
+      ++*n_params;
+    }
+    break;
+
+  case AST_ST_VARDECL:
+    node->name = string_index (st, FLAT_PAYLOAD (flat, i, st_vardecl)->name);
+    node->type = type_index (st, FLAT_PAYLOAD (flat, i, st_vardecl)->type);
+    break;
+
+  case AST_ST_FOR:
+    st_for = FLAT_PAYLOAD (flat, i, st_for);
+    node->flags |= (st_for->has_init ? BINAST_FOR_INIT : 0) |
+      (st_for->has_cond ? BINAST_FOR_COND : 0) |
+      (st_for->has_step ? BINAST_FOR_STEP : 0);
+    break;
+
+  case AST_EXPR:
+    expr = FLAT_PAYLOAD (flat, i, expr);
+    node->kind = expr->kind;
+    node->op = expr->op;
+    node->name = string_index (st, expr->name);
+    node->type = type_index (st, expr->type);
+    if (expr->kind == EXPR_LITERAL && token->type == T_STRING)
+      node->name = string_index (st, intern (token->value, token->len));
+    /* Only numbers have a value. For true, false and null, which are told
+     * by their token's ID, 'num' stays zero, as the nodes were allocated. */
+    else if (expr->kind == EXPR_LITERAL &&
+             (token->type == T_INT || token->type == T_REAL))
+      memcpy (&node->num, &token->num, sizeof (node->num));
+    break;
+  }
+}
+
+/* Write the nodes of 'flat' for which map[i] is not BINAST_NONE, with
+ * node i becoming node map[i]. Only whole subtrees may be left out, and node
+ * 0 must stay. */
+static int
+write_nodes (struct flat_ast *flat, const char *source, const uint32_t *map,
+             uint32_t n_nodes, uint16_t file_flags, FILE *f)
+{
+  struct binast_header header;
+  struct binast_node *nodes, *node;
+  struct binast_param *params = NULL;
+  struct strings st;
+  size_t n_params = 0, params_mem = 0, i;
+  uint32_t offset, next;
+  int failed;
+
+  memset (&st, 0, sizeof (st));
+  nodes = calloc (n_nodes, sizeof (*nodes));
+  if (!nodes) error_errno ();
+
+  memset (&header, 0, sizeof (header));
+  memcpy (header.magic, MAGIC, sizeof (MAGIC));
+  header.version = BINAST_VERSION;
+  header.byte_order = BINAST_BYTE_ORDER;
+  header.source = string_index (&st, intern_s (source));
+
+  for (i = 0; i < flat->n_nodes; ++i) {
+    if (map[i] == BINAST_NONE)
+      continue;
+    node = &nodes[map[i]];
+
+    /* A left-out child is passed over in favour of the next one kept */
+    node->parent = i ? map[flat->nodes[i].parent] : BINAST_NONE;
+    next = flat->nodes[i].first_child;
+    while (next != FLAT_NONE && map[next] == BINAST_NONE)
+      next = flat->nodes[next].next_sibling;
+    node->first_child = next == FLAT_NONE ? BINAST_NONE : map[next];
+    next = flat->nodes[i].next_sibling;
+    while (next != FLAT_NONE && map[next] == BINAST_NONE)
+      next = flat->nodes[next].next_sibling;
+    node->next_sibling = next == FLAT_NONE ? BINAST_NONE : map[next];
+
+    node->offset = flat->tokens[i].offset;
+    node->len = flat->tokens[i].len;
+    node->name = node->type = node->params = BINAST_NONE;
+    node->tag = flat->nodes[i].tag;
+    node->token_type = flat->tokens[i].type;
+    node->token_id = flat->tokens[i].id;
+    write_payload (flat, i, node, &st, &params, &n_params, &params_mem);
+    if (node->tag == AST_FUNCTION && node->first_child == BINAST_NONE &&
+        flat->nodes[i].first_child != FLAT_NONE)
+      node->flags |= BINAST_NO_BODY;
+  }
+  nodes[0].flags |= file_flags;
+
+  header.n_nodes = n_nodes;
+  header.n_params = n_params;
+  header.n_strings = st.n;
+  header.strings_size = st.data_size;
+
+  fwrite (&header, sizeof (header), 1, f);
+  fwrite (nodes, sizeof (*nodes), n_nodes, f);
+  if (n_params)
+    fwrite (params, sizeof (*params), n_params, f);
+  for (i = 0, offset = 0; i < st.n; ++i) {
+    fwrite (&offset, sizeof (offset), 1, f);
+    offset += strlen (st.list[i]) + 1;
+  }
+  for (i = 0; i < st.n; ++i)
+    fwrite (st.list[i], 1, strlen (st.list[i]) + 1, f);
+  failed = fflush (f) || ferror (f);
+
+  free (nodes);
+  free (params);
+  free (st.list);
+  free (st.table);
+  return failed;
+}
+
+int
+binast_write (struct flat_ast *flat, const char *source, FILE *f)
+{
+  uint32_t *map, i;
+  int failed;
+
+  map = malloc (flat->n_nodes * sizeof (*map));
+  if (!map) error_errno ();
+  for (i = 0; i < flat->n_nodes; ++i)
+    map[i] = i;
+  failed = write_nodes (flat, source, map, flat->n_nodes, 0, f);
+  free (map);
+  return failed;
+}
+
+int
+binast_write_interface (struct flat_ast *flat, const char *source,
+                        uint32_t max_inline, FILE *f)
+{
+  uint32_t *map, i, j, end, n = 0;
+  int failed;
+
+  map = malloc (flat->n_nodes * sizeof (*map));
+  if (!map) error_errno ();
+  for (i = 0; i < flat->n_nodes; ++i)
+    map[i] = BINAST_NONE;
+
+  map[0] = n++;
+  FLAT_FOR_CHILDREN (flat, 0, i) {
+    if (flat->nodes[i].tag != AST_FUNCTION &&
+        flat->nodes[i].tag != AST_CLASS)
+      continue;
+    /* Importers need every field, to lay records out */
+    map[i] = n++;
+    end = flat_subtree_end (flat, i);
+    if (flat->nodes[i].tag == AST_FUNCTION && end - i - 1 > max_inline)
+      continue;
+    for (j = i + 1; j < end; ++j)
+      map[j] = n++;
+  }
+
+  failed = write_nodes (flat, source, map, n, BINAST_INTERFACE, f);
+  free (map);
+  return failed;
+}
+
+/* Whether 'i' is a valid index into a table of 'n', or BINAST_NONE */
+#define INDEX_OK(i, n) ((i) == BINAST_NONE || (i) < (n))
+
+/* Check the binary AST in bin->data, and point bin's tables into it. Return
+ * NULL, or what is wrong with it */
+static const char *
+check (struct binast *bin)
+{
+  const struct binast_header *h;
+  const struct binast_node *node;
+  size_t need, i;
+
+  h = bin->header = (const struct binast_header *) bin->data;
+  if (bin->size < sizeof (*h) || memcmp (h->magic, MAGIC, sizeof (MAGIC)))
+    return "not a binary AST file";
+  if (h->byte_order != BINAST_BYTE_ORDER)
+    return "binary AST is in the wrong byte order";
+  if (h->version != BINAST_VERSION)
+    return "binary AST is from another version of the compiler";
+
+  /* Sizes are 32-bit, so this can't overflow a 64-bit size_t; on 32 bits,
+   * a file this big couldn't have been read */
+  need = sizeof (*h) + (size_t) h->n_nodes * sizeof (*bin->nodes) +
+    (size_t) h->n_params * sizeof (*bin->params) +
+    (size_t) h->n_strings * sizeof (*bin->strings) + h->strings_size;
+  if (need != bin->size || !h->n_nodes)
+    return "binary AST is truncated or corrupt";
+
+  bin->nodes = (const struct binast_node *) (h + 1);
+  bin->params = (const struct binast_param *) (bin->nodes + h->n_nodes);
+  bin->strings = (const uint32_t *) (bin->params + h->n_params);
+  bin->string_data = (const char *) (bin->strings + h->n_strings);
+
+  /* Check every index, so that readers need not */
+  if ((h->strings_size && bin->string_data[h->strings_size - 1]) ||
+      !INDEX_OK (h->source, h->n_strings))
+    return "binary AST is truncated or corrupt";
+  for (i = 0; i < h->n_strings; ++i) {
+    if (bin->strings[i] >= h->strings_size)
+      return "binary AST is truncated or corrupt";
+  }
+  for (i = 0; i < h->n_params; ++i) {
+    if (!INDEX_OK (bin->params[i].type, h->n_strings) ||
+        !INDEX_OK (bin->params[i].name, h->n_strings))
+      return "binary AST is truncated or corrupt";
+  }
+  for (i = 0; i < h->n_nodes; ++i) {
+    node = &bin->nodes[i];
+    if (!INDEX_OK (node->parent, h->n_nodes) ||
+        !INDEX_OK (node->first_child, h->n_nodes) ||
+        !INDEX_OK (node->next_sibling, h->n_nodes) ||
+        !INDEX_OK (node->name, h->n_strings) ||
+        !INDEX_OK (node->type, h->n_strings) ||
+        node->tag >= AST_N_TAGS ||
+        (node->params != BINAST_NONE &&
+         (node->params > h->n_params ||
+          node->n_params > h->n_params - node->params)))
+      return "binary AST is truncated or corrupt";
+  }
+  return NULL;
+}
+
+void
+binast_open (const char *path, struct binast *bin)
+{
+  const char *problem;
+  FILE *f;
+
+  memset (bin, 0, sizeof (*bin));
+  f = fopen (path, "rb");
+  if (!f) error_message ("%s: %s", path, strerror (errno));
+
+  bin->data = map_file_f (f, &bin->size);
+  bin->mapped = bin->data != NULL;
+  if (!bin->data) {
+    /* malloc () aligns well enough for the tables too */
+    bin->size = size_of_f (f);
+    bin->data = malloc (bin->size + 1);
+    if (!bin->data) error_errno ();
+    if (fread (bin->data, 1, bin->size, f) != bin->size)
+      error_message ("%s: %s", path, strerror (errno));
+  }
+  fclose (f);
+
+  problem = check (bin);
+  if (problem)
+    error_message ("%s: %s", path, problem);
+}
+
+const char *
+binast_view (struct binast *bin, const char *data, size_t size)
+{
+  const char *problem;
+
+  memset (bin, 0, sizeof (*bin));
+  bin->data = (char *) data;
+  bin->size = size;
+  problem = check (bin);
+  bin->data = NULL;
+  bin->size = 0;
+  return problem;
+}
+
+void
+binast_close (struct binast *bin)
+{
+  if (bin->mapped)
+    unmap_file (bin->data, bin->size);
+  else
+    free (bin->data);
+  memset (bin, 0, sizeof (*bin));
+}
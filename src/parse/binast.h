@@ -0,0 +1,127 @@
+/* Copyright (c) 2011, Christopher Pavlina. All rights reserved. */
+
+#ifndef _PARSE_BINAST_H
+#define _PARSE_BINAST_H 1
+
+#include "flat.h"
+#include <stdio.h>
+#include <stdint.h>
+
+/* Binary AST files, as written by -ast=binary. A file is one flat AST (see
+ * flat.h), laid out so that it can be mapped into memory and used in place:
+ *
+ *   struct binast_header
+ *   struct binast_node    nodes[n_nodes]     pre-order; node 0 is the file
+ *   struct binast_param   params[n_params]
+ *   uint32_t              strings[n_strings] offsets into the string data
+ *   char                  string data[strings_size]
+ *
+ * Nodes refer to each other, to parameters and to strings by index, with
+ * BINAST_NONE for none. The file node's "parameters" are its imports, with
+ * no type. Each distinct string is stored once, NUL-terminated;
+ * types are stored as their names spelt out in full (see type_format ()).
+ * Every field is in the writer's byte order - 'byte_order' tells a reader
+ * whether that is its own - and every struct is padded to a multiple of 8
+ * bytes, so the tables stay aligned. Readers must reject a 'version' other
+ * than the one they know: it is bumped on any change to the layout. */
+
+#define BINAST_VERSION 2
+#define BINAST_BYTE_ORDER 0x01020304u
+#define BINAST_NONE UINT32_MAX
+
+struct binast_header {
+  char magic[4];                 /* "ALST" */
+  uint32_t version;
+  uint32_t byte_order;           /* BINAST_BYTE_ORDER */
+  uint32_t n_nodes, n_params, n_strings, strings_size;
+  uint32_t source;               /* string: path of the source file */
+};
+
+/* binast_node.flags */
+#define BINAST_EXTERN    0x01    /* AST_FUNCTION: declared 'extern' */
+#define BINAST_VARIADIC  0x02    /* AST_FUNCTION: takes ... */
+#define BINAST_EXECUTABLE 0x04   /* AST_FILE: 'executable', not 'package' */
+#define BINAST_FOR_INIT  0x08    /* AST_ST_FOR: see struct st_for */
+#define BINAST_FOR_COND  0x10
+#define BINAST_FOR_STEP  0x20
+#define BINAST_INTERFACE 0x40    /* AST_FILE: a package interface - see
+                                    binast_write_interface () */
+#define BINAST_NO_BODY   0x80    /* AST_FUNCTION: has a body, left out of a
+                                    package interface or not parsed (see
+                                    -skip-bodies) */
+#define BINAST_RECORD    0x100   /* AST_CLASS: 'record', not 'class' */
+#define BINAST_REORDER   0x200   /* AST_CLASS: marked @reorder */
+#define BINAST_HOT       0x400   /* AST_FIELD: marked @hot */
+
+struct binast_node {
+  uint64_t num;                  /* literal's value, as in union token_num */
+  uint32_t parent, first_child, next_sibling;
+  uint32_t offset, len;          /* the node's token's place in the source */
+  uint32_t name;                 /* string: the name of a file, record,
+                                    class, field, function, variable, name
+                                    or member; the text of a string
+                                    literal */
+  uint32_t type;                 /* string: a function's return type, a
+                                    field's, variable's or cast's type */
+  uint32_t params, n_params;     /* AST_FUNCTION: its parameters;
+                                    AST_FILE: its imports */
+  uint16_t flags;                /* BINAST_* */
+  uint8_t tag;                   /* enum ast_tag */
+  uint8_t kind, op;              /* AST_EXPR: see struct expr */
+  uint8_t token_type, token_id;  /* the node's token's T_* and TOK_* */
+  uint8_t pad[5];
+};
+
+struct binast_param {
+  uint32_t type, name;           /* strings */
+};
+
+/* A binary AST file, opened for reading */
+struct binast {
+  const struct binast_header *header;
+  const struct binast_node *nodes;
+  const struct binast_param *params;
+  const uint32_t *strings;
+  const char *string_data;
+
+  /* The whole file, and whether it is mapped (see map_file_f ()) rather
+   * than read into memory */
+  char *data;
+  size_t size;
+  int mapped;
+};
+
+/* Write 'flat' to 'f' as a binary AST. 'source' is the path of the source
+ * file. The flat AST's tokens are read for string literals, so the lexer
+ * must still be open. Returns nonzero with errno set if writing fails; exits
+ * on other errors */
+int binast_write (struct flat_ast *flat, const char *source, FILE *f);
+
+/* Write the interface of the package parsed into 'flat' to 'f': a binary AST
+ * of the file node, flagged BINAST_INTERFACE, its records and classes, and
+ * its functions. Only bodies
+ * of at most 'max_inline' nodes, worth inlining, are kept; the functions
+ * whose bodies were left out are flagged BINAST_NO_BODY. Returns as
+ * binast_write () does */
+int binast_write_interface (struct flat_ast *flat, const char *source,
+                            uint32_t max_inline, FILE *f);
+
+/* Open a binary AST file, mapping it into memory if possible, and check that
+ * it is well formed: every index in range, and every string terminated.
+ * Exit on error */
+void binast_open (const char *path, struct binast *bin);
+
+/* Use the binary AST in 'data', 'size' bytes aligned to 8, in place, after
+ * checking it as binast_open () does. Returns NULL, or what is wrong with it.
+ * 'data' stays the caller's, and must outlive 'bin'; don't binast_close ()
+ * it */
+const char *binast_view (struct binast *bin, const char *data, size_t size);
+
+/* Close a binary AST file */
+void binast_close (struct binast *bin);
+
+/* String number 'i' of a binary AST, or NULL for BINAST_NONE */
+#define binast_string(bin, i)                                           \
+  ((i) == BINAST_NONE ? NULL : (bin)->string_data + (bin)->strings[i])
+
+#endif /* _PARSE_BINAST_H */
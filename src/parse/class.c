@@ -0,0 +1,122 @@
+/* Copyright (c) 2011, Christopher Pavlina. All rights reserved. */
+
+#include "parse.h"
+#include "../error.h"
+#include "../types/type.h"
+
+/* If the next token is an attribute - a word starting with @ - read it, and
+ * return nonzero. Any attribute but 'name' is an error here. */
+static int
+read_attribute (struct lex *lex, const char *name)
+{
+  struct token *token = lexer_peek (lex);
+
+  if (!token_is_t (token, T_WORD) || token->value[0] != '@')
+    return 0;
+  lexer_next (lex);
+  if (!token_is (token, T_WORD, name))
+    cerror_at (lex, token, "unknown attribute %.*s here", (int) token->len,
+               token->value);
+  return 1;
+}
+
+/* Read one field: '[@hot] type name;' */
+static struct ast *
+parse_field (struct lex *lex, struct env *env, struct ast_arena *arena)
+{
+  struct ast *ast = new_ast (arena, AST_FIELD);
+
+  ast->token = *lexer_peek (lex);
+  while (read_attribute (lex, "@hot"))
+    ast->o.field.is_hot = 1;
+  ast->o.field.type = parse_type (lex, env);
+  ast->o.field.name = parse_name (lex, "field name");
+  parse_expect (lex, TOK_SEMI, ";");
+  return ast;
+}
+
+struct ast *
+parse_class (struct lex *lex, struct env *env, struct ast_arena *arena)
+{
+  /* [@reorder] record name { [@hot] type name; ... }
+   * [@reorder] class name { [@hot] type name; ... }
+   */
+
+  struct ast *ast, *child;
+  struct token *token;
+  jmp_buf recover, *outer;
+  volatile size_t kept;
+  size_t mark;
+
+  ast = new_ast (arena, AST_CLASS);
+  ast->token = *lexer_peek (lex);
+
+  while (read_attribute (lex, "@reorder"))
+    ast->o.class.is_reorder = 1;
+  token = lexer_next (lex);
+  if (!token)
+    cerror_eof (lex, "expected record or class");
+  else if (token_is_id (token, TOK_RECORD))
+    ast->o.class.is_record = 1;
+  else if (!token_is_id (token, TOK_CLASS))
+    cerror_at (lex, token, "expected record or class");
+  ast->o.class.name = parse_name (lex, ast->o.class.is_record
+                                  ? "record name" : "class name");
+  parse_expect (lex, TOK_LBRACE, "{");
+
+  mark = kept = ast_begin (arena);
+
+  /* After an error, drop the field it was in, and go on from the next one
+   * (see cerror_at ()) */
+  outer = lex->recover;
+  lex->recover = &recover;
+  if (setjmp (recover)) {
+    arena->stack_len = kept;
+    parse_sync (lex, 1);
+  }
+
+  while (!token_is_id (lexer_peek (lex), TOK_RBRACE)) {
+    if (!lexer_peek (lex))
+      cerror_eof (lex, "expected }");
+    child = parse_field (lex, env, arena);
+    ast_add (arena, child);
+    kept = arena->stack_len;
+  }
+  lex->recover = outer;
+  lexer_next (lex);
+  ast_finish (arena, ast, mark);
+
+  return ast;
+}
+
+enum ast_visit_result
+print_class (struct ast *ast, size_t depth, void *data)
+{
+  /* (record "name" @reorder
+   *   (field...))
+   */
+
+  FILE *dest = data;
+
+  print_start (ast, depth, dest);
+  fprintf (dest, "(%s \"%s\"", ast->o.class.is_record ? "record" : "class",
+           ast->o.class.name);
+  if (ast->o.class.is_reorder) fputs (" @reorder", dest);
+  if (ast->n_children) fputc ('\n', dest);
+  return AST_CONTINUE;
+}
+
+enum ast_visit_result
+print_field (struct ast *ast, size_t depth, void *data)
+{
+  /* (field type "name" @hot) */
+
+  FILE *dest = data;
+
+  print_start (ast, depth, dest);
+  fputs ("(field ", dest);
+  print_type (ast->o.field.type, dest);
+  fprintf (dest, " \"%s\"", ast->o.field.name);
+  if (ast->o.field.is_hot) fputs (" @hot", dest);
+  return AST_CONTINUE;
+}
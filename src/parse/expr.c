@@ -0,0 +1,266 @@
+/* Copyright (c) 2011, Christopher Pavlina. All rights reserved. */
+
+#include "parse.h"
+#include "oper_tables.h"
+#include "../error.h"
+#include "../intern.h"
+#include "../types/type.h"
+#include <inttypes.h>
+
+/* The expression parser. It is a Pratt parser: one loop reads an operand,
+ * then as many operators as bind to it more tightly than 'min_bp', each with
+ * its right operand, building the tree as it goes. Every operator's binding
+ * power comes from the generated tables in oper_tables.h, indexed by token
+ * ID, so adding an operator or moving one to another precedence level is a
+ * change to autogen/operators.spec alone. Each token is read once, and never
+ * put back, so the time taken is linear in the length of the expression. */
+
+static struct ast *
+new_expr (struct ast_arena *arena, struct token *token, enum expr_kind kind)
+{
+  struct ast *ast = new_ast (arena, AST_EXPR);
+
+  ast->token = *token;
+  ast->o.expr.kind = kind;
+  ast->o.expr.op = token->id;
+  return ast;
+}
+
+/* Give 'parent' the children 'a' and, unless it is NULL, 'b' */
+static void
+set_operands (struct ast_arena *arena, struct ast *parent, struct ast *a,
+              struct ast *b)
+{
+  size_t mark = ast_begin (arena);
+
+  ast_add (arena, a);
+  if (b) ast_add (arena, b);
+  ast_finish (arena, parent, mark);
+}
+
+/* Read an operand: a name, a literal, a parenthesised expression, or a
+ * prefix operator and its operand */
+static struct ast *
+parse_operand (struct lex *lex, struct env *env, struct ast_arena *arena)
+{
+  struct token *token = lexer_next (lex);
+  struct ast *ast;
+
+  if (!token)
+    cerror_eof (lex, "expected expression");
+
+  switch (token->type) {
+  case T_INT:
+  case T_REAL:
+  case T_STRING:
+    return new_expr (arena, token, EXPR_LITERAL);
+
+  case T_WORD:
+    if (token->id == TOK_TRUE || token->id == TOK_FALSE ||
+        token->id == TOK_NULL)
+      return new_expr (arena, token, EXPR_LITERAL);
+    if (token_is_keyword (token, 1))
+      break;
+    /* Fall through */
+  case T_EXTRA:
+    ast = new_expr (arena, token, EXPR_NAME);
+    ast->o.expr.name = intern (token->value, token->len);
+    return ast;
+
+  case T_OPER:
+    if (token->id == TOK_LPAREN) {
+      ast = parse_expr (lex, env, arena, 0);
+      parse_expect (lex, TOK_RPAREN, ")");
+      return ast;
+    } else if (oper_prefix_bp[token->id]) {
+      ast = new_expr (arena, token, EXPR_PREFIX);
+      set_operands (arena, ast, parse_expr (lex, env, arena,
+                                            oper_prefix_bp[token->id]),
+                    NULL);
+      return ast;
+    }
+    break;
+  }
+
+  cerror_at (lex, token, "expected expression");
+  return NULL;
+}
+
+/* Read the arguments of a call, after the opening paren, as children of
+ * 'ast' after the function */
+static void
+parse_call (struct lex *lex, struct env *env, struct ast_arena *arena,
+            struct ast *ast, struct ast *function)
+{
+  struct token *token;
+  size_t mark = ast_begin (arena);
+
+  ast_add (arena, function);
+  if (token_is_id (lexer_peek (lex), TOK_RPAREN)) {
+    lexer_next (lex);
+  } else {
+    while (1) {
+      ast_add (arena, parse_expr (lex, env, arena, 0));
+      token = lexer_next (lex);
+      if (!token)
+        cerror_eof (lex, "expected , or )");
+      else if (token_is_id (token, TOK_RPAREN))
+        break;
+      else if (!token_is_id (token, TOK_COMMA))
+        cerror_after (lex, lexer_last (lex), "expected , or )");
+    }
+  }
+  ast_finish (arena, ast, mark);
+}
+
+/* Apply the postfix operator 'token' (just read) to 'left' */
+static struct ast *
+parse_postfix (struct lex *lex, struct env *env, struct ast_arena *arena,
+               struct token *token, struct ast *left)
+{
+  struct ast *ast;
+
+  switch (token->id) {
+  case TOK_LPAREN:
+    ast = new_expr (arena, token, EXPR_CALL);
+    parse_call (lex, env, arena, ast, left);
+    break;
+
+  case TOK_LBRACKET:
+    ast = new_expr (arena, token, EXPR_INDEX);
+    set_operands (arena, ast, left, parse_expr (lex, env, arena, 0));
+    parse_expect (lex, TOK_RBRACKET, "]");
+    break;
+
+  case TOK_DOT:
+    ast = new_expr (arena, token, EXPR_MEMBER);
+    ast->o.expr.name = parse_name (lex, "member name");
+    set_operands (arena, ast, left, NULL);
+    break;
+
+  default:
+    ast = new_expr (arena, token, EXPR_POSTFIX);
+    set_operands (arena, ast, left, NULL);
+    break;
+  }
+  return ast;
+}
+
+/* Apply the infix operator 'token' (just read) to 'left' and what follows */
+static struct ast *
+parse_infix (struct lex *lex, struct env *env, struct ast_arena *arena,
+             struct token *token, struct ast *left)
+{
+  struct ast *ast, *then;
+  size_t mark;
+  int rbp = oper_infix_rbp[token->id];
+
+  switch (token->id) {
+  case TOK_QUESTION:
+    /* Anything goes between ? and :, as between parens */
+    ast = new_expr (arena, token, EXPR_CONDITIONAL);
+    then = parse_expr (lex, env, arena, 0);
+    parse_expect (lex, TOK_COLON, ":");
+    mark = ast_begin (arena);
+    ast_add (arena, left);
+    ast_add (arena, then);
+    ast_add (arena, parse_expr (lex, env, arena, rbp));
+    ast_finish (arena, ast, mark);
+    break;
+
+  case TOK_AS:
+    ast = new_expr (arena, token, EXPR_CAST);
+    ast->o.expr.type = parse_type (lex, env);
+    set_operands (arena, ast, left, NULL);
+    break;
+
+  default:
+    ast = new_expr (arena, token, EXPR_BINARY);
+    set_operands (arena, ast, left, parse_expr (lex, env, arena, rbp));
+    break;
+  }
+  return ast;
+}
+
+struct ast *
+parse_expr (struct lex *lex, struct env *env, struct ast_arena *arena,
+            int min_bp)
+{
+  struct ast *left;
+  struct token *token, op;
+  int id;
+
+  left = parse_operand (lex, env, arena);
+
+  while ((token = lexer_peek (lex))) {
+    /* Words other than keywords have no ID, and so no binding power */
+    id = token->id;
+    if (oper_postfix_bp[id]) {
+      if (oper_postfix_bp[id] < min_bp) break;
+      op = *lexer_next (lex);
+      left = parse_postfix (lex, env, arena, &op, left);
+    } else if (oper_infix_lbp[id]) {
+      if (oper_infix_lbp[id] < min_bp) break;
+      op = *lexer_next (lex);
+      left = parse_infix (lex, env, arena, &op, left);
+    } else {
+      break;
+    }
+  }
+
+  return left;
+}
+
+enum ast_visit_result
+print_expr (struct ast *ast, size_t depth, void *data)
+{
+  /* (binary "+"
+   *   (name "a")
+   *   (int 1))
+   */
+
+  static const char *const kinds[] = {
+    "name", "literal", "prefix", "postfix", "binary", "conditional", "call",
+    "index", "member", "cast"
+  };
+  FILE *dest = data;
+  struct expr *expr = &ast->o.expr;
+  struct token *token = &ast->token;
+
+  print_start (ast, depth, dest);
+  switch (expr->kind) {
+  case EXPR_NAME:
+  case EXPR_MEMBER:
+    fprintf (dest, "(%s \"%s\"", kinds[expr->kind], expr->name);
+    break;
+
+  case EXPR_LITERAL:
+    if (token->type == T_INT)
+      fprintf (dest, "(int %" PRIu64, token->num.i);
+    else if (token->type == T_REAL)
+      fprintf (dest, "(real %.17g", token->num.r);
+    else if (token->type == T_STRING)
+      fprintf (dest, "(string %.*s", (int) token->len, token->value);
+    else
+      fprintf (dest, "(%.*s", (int) token->len, token->value);
+    break;
+
+  case EXPR_PREFIX:
+  case EXPR_POSTFIX:
+  case EXPR_BINARY:
+    fprintf (dest, "(%s \"%.*s\"", kinds[expr->kind], (int) token->len,
+             token->value);
+    break;
+
+  case EXPR_CAST:
+    fputs ("(cast ", dest);
+    print_type (expr->type, dest);
+    break;
+
+  default:
+    fprintf (dest, "(%s", kinds[expr->kind]);
+    break;
+  }
+  if (ast->n_children) fputc ('\n', dest);
+  return AST_CONTINUE;
+}
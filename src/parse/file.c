@@ -2,7 +2,11 @@
 
 #include "parse.h"
 #include "../error.h"
-#include "../keywords.h"
+#include "../intern.h"
+#include "../jobs.h"
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
 
 /* Read the "executable" or "package" declaration. */
 static int
@@ -11,9 +15,9 @@ read_exec_package (struct lex *lex)
   struct token *token = lexer_next (lex);
   if (!token) {
     error_message ("no code in source file %s", lex->file);
-  } else if (token_is (token, T_WORD, "executable")) {
+  } else if (token_is_id (token, TOK_EXECUTABLE)) {
     return 1;
-  } else if (token_is (token, T_WORD, "package")) {
+  } else if (token_is_id (token, TOK_PACKAGE)) {
     return 0;
   } else {
     cerror_at (lex, token, "expected 'package' or 'executable'");
@@ -21,89 +25,367 @@ read_exec_package (struct lex *lex)
   return 0; // Shut up
 }
 
-/* Read the package name and semicolon */
-static char *
+/* Read the package name and semicolon. Returns the name token. */
+static struct token *
 read_name (struct lex *lex)
 {
-  char *name;
+  struct token *name;
   struct token *token = lexer_next (lex);
   if (!token) {
     cerror_eof (lex, "expected name");
   } else if (!token_is_t (token, T_WORD)) {
     cerror_at (lex, token, "expected name");
-  } else if (is_keyword (token->value, 1)) {
+  } else if (token_is_keyword (token, 1)) {
     cerror_at (lex, token, "expected name");
   }
-  name = token->value;
+  name = token;
 
   token = lexer_next (lex);
   if (!token)
     cerror_eof (lex, "expected ;");
-  else if (!token_is (token, T_OPER, ";"))
+  else if (!token_is_id (token, TOK_SEMI))
     cerror_after (lex, lexer_last (lex), "expected ;");
 
   return name;
 }
 
-static struct ast *parse_function (void *a, void *b) { return NULL; }
+/* Read any "import name;" declarations into the arena */
+static void
+read_imports (struct lex *lex, struct ast_arena *arena, struct file *file)
+{
+  const char **imports = NULL, **new_imports;
+  size_t n = 0, mem = 0;
+  struct token *name;
+
+  while (token_is_id (lexer_peek (lex), TOK_IMPORT)) {
+    lexer_next (lex);
+    if (n == mem) {
+      mem = mem ? 2 * mem : 8;
+      new_imports = realloc (imports, mem * sizeof (*imports));
+      if (!new_imports) error_errno ();
+      imports = new_imports;
+    }
+    name = read_name (lex);
+    imports[n++] = intern (name->value, name->len);
+  }
+
+  if (n) {
+    file->imports = arena_alloc (&arena->mem, n * sizeof (*imports));
+    memcpy (file->imports, imports, n * sizeof (*imports));
+    file->n_imports = n;
+  }
+  free (imports);
+}
 
 static struct ast *
-read_child (struct lex *lex, struct env *env)
+read_child (struct lex *lex, struct env *env, struct ast_arena *arena,
+            int lazy)
 {
   struct token *token = lexer_peek (lex);
 
   if (!token) return NULL;
 
-  /* All we support so far are functions and 'extern' declarations, which are
-   * both handled by parse_function. */
+  /* Records and classes, which may start with an attribute */
+  if (token_is_id (token, TOK_RECORD) || token_is_id (token, TOK_CLASS) ||
+      (token_is_t (token, T_WORD) && token->value[0] == '@'))
+    return parse_class (lex, env, arena);
+
+  /* Otherwise functions and 'extern' declarations, which are both handled
+   * by parse_function. */
   else
-    return parse_function (lex, env);
+    return parse_function (lex, env, arena, lazy);
 }
 
-struct ast *
-parse_file (struct lex *lex, struct env *env)
+/* Make an empty arena for a tree */
+static struct ast_arena *
+new_arena (void)
 {
-  struct ast *ast = new_ast (AST_FILE);
-  
+  struct ast_arena *arena = malloc (sizeof (*arena));
+
+  if (!arena) error_errno ();
+  arena_init (&arena->mem);
+  arena->stack = NULL;
+  arena->stack_len = arena->stack_mem = 0;
+  arena->next = NULL;
+  return arena;
+}
+
+/* Parse the file in 'lex', skipping function bodies if 'lazy'. If the lexer
+ * keeps a log, the parse stops at the end of the file or once the log is
+ * full, as the log says, and returns the tree as far as it got, for the
+ * caller to print the log and check lex->n_errors; otherwise, exit on
+ * error. */
+static struct ast *
+read_file (struct lex *lex, struct env *env, int lazy)
+{
+  struct ast_arena *arena;
+  struct ast *ast;
+  jmp_buf recover, stop;
+  volatile size_t kept;
+  size_t mark;
+
+  /* The file node owns the arena the whole tree lives in */
+  arena = new_arena ();
+  ast = new_ast (arena, AST_FILE);
+  ast->o.file.arena = arena;
+
+  mark = kept = ast_begin (arena);
+  if (lex->log) {
+    lex->log->stop = &stop;
+    if (setjmp (stop))
+      goto stopped;
+  }
+
   /* Get the first token */
-  ast->token = lexer_peek (lex);
+  if (lexer_peek (lex))
+    ast->token = *lexer_peek (lex);
 
   /* Read the info line */
   ast->o.file.is_executable = read_exec_package (lex);
-  ast->o.file.name = read_name (lex);
+  struct token *name = read_name (lex);
+  ast->o.file.name = intern (name->value, name->len);
+  read_imports (lex, arena, &ast->o.file);
 
-  /* After this come the children */
+  /* After this come the children. After an error in one, drop it, and go
+   * on from the next (see cerror_at ()). */
+  lex->recover = &recover;
+  if (setjmp (recover)) {
+    arena->stack_len = kept;
+    parse_sync (lex, 0);
+  }
   while (1) {
-    struct ast *child = read_child (lex, env);
+    struct ast *child = read_child (lex, env, arena, lazy);
     if (!child) break;
-    ast_add (ast, child);
+    ast_add (arena, child);
+    kept = arena->stack_len;
   }
 
+stopped:
+  arena->stack_len = kept;
+  lex->recover = NULL;
+  ast_finish (arena, ast, mark);
+  if (lex->log) {
+    lex->log->stop = NULL;
+    return ast;
+  }
+
+  /* Every error has been reported now */
+  if (lex->n_errors) {
+    free_ast (ast);
+    error_fail ();
+  }
   return ast;
 }
 
-/* Nothing to do */
-void
-free_file (struct ast *ast) { (void) ast; }
+struct ast *
+parse_file (struct lex *lex, struct env *env)
+{
+  return read_file (lex, env, 0);
+}
+
+struct ast *
+parse_file_lazy (struct lex *lex, struct env *env)
+{
+  return read_file (lex, env, 1);
+}
+
+/* The file node of the tree 'ast' is in */
+static struct ast *
+file_of (struct ast *ast)
+{
+  while (ast->parent)
+    ast = ast->parent;
+  return ast;
+}
+
+/* Parse the skipped body of 'function', reading with 'lex' into 'arena' */
+static struct ast *
+read_body (struct lex *lex, struct env *env, struct ast_arena *arena,
+           struct ast *function)
+{
+  size_t mark, pos = lexer_tell (lex), errors = lex->n_errors;
+  struct ast *body;
+
+  lexer_seek (lex, function->o.function.body_start);
+  mark = ast_begin (arena);
+  body = parse_scope (lex, env, arena);
+  ast_add (arena, body);
+  ast_finish (arena, function, mark);
+  /* The braces were balanced going by the tokens, so the parser can't have
+   * stopped anywhere else - unless it was recovering from an error */
+  assert (lexer_tell (lex) == function->o.function.body_end ||
+          lex->n_errors != errors);
+  function->o.function.is_lazy = 0;
+  lexer_seek (lex, pos);
+  if (lex->n_errors != errors)
+    error_fail ();
+  return body;
+}
+
+struct ast *
+parse_function_body (struct lex *lex, struct env *env, struct ast *function)
+{
+  if (!function->o.function.is_lazy)
+    return function->n_children ? function->children[0] : NULL;
+  return read_body (lex, env, file_of (function)->o.file.arena, function);
+}
+
+/* What parse_function_bodies ()'s threads share */
+struct bodies {
+  struct env *env;
+  struct ast **functions;
+  /* Each body's diagnostics */
+  struct diag_log *logs;
+  /* Each thread's reader and arena */
+  struct lex *cursors;
+  struct ast_arena **arenas;
+};
+
+static void
+read_one_body (size_t i, unsigned worker, void *ctx)
+{
+  struct bodies *b = ctx;
+  struct lex *cursor = &b->cursors[worker];
+
+  if (!b->arenas[worker])
+    b->arenas[worker] = new_arena ();
+  /* The body's errors are all its own, to be printed in order afterwards */
+  cursor->log = &b->logs[i];
+  cursor->n_errors = 0;
+  cursor->recover = NULL;
+  read_body (cursor, b->env, b->arenas[worker], b->functions[i]);
+}
+
+size_t
+parse_function_bodies (struct lex *lex, struct env *env, struct ast *file,
+                       int n_threads)
+{
+  struct ast_arena *arena = file->o.file.arena;
+  size_t limit = env->error_limit;
+  struct bodies b;
+  size_t *starts;
+  size_t i, n = 0, errors;
+
+  if (n_threads < 1) n_threads = 1;
+  b.env = env;
+  b.functions = malloc (file->n_children * sizeof (*b.functions));
+  starts = malloc (file->n_children * sizeof (*starts));
+  b.logs = malloc (file->n_children * sizeof (*b.logs));
+  b.cursors = malloc (n_threads * sizeof (*b.cursors));
+  b.arenas = calloc (n_threads, sizeof (*b.arenas));
+  if ((file->n_children && (!b.functions || !starts || !b.logs)) ||
+      !b.cursors || !b.arenas)
+    error_errno ();
+
+  /* No error in a body after the file's limit would be printed, so those
+   * bodies are left */
+  for (i = 0; i < file->n_children; ++i) {
+    struct ast *child = file->children[i];
+    if (child->tag != AST_FUNCTION || !child->o.function.is_lazy)
+      continue;
+    if (limit &&
+        error_log_errors_before (lex, child->o.function.body_start) >= limit)
+      break;
+    starts[n] = child->o.function.body_start;
+    error_log_init (&b.logs[n]);
+    b.functions[n++] = child;
+  }
+  for (i = 0; i < (size_t) n_threads; ++i)
+    lexer_fork (lex, &b.cursors[i]);
+
+  run_tasks (n, n_threads, read_one_body, &b);
+  errors = error_print_logs (lex, b.logs, starts, n);
+
+  /* The file's arena owns the threads' */
+  for (i = 0; i < (size_t) n_threads; ++i) {
+    if (b.arenas[i]) {
+      b.arenas[i]->next = arena->next;
+      arena->next = b.arenas[i];
+    }
+  }
+  for (i = 0; i < n; ++i)
+    error_log_free (&b.logs[i]);
+  free (b.functions);
+  free (starts);
+  free (b.logs);
+  free (b.cursors);
+  free (b.arenas);
+  return errors;
+}
+
+struct ast *
+parse_file_parallel (struct lex *lex, struct env *env, int n_threads)
+{
+  struct diag_log log;
+  struct ast *ast;
+  size_t errors;
+
+  /* Keep every diagnostic, the lexer's included, to print in order with the
+   * bodies' */
+  error_log_init (&log);
+  lex->log = &log;
+  lexer_lex (lex);
+
+  /* With no tokens, read_file () gives up at once, after what the lexer found
+   * is printed */
+  if (!lex->n_tokens) {
+    errors = error_print_logs (lex, NULL, NULL, 0);
+    lex->log = NULL;
+    error_log_free (&log);
+    if (errors && env->error_limit && errors >= env->error_limit)
+      error_fail ();
+    return read_file (lex, env, 1);
+  }
+
+  /* The reader stops once its own errors make the limit, as nothing after
+   * them could be printed; the lexer's may come after them */
+  lex->n_errors = 0;
+  ast = read_file (lex, env, 1);
+  errors = parse_function_bodies (lex, env, ast, n_threads);
+  lex->log = NULL;
+  error_log_free (&log);
+  if (errors) {
+    free_ast (ast);
+    return NULL;
+  }
+  return ast;
+}
 
 void
-print_file (struct ast *ast, FILE *dest, int indent)
+free_file (struct ast *ast)
+{
+  /* The node itself is in the arena, so take the arena out first */
+  struct ast_arena *arena = ast->o.file.arena, *next;
+
+  for (; arena; arena = next) {
+    next = arena->next;
+    free (arena->stack);
+    arena_free (&arena->mem);
+    free (arena);
+  }
+}
+
+enum ast_visit_result
+print_file (struct ast *ast, size_t depth, void *data)
 {
-  /* (executable "name"
+  /* (executable "name" (import "a" "b")
    *   (child...)
    *   (child...))
    */
 
-  int ind;
+  FILE *dest = data;
   size_t i;
 
-  for (ind = 0; ind < indent; ++ind) fputc (' ', dest);
-  fprintf (dest, "(%s \"%s\"\n",
+  print_start (ast, depth, dest);
+  fprintf (dest, "(%s \"%s\"",
            ast->o.file.is_executable ? "executable" : "package",
            ast->o.file.name);
-  for (i = 0; i < ast->n_children; ++i) {
-    _print_ast (ast->children[i], dest, indent + 2);
-    if (i != ast->n_children - 1) fputc ('\n', dest);
+  if (ast->o.file.n_imports) {
+    fputs (" (import", dest);
+    for (i = 0; i < ast->o.file.n_imports; ++i)
+      fprintf (dest, " \"%s\"", ast->o.file.imports[i]);
+    fputc (')', dest);
   }
-  fputc (')', dest);
+  fputc ('\n', dest);
+  return AST_CONTINUE;
 }
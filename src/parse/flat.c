@@ -0,0 +1,166 @@
+/* Copyright (c) 2011, Christopher Pavlina. All rights reserved. */
+
+#include "flat.h"
+#include "../error.h"
+#include <stdlib.h>
+#include <string.h>
+
+static const size_t PAYLOAD_SIZE[AST_N_TAGS] = {
+  sizeof (struct file),
+  sizeof (struct class),
+  sizeof (struct field),
+  sizeof (struct function),
+  sizeof (struct st_break),
+  sizeof (struct st_continue),
+  sizeof (struct st_vardecl),
+  sizeof (struct st_new),
+  sizeof (struct st_delete),
+  sizeof (struct st_do_while),
+  sizeof (struct st_while),
+  sizeof (struct st_for),
+  sizeof (struct st_if),
+  sizeof (struct st_return),
+  sizeof (struct expr),
+  sizeof (struct scope) };
+
+/* Work stack for the pre-order walk. Nodes are visited iteratively, so deep
+ * trees can't overflow the C stack. */
+struct walk {
+  struct ast *ast;
+  uint32_t parent;
+};
+
+static void
+push (struct walk **stack, size_t *len, size_t *mem, struct ast *ast,
+      uint32_t parent)
+{
+  if (*len == *mem) {
+    *mem = *mem ? 2 * *mem : 64;
+    *stack = realloc (*stack, *mem * sizeof (**stack));
+    if (!*stack) error_errno ();
+  }
+  (*stack)[*len].ast = ast;
+  (*stack)[*len].parent = parent;
+  ++*len;
+}
+
+/* Push the children of 'ast' last first, so that they come off in order */
+static void
+push_children (struct walk **stack, size_t *len, size_t *mem, struct ast *ast,
+               uint32_t index)
+{
+  size_t i;
+
+  for (i = ast->n_children; i > 0; --i)
+    push (stack, len, mem, ast->children[i - 1], index);
+}
+
+struct flat_ast *
+flat_build (struct ast *ast)
+{
+  struct flat_ast *flat;
+  struct walk *stack = NULL, top;
+  size_t len = 0, mem = 0, n_nodes = 0;
+  uint32_t i, tag, *last_child;
+
+  flat = malloc (sizeof (*flat));
+  if (!flat) error_errno ();
+  memset (flat, 0, sizeof (*flat));
+
+  /* First count the nodes, and each tag's payloads */
+  push (&stack, &len, &mem, ast, FLAT_NONE);
+  while (len) {
+    top = stack[--len];
+    ++n_nodes;
+    if (PAYLOAD_SIZE[top.ast->tag])
+      ++flat->n_payloads[top.ast->tag];
+    push_children (&stack, &len, &mem, top.ast, 0);
+  }
+  if (n_nodes >= FLAT_NONE)
+    error_message ("AST too large");
+
+  flat->n_nodes = n_nodes;
+  flat->nodes = malloc (n_nodes * sizeof (*flat->nodes));
+  flat->tokens = malloc (n_nodes * sizeof (*flat->tokens));
+  last_child = malloc (n_nodes * sizeof (*last_child));
+  if (!flat->nodes || !flat->tokens || !last_child) error_errno ();
+  for (tag = 0; tag < AST_N_TAGS; ++tag) {
+    if (!flat->n_payloads[tag]) continue;
+    flat->payloads[tag] = malloc (flat->n_payloads[tag] * PAYLOAD_SIZE[tag]);
+    if (!flat->payloads[tag]) error_errno ();
+    flat->n_payloads[tag] = 0;
+  }
+
+  /* Then lay them out in pre-order, linking each to its parent and to its
+   * previous sibling */
+  push (&stack, &len, &mem, ast, FLAT_NONE);
+  for (i = 0; len; ++i) {
+    top = stack[--len];
+    tag = top.ast->tag;
+
+    flat->nodes[i].tag = tag;
+    flat->nodes[i].parent = top.parent;
+    flat->nodes[i].first_child = FLAT_NONE;
+    flat->nodes[i].next_sibling = FLAT_NONE;
+    flat->nodes[i].payload = FLAT_NONE;
+    flat->tokens[i] = top.ast->token;
+    if (PAYLOAD_SIZE[tag]) {
+      flat->nodes[i].payload = flat->n_payloads[tag]++;
+      memcpy ((char *) flat->payloads[tag] +
+              flat->nodes[i].payload * PAYLOAD_SIZE[tag],
+              &top.ast->o, PAYLOAD_SIZE[tag]);
+    }
+
+    if (top.parent != FLAT_NONE) {
+      if (flat->nodes[top.parent].first_child == FLAT_NONE)
+        flat->nodes[top.parent].first_child = i;
+      else
+        flat->nodes[last_child[top.parent]].next_sibling = i;
+      last_child[top.parent] = i;
+    }
+    push_children (&stack, &len, &mem, top.ast, i);
+  }
+
+  if (flat->n_payloads[AST_FILE])
+    ((struct file *) flat->payloads[AST_FILE])[0].arena = NULL;
+
+  free (last_child);
+  free (stack);
+  return flat;
+}
+
+struct flat_ast *
+parse_file_flat (struct lex *lex, struct env *env)
+{
+  struct ast *ast = parse_file (lex, env);
+  struct flat_ast *flat = flat_build (ast);
+
+  flat->tree = ast;
+  return flat;
+}
+
+void
+flat_free (struct flat_ast *flat)
+{
+  uint32_t tag;
+
+  for (tag = 0; tag < AST_N_TAGS; ++tag)
+    free (flat->payloads[tag]);
+  if (flat->tree)
+    free_ast (flat->tree);
+  free (flat->nodes);
+  free (flat->tokens);
+  free (flat);
+}
+
+uint32_t
+flat_subtree_end (struct flat_ast *flat, uint32_t i)
+{
+  /* The subtree ends where the next sibling of the nearest node on the way
+   * up which has one starts */
+  for (; i != FLAT_NONE; i = flat->nodes[i].parent) {
+    if (flat->nodes[i].next_sibling != FLAT_NONE)
+      return flat->nodes[i].next_sibling;
+  }
+  return flat->n_nodes;
+}
@@ -0,0 +1,80 @@
+/* Copyright (c) 2011, Christopher Pavlina. All rights reserved. */
+
+#ifndef _PARSE_FLAT_H
+#define _PARSE_FLAT_H 1
+
+#include "parse.h"
+#include <stdint.h>
+
+/* Flattened AST. The nodes of a file are in one array, in pre-order - a node,
+ * then its first child's subtree, then its next child's, and so on - and
+ * refer to each other by 32-bit index rather than by pointer. The parts
+ * which passes rarely look at are kept out of the node array: each node's
+ * first token is in 'tokens', under the node's index, and its tag's payload
+ * (the struct in union ast_union) is in a side table for that tag. A pass
+ * over the whole file is then a walk up one array.
+ *
+ * A flat AST is built from the pointer tree which parse_file () produces.
+ * The tokens point into the lexer's text, so they are only valid while the
+ * lexer is. The payloads share the tree's parameter lists and types, so they
+ * are only valid while the tree is. */
+
+/* "No node" */
+#define FLAT_NONE UINT32_MAX
+
+struct flat_node {
+  uint32_t parent;
+  uint32_t first_child;
+  uint32_t next_sibling;
+  /* Index into the side table payloads[tag] */
+  uint32_t payload;
+  unsigned char tag;             /* enum ast_tag */
+};
+
+struct flat_ast {
+  struct flat_node *nodes;
+  struct token *tokens;
+  uint32_t n_nodes;
+
+  /* Side tables, one per tag: payloads[tag] is an array of the tag's struct
+   * (struct file for AST_FILE, and so on). Tags whose struct is empty have
+   * no table. */
+  void *payloads[AST_N_TAGS];
+  uint32_t n_payloads[AST_N_TAGS];
+
+  /* The pointer tree, if it belongs to this flat AST and is freed with it */
+  struct ast *tree;
+};
+
+/* Flatten the pointer tree under 'ast'. Node 0 of the result is 'ast'. The
+ * file node's payload has no arena - the pointer tree keeps its own. Exit on
+ * error. */
+struct flat_ast *flat_build (struct ast *ast);
+
+/* Parse a file (see parse_file ()) straight into a flat AST, which keeps the
+ * pointer tree. Exit on error */
+struct flat_ast *parse_file_flat (struct lex *lex, struct env *env);
+
+/* Free a flat AST */
+void flat_free (struct flat_ast *flat);
+
+/* Navigation. Each of these gives FLAT_NONE if there is no such node. */
+#define flat_parent(f, i)       ((f)->nodes[i].parent)
+#define flat_first_child(f, i)  ((f)->nodes[i].first_child)
+#define flat_next_sibling(f, i) ((f)->nodes[i].next_sibling)
+
+/* Loop 'child' over the children of node 'i' */
+#define FLAT_FOR_CHILDREN(f, i, child)                          \
+  for ((child) = flat_first_child (f, i); (child) != FLAT_NONE;   \
+       (child) = flat_next_sibling (f, child))
+
+/* The index just past the subtree of node 'i', for skipping it: the nodes
+ * from i to flat_subtree_end () - 1 are i and its descendants */
+uint32_t flat_subtree_end (struct flat_ast *flat, uint32_t i);
+
+/* Node i's payload, as a pointer to 'type' - for example,
+ * FLAT_PAYLOAD (f, 0, file)->name */
+#define FLAT_PAYLOAD(f, i, type)                                        \
+  (&((struct type *) (f)->payloads[(f)->nodes[i].tag])[(f)->nodes[i].payload])
+
+#endif /* _PARSE_FLAT_H */
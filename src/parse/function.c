@@ -0,0 +1,139 @@
+/* Copyright (c) 2011, Christopher Pavlina. All rights reserved. */
+
+#include "parse.h"
+#include "../error.h"
+#include "../types/type.h"
+#include <stdlib.h>
+#include <string.h>
+
+/* Read the parameter list, from just after the opening paren to the closing
+ * one. The parameters go into the arena - grown there too, so that nothing
+ * leaks if an error unwinds out of here (see parse_scope ()). */
+static void
+read_params (struct lex *lex, struct env *env, struct ast_arena *arena,
+             struct function *function)
+{
+  struct param *params = NULL, *new_params;
+  size_t n = 0, mem = 0;
+  struct token *token;
+
+  if (token_is_id (lexer_peek (lex), TOK_RPAREN)) {
+    lexer_next (lex);
+    return;
+  }
+
+  while (1) {
+    if (token_is_id (lexer_peek (lex), TOK_ELLIPSIS)) {
+      lexer_next (lex);
+      function->is_variadic = 1;
+      parse_expect (lex, TOK_RPAREN, ")");
+      break;
+    }
+
+    if (n == mem) {
+      mem = mem ? 2 * mem : 8;
+      new_params = arena_alloc (&arena->mem, mem * sizeof (*params));
+      if (n)
+        memcpy (new_params, params, n * sizeof (*params));
+      params = new_params;
+    }
+    params[n].type = parse_type (lex, env);
+    params[n].name = parse_name (lex, "parameter name");
+    ++n;
+
+    token = lexer_next (lex);
+    if (!token)
+      cerror_eof (lex, "expected , or )");
+    else if (token_is_id (token, TOK_RPAREN))
+      break;
+    else if (!token_is_id (token, TOK_COMMA))
+      cerror_after (lex, lexer_last (lex), "expected , or )");
+  }
+
+  function->params = params;
+  function->n_params = n;
+}
+
+struct ast *
+parse_function (struct lex *lex, struct env *env, struct ast_arena *arena,
+                int lazy)
+{
+  /* [extern] type name ([type name, ...] [...]) { body }
+   * [extern] type name ([type name, ...] [...]);
+   */
+
+  struct ast *ast, *body;
+  struct token *token;
+  size_t mark;
+
+  ast = new_ast (arena, AST_FUNCTION);
+  ast->token = *lexer_peek (lex);
+
+  if (token_is_id (lexer_peek (lex), TOK_EXTERN)) {
+    lexer_next (lex);
+    ast->o.function.is_extern = 1;
+  }
+  ast->o.function.ret = parse_type (lex, env);
+  ast->o.function.name = parse_name (lex, "function name");
+  parse_expect (lex, TOK_LPAREN, "(");
+  read_params (lex, env, arena, &ast->o.function);
+
+  token = lexer_peek (lex);
+  if (!token) {
+    cerror_eof (lex, "expected { or ;");
+  } else if (token_is_id (token, TOK_SEMI)) {
+    lexer_next (lex);
+  } else if (token_is_id (token, TOK_LBRACE) && lazy) {
+    ast->o.function.is_lazy = 1;
+    ast->o.function.body_start = lexer_tell (lex);
+    ast->o.function.body_end = lexer_skip_block (lex);
+    /* Keeping a log, leave the end of the file for the body's own reader to
+     * find, as parse_file () would have, after whatever else is wrong in it
+     * (see parse_file_parallel ()) */
+    if (!ast->o.function.body_end && lex->log) {
+      ast->o.function.body_end = lex->n_tokens;
+      lexer_seek (lex, lex->n_tokens);
+    } else if (!ast->o.function.body_end) {
+      cerror_eof (lex, "expected }");
+    }
+  } else if (token_is_id (token, TOK_LBRACE)) {
+    mark = ast_begin (arena);
+    body = parse_scope (lex, env, arena);
+    ast_add (arena, body);
+    ast_finish (arena, ast, mark);
+  } else {
+    cerror_after (lex, lexer_last (lex), "expected { or ;");
+  }
+
+  return ast;
+}
+
+enum ast_visit_result
+print_function (struct ast *ast, size_t depth, void *data)
+{
+  /* (function "name" type ((type "name") ... ...)
+   *   (scope...))
+   */
+
+  FILE *dest = data;
+  struct function *function = &ast->o.function;
+  size_t i;
+
+  print_start (ast, depth, dest);
+  fprintf (dest, "(%s \"%s\" ", function->is_extern ? "extern" : "function",
+           function->name);
+  print_type (function->ret, dest);
+  fputs (" (", dest);
+  for (i = 0; i < function->n_params; ++i) {
+    if (i) fputc (' ', dest);
+    fputc ('(', dest);
+    print_type (function->params[i].type, dest);
+    fprintf (dest, " \"%s\")", function->params[i].name);
+  }
+  if (function->is_variadic)
+    fputs (function->n_params ? " ..." : "...", dest);
+  fputc (')', dest);
+  if (function->is_lazy) fputs (" {...}", dest);
+  if (ast->n_children) fputc ('\n', dest);
+  return AST_CONTINUE;
+}
@@ -5,38 +5,142 @@
 
 #include "../lex/lex.h"
 #include "../env.h"
+#include "../arena.h"
 #include <stdio.h>
 
 /* AST item types */
 enum ast_tag {
-  AST_FILE, AST_CLASS, AST_FUNCTION, AST_ST_BREAK, AST_ST_CONTINUE,
+  AST_FILE, AST_CLASS, AST_FIELD, AST_FUNCTION, AST_ST_BREAK,
+  AST_ST_CONTINUE,
   AST_ST_VARDECL, AST_ST_NEW, AST_ST_DELETE, AST_ST_DO_WHILE, AST_ST_WHILE,
-  AST_ST_FOR, AST_ST_IF, AST_ST_RETURN, AST_EXPR, AST_SCOPE
+  AST_ST_FOR, AST_ST_IF, AST_ST_RETURN, AST_EXPR, AST_SCOPE,
+  AST_N_TAGS                   /* number of tags, not a tag */
 };
 
+struct ast_arena;
+
 struct file {
+  /* Package name - interned (see intern.h) */
   char const *name;
   int is_executable;
+  /* Names of the imported packages, interned, in the arena */
+  char const **imports;
+  size_t n_imports;
+  /* Memory for the whole tree, this node included */
+  struct ast_arena *arena;
+};
+
+struct type;
+
+/* A record or class: '[@reorder] record name { fields }', or the same with
+ * 'class'. Children: the fields, in the order declared. */
+struct class {
+  /* Interned */
+  const char *name;
+  /* 'record' rather than 'class'; marked @reorder, to have its fields laid
+   * out in the order that wastes least space (see types/layout.h) */
+  unsigned char is_record, is_reorder;
+};
+
+/* A field of a record or class: '[@hot] type name;' */
+struct field {
+  /* Interned */
+  const char *name;
+  struct type *type;
+  /* Marked @hot: used often, so to be kept together at the front when the
+   * fields are reordered */
+  unsigned char is_hot;
+};
+
+/* A function parameter */
+struct param {
+  struct type *type;
+  /* Interned */
+  const char *name;
+};
+
+/* A function. Its one child, if it has a body, is the body's AST_SCOPE. */
+struct function {
+  /* Interned */
+  const char *name;
+  struct type *ret;
+  /* In the arena */
+  struct param *params;
+  size_t n_params;
+  /* If the body was skipped by parse_file_lazy (), and not parsed yet: its
+   * tokens, from the { up to just after the } (see lexer_tell ()) */
+  size_t body_start, body_end;
+  /* Declared 'extern'; takes more arguments after 'params' (...); body not
+   * parsed yet */
+  unsigned char is_extern, is_variadic, is_lazy;
 };
 
-struct class {};
-struct function {};
 struct st_break {};
 struct st_continue {};
-struct st_vardecl {};
+
+/* A variable declaration: 'let name := init;' or 'type name [= init];'. The
+ * child, if any, is the initialiser. */
+struct st_vardecl {
+  /* Interned */
+  const char *name;
+  /* NULL for 'let', which takes the type of the initialiser */
+  struct type *type;
+};
+
 struct st_new {};
 struct st_delete {};
+
+/* Children: body, condition */
 struct st_do_while {};
+
+/* Children: condition, body */
 struct st_while {};
-struct st_for {};
+
+/* Children: those of the initialiser, condition and step which are present,
+ * in that order, then the body. The initialiser is an AST_ST_VARDECL or
+ * AST_EXPR. */
+struct st_for {
+  unsigned char has_init, has_cond, has_step;
+};
+
+/* Children: condition, then-branch, and else-branch if any */
 struct st_if {};
+
+/* Child: the value, if any */
 struct st_return {};
-struct expr {};
+
+enum expr_kind {
+  EXPR_NAME,          /* a variable or function */
+  EXPR_LITERAL,       /* a number, string, true, false or null: the token */
+  EXPR_PREFIX,        /* op operand */
+  EXPR_POSTFIX,       /* operand op */
+  EXPR_BINARY,        /* left op right; assignments included */
+  EXPR_CONDITIONAL,   /* cond ? then : else */
+  EXPR_CALL,          /* function (arguments...) */
+  EXPR_INDEX,         /* array [index] */
+  EXPR_MEMBER,        /* object . name */
+  EXPR_CAST           /* operand as type */
+};
+
+/* An expression. The children are the operands, in source order. The node's
+ * token is the operator's, rather than the first of the expression, so that
+ * errors can point at it. */
+struct expr {
+  unsigned char kind;      /* enum expr_kind */
+  unsigned char op;        /* the operator's TOK_* ID */
+  /* EXPR_NAME, EXPR_MEMBER: the name, interned */
+  const char *name;
+  /* EXPR_CAST */
+  struct type *type;
+};
+
+/* A block. Children: the statements */
 struct scope {};
 
 union ast_union {
   struct file file;
   struct class class;
+  struct field field;
   struct function function;
   struct st_break st_break;
   struct st_continue st_continue;
@@ -56,65 +160,170 @@ union ast_union {
 struct ast {
   enum ast_tag tag;
   union ast_union o;
-  struct token *token;
+  struct token token;        /* copy of the node's first token */
   struct ast **children, *parent;
   size_t n_children;
-  size_t children_mem;
 };
 
-/* Create a 'struct ast' with its 'children' list initialised. Exit on error */
-struct ast *new_ast (enum ast_tag type);
+/* Memory for one file's AST. Nodes and their child lists are allocated from
+ * 'mem', and freed all at once with the file node (see free_ast ()). While a
+ * node is being parsed, its children are pushed on to 'stack'; ast_finish ()
+ * then copies them into 'mem' in one piece, so a child list is never grown. */
+struct ast_arena {
+  struct arena mem;
+  struct ast **stack;
+  size_t stack_len, stack_mem;
+  /* More arenas holding parts of the same tree, freed with this one: those
+   * of parse_function_bodies ()'s threads */
+  struct ast_arena *next;
+};
+
+/* Create an empty 'struct ast' in the arena. Exit on error */
+struct ast *new_ast (struct ast_arena *arena, enum ast_tag type);
+
+/* AST visitors. ast_visit () walks a tree depth first, calling the pre hook
+ * for each node's tag on the way down and the post hook on the way back up;
+ * 'depth' is 0 for the node the walk started at. A NULL hook does nothing. A
+ * pre hook returns AST_SKIP to leave out the node's children (its post hook
+ * is still called), or AST_CONTINUE. The walk keeps its own stack on the
+ * heap, so trees of any depth are fine. Passes should define their visitor
+ * once, as a static const table:
+ *
+ *   static const struct ast_visitor PRINT_VISITOR = {
+ *     .pre = {[AST_FILE] = print_file, ...},
+ *     .post = {[AST_FILE] = print_close, ...}
+ *   };
+ */
+enum ast_visit_result {
+  AST_CONTINUE,
+  AST_SKIP
+};
+
+typedef enum ast_visit_result (*ast_pre_fn) (struct ast *ast, size_t depth,
+                                             void *data);
+typedef void (*ast_post_fn) (struct ast *ast, size_t depth, void *data);
 
-/* Pretty-print a 'struct ast' recursively. */
+struct ast_visitor {
+  ast_pre_fn pre[AST_N_TAGS];
+  ast_post_fn post[AST_N_TAGS];
+};
+
+/* Walk 'ast' with 'visitor', passing 'data' to the hooks. Exit on error */
+void ast_visit (struct ast *ast, const struct ast_visitor *visitor,
+                void *data);
+
+/* Pretty-print a 'struct ast'. */
 void print_ast (struct ast *ast, FILE *dest);
-void _print_ast (struct ast *ast, FILE *dest, int indent);
 
-/* Free a 'struct ast' recursively. */
+/* Free a file's AST. Every node is in the file's arena, so this releases
+ * the whole tree at once; only call it on the AST_FILE node. */
 void free_ast (struct ast *ast);
 
-/* Add a child to an AST item. Exit on error */
-void ast_add (struct ast *parent, struct ast *child);
+/* Start collecting children for a node. Returns a mark to pass to
+ * ast_finish (). */
+size_t ast_begin (struct ast_arena *arena);
 
-/* Various AST parsers. Use parse_file to parse the entire file recursively. */
+/* Add a child to the node being collected. Exit on error */
+void ast_add (struct ast_arena *arena, struct ast *child);
+
+/* Give 'parent' the children added since ast_begin () returned 'mark'. Exit
+ * on error */
+void ast_finish (struct ast_arena *arena, struct ast *parent, size_t mark);
+
+/* Various AST parsers. Use parse_file to parse the entire file recursively.
+ * The rest each parse one construct, adding nodes to 'arena'. Exit on
+ * error. parse_file picks up after each error in a declaration or statement
+ * (see parse_sync ()), so that it reports as many as it can - up to
+ * env->error_limit - before exiting. */
 struct ast *parse_file (struct lex *lex, struct env *env);
+struct ast *parse_function (struct lex *lex, struct env *env,
+                            struct ast_arena *arena, int lazy);
+struct ast *parse_class (struct lex *lex, struct env *env,
+                         struct ast_arena *arena);
+
+/* Parse a file as parse_file () does, but only skip over function bodies,
+ * balancing braces, and note where they are (see struct function). This is
+ * enough for imports, signatures and interfaces; bodies can be parsed later,
+ * by parse_function_body () or parse_function_bodies (). The whole file must
+ * have been lexed, by lexer_lex (), and the lexer kept open until then. Exit
+ * on error. */
+struct ast *parse_file_lazy (struct lex *lex, struct env *env);
 
-/* Various AST printers. Just call print_ast(); this will choose the proper one.
- * When writing these, note: always indent 'indent' spaces, and do NOT append a
- * final newline (sometimes a parent printer may want to finish out your line
- * with a closing paren, etc)
+/* Parse the body of 'function', from a tree made by parse_file_lazy (), if
+ * that hasn't been done yet. Returns the body, or NULL if there is none.
+ * Exit on error */
+struct ast *parse_function_body (struct lex *lex, struct env *env,
+                                 struct ast *function);
+
+/* Parse every body left by parse_file_lazy () in 'file', on up to 'n_threads'
+ * threads (see run_tasks ()). Each body's diagnostics are kept apart, and
+ * printed once all are done, together with any in lex->log, in the order
+ * parse_file () would have printed them (see error_print_logs ()), up to
+ * env->error_limit errors; bodies past that are left. Returns the number of
+ * errors printed, leaving the tree to the caller */
+size_t parse_function_bodies (struct lex *lex, struct env *env,
+                              struct ast *file, int n_threads);
+
+/* Lex and parse the file in 'lex', which must not have been lexed yet, as
+ * parse_file () does, but with the function bodies parsed on up to
+ * 'n_threads' threads, as by parse_function_bodies (). The diagnostics come
+ * out the same as from parse_file () in streaming mode, however the threads
+ * run. If there were errors, once the whole file has been tried, free the tree
+ * and return NULL. The tokens are kept, as by lexer_lex (). */
+struct ast *parse_file_parallel (struct lex *lex, struct env *env,
+                                 int n_threads);
+
+
+struct ast *parse_statement (struct lex *lex, struct env *env,
+                             struct ast_arena *arena);
+struct ast *parse_scope (struct lex *lex, struct env *env,
+                         struct ast_arena *arena);
+
+/* Read a token with TOK_* ID 'id', and return it; if the next token is
+ * anything else, complain "expected WHAT". Exit on error */
+struct token *parse_expect (struct lex *lex, int id, const char *what);
+
+/* Read a name (a word which is not a keyword), and return it interned; if
+ * the next token is anything else, complain "expected WHAT". Exit on error */
+const char *parse_name (struct lex *lex, const char *what);
+
+/* After an error, skip from where it was found to where parsing can pick up
+ * again: just past the next ; or the } matching a { skipped on the way, or -
+ * if 'nested', inside a scope - to an unmatched }, which closes the scope */
+void parse_sync (struct lex *lex, int nested);
+
+/* Parse an expression, in one pass over its tokens: a Pratt parser, with
+ * binding powers from src/parse/oper_tables.h (see autogen/operators.spec).
+ * 'min_bp' is the binding power below which an infix or postfix operator
+ * ends the expression rather than continuing it - 0 for a whole expression.
  */
-void print_file (struct ast *ast, FILE *dest, int indent);
-void print_class (struct ast *ast, FILE *dest, int indent);
-void print_function (struct ast *ast, FILE *dest, int indent);
-void print_st_break (struct ast *ast, FILE *dest, int indent);
-void print_st_continue (struct ast *ast, FILE *dest, int indent);
-void print_st_vardecl (struct ast *ast, FILE *dest, int indent);
-void print_st_new (struct ast *ast, FILE *dest, int indent);
-void print_st_delete (struct ast *ast, FILE *dest, int indent);
-void print_st_do_while (struct ast *ast, FILE *dest, int indent);
-void print_st_while (struct ast *ast, FILE *dest, int indent);
-void print_st_for (struct ast *ast, FILE *dest, int indent);
-void print_st_if (struct ast *ast, FILE *dest, int indent);
-void print_st_return (struct ast *ast, FILE *dest, int indent);
-void print_st_expr (struct ast *ast, FILE *dest, int indent);
-void print_st_scope (struct ast *ast, FILE *dest, int indent);
-
-/* Various AST freers. Just call free_ast(); this will choose the proper one.
- * These do not free the entire struct ast. */
+struct ast *parse_expr (struct lex *lex, struct env *env,
+                        struct ast_arena *arena, int min_bp);
+
+/* Various AST printers: pre hooks for print_ast ()'s visitor, which is in
+ * ast.c. Each one starts with print_start (), then prints the node up to its
+ * children; print_ast () prints the closing paren after them. Do NOT append a
+ * final newline - the next sibling's print_start () does that. 'data' is the
+ * destination FILE.
+ */
+void print_start (struct ast *ast, size_t depth, FILE *dest);
+void print_type (struct type *type, FILE *dest);
+enum ast_visit_result print_file (struct ast *ast, size_t depth, void *data);
+enum ast_visit_result print_function (struct ast *ast, size_t depth,
+                                      void *data);
+enum ast_visit_result print_class (struct ast *ast, size_t depth,
+                                   void *data);
+enum ast_visit_result print_field (struct ast *ast, size_t depth,
+                                   void *data);
+enum ast_visit_result print_statement (struct ast *ast, size_t depth,
+                                       void *data);
+enum ast_visit_result print_st_vardecl (struct ast *ast, size_t depth,
+                                        void *data);
+enum ast_visit_result print_expr (struct ast *ast, size_t depth, void *data);
+
+/* Free the tree under file node 'ast'. Nodes keep everything in the arena,
+ * and types are shared (see types/type.h), so this frees the arenas, and
+ * with them the whole tree. */
 void free_file (struct ast *ast);
-void free_class (struct ast *ast);
-void free_function (struct ast *ast);
-void free_st_break (struct ast *ast);
-void free_st_continue (struct ast *ast);
-void free_st_vardecl (struct ast *ast);
-void free_st_new (struct ast *ast);
-void free_st_delete (struct ast *ast);
-void free_st_do_while (struct ast *ast);
-void free_st_while (struct ast *ast);
-void free_st_for (struct ast *ast);
-void free_st_if (struct ast *ast);
-void free_st_return (struct ast *ast);
-void free_expr (struct ast *ast);
-void free_scope (struct ast *ast);
 
 #endif /* _PARSE_PARSE_H */
@@ -0,0 +1,358 @@
+/* Copyright (c) 2011, Christopher Pavlina. All rights reserved. */
+
+#include "parse.h"
+#include "../error.h"
+#include "../types/type.h"
+#include <stdlib.h>
+
+/* Give 'parent' the children 'a', 'b' and 'c', leaving out the NULLs */
+static void
+set_children (struct ast_arena *arena, struct ast *parent, struct ast *a,
+              struct ast *b, struct ast *c)
+{
+  size_t mark = ast_begin (arena);
+
+  if (a) ast_add (arena, a);
+  if (b) ast_add (arena, b);
+  if (c) ast_add (arena, c);
+  ast_finish (arena, parent, mark);
+}
+
+/* Parse the body of an if, while, do or for. An empty statement becomes an
+ * empty scope, so that the body is always there. */
+static struct ast *
+parse_body (struct lex *lex, struct env *env, struct ast_arena *arena)
+{
+  struct ast *ast;
+  struct token first, *token = lexer_peek (lex);
+
+  if (!token)
+    cerror_eof (lex, "expected statement");
+  first = *token;
+  ast = parse_statement (lex, env, arena);
+  if (!ast) {
+    ast = new_ast (arena, AST_SCOPE);
+    ast->token = first;
+  }
+  return ast;
+}
+
+/* Parse a parenthesised condition */
+static struct ast *
+parse_cond (struct lex *lex, struct env *env, struct ast_arena *arena)
+{
+  struct ast *ast;
+
+  parse_expect (lex, TOK_LPAREN, "(");
+  ast = parse_expr (lex, env, arena, 0);
+  parse_expect (lex, TOK_RPAREN, ")");
+  return ast;
+}
+
+/* let name := init;
+ * type name [= init];
+ */
+static struct ast *
+parse_vardecl (struct lex *lex, struct env *env, struct ast_arena *arena)
+{
+  struct ast *ast, *init = NULL;
+
+  ast = new_ast (arena, AST_ST_VARDECL);
+  ast->token = *lexer_peek (lex);
+
+  if (token_is_id (lexer_peek (lex), TOK_LET)) {
+    lexer_next (lex);
+    ast->o.st_vardecl.name = parse_name (lex, "variable name");
+    parse_expect (lex, TOK_DECLARE, ":=");
+    init = parse_expr (lex, env, arena, 0);
+  } else {
+    ast->o.st_vardecl.type = parse_type (lex, env);
+    ast->o.st_vardecl.name = parse_name (lex, "variable name");
+    if (token_is_id (lexer_peek (lex), TOK_ASSIGN)) {
+      lexer_next (lex);
+      init = parse_expr (lex, env, arena, 0);
+    }
+  }
+  parse_expect (lex, TOK_SEMI, ";");
+
+  set_children (arena, ast, init, NULL, NULL);
+  return ast;
+}
+
+/* Whether 'token' can be a variable's name */
+static int
+is_name (struct token *token)
+{
+  return token_is_t (token, T_WORD) && !token_is_keyword (token, 1) &&
+    token->value[0] != '@';
+}
+
+/* Whether the statement starting with the next token is a variable
+ * declaration. 'let' and the builtin types always start one. Any other word
+ * does if it is followed by a name, or by a type's arguments, *, [] and
+ * qualifiers and then a name - looking no further than LEX_VIEWS - 3 tokens
+ * ahead (see lexer_peek_ahead ()) - and the name by = or ;. So 'P p;' and
+ * 'list<int> l;' are declarations, and 'a < b;' and 'a * b + c;' are not. */
+static int
+is_vardecl (struct lex *lex)
+{
+  struct token *token = lexer_peek (lex);
+  size_t i = 1, depth = 0;
+
+  if (token->id == TOK_LET ||
+      (token->id >= TOK_FIRST_TYPE && token->id < TOK_END_TYPE))
+    return 1;
+  if (!is_name (token))
+    return 0;
+
+  /* The arguments: words, and what goes between and after them */
+  if (token_is_id (lexer_peek_ahead (lex, 1), TOK_LT)) {
+    for (depth = 1, i = 2; depth; ++i) {
+      if (i > LEX_VIEWS - 4)
+        return 0;
+      token = lexer_peek_ahead (lex, i);
+      if (!token)
+        return 0;
+      else if (token->id == TOK_LT)
+        ++depth;
+      else if (token->id == TOK_GT)
+        --depth;
+      else if (token->id == TOK_SHR && depth >= 2)
+        depth -= 2;
+      else if (!token_is_t (token, T_WORD) && token->id != TOK_COMMA &&
+               token->id != TOK_MUL && token->id != TOK_LBRACKET &&
+               token->id != TOK_RBRACKET)
+        return 0;
+    }
+  }
+
+  /* The modifiers, and the name */
+  for (; i <= LEX_VIEWS - 4; ++i) {
+    token = lexer_peek_ahead (lex, i);
+    if (token_is_id (token, TOK_LBRACKET) &&
+        token_is_id (lexer_peek_ahead (lex, i + 1), TOK_RBRACKET))
+      ++i;
+    else if (!token_is_id (token, TOK_MUL) &&
+             !token_is_id (token, TOK_CONST) &&
+             !token_is_id (token, TOK_VOLATILE))
+      break;
+  }
+  if (i > LEX_VIEWS - 4 || !is_name (token))
+    return 0;
+  token = lexer_peek_ahead (lex, i + 1);
+  return token_is_id (token, TOK_ASSIGN) || token_is_id (token, TOK_SEMI);
+}
+
+/* for ([init]; [cond]; [step]) body */
+static struct ast *
+parse_for (struct lex *lex, struct env *env, struct ast_arena *arena)
+{
+  struct ast *ast, *init = NULL, *cond = NULL, *step = NULL, *body;
+  struct token *token;
+  size_t mark;
+
+  ast = new_ast (arena, AST_ST_FOR);
+  ast->token = *lexer_next (lex);
+  parse_expect (lex, TOK_LPAREN, "(");
+
+  token = lexer_peek (lex);
+  if (!token) {
+    cerror_eof (lex, "expected expression");
+  } else if (token_is_id (token, TOK_SEMI)) {
+    lexer_next (lex);
+  } else if (is_vardecl (lex)) {
+    init = parse_vardecl (lex, env, arena);
+  } else {
+    init = parse_expr (lex, env, arena, 0);
+    parse_expect (lex, TOK_SEMI, ";");
+  }
+
+  if (!token_is_id (lexer_peek (lex), TOK_SEMI))
+    cond = parse_expr (lex, env, arena, 0);
+  parse_expect (lex, TOK_SEMI, ";");
+
+  if (!token_is_id (lexer_peek (lex), TOK_RPAREN))
+    step = parse_expr (lex, env, arena, 0);
+  parse_expect (lex, TOK_RPAREN, ")");
+
+  body = parse_body (lex, env, arena);
+
+  ast->o.st_for.has_init = init != NULL;
+  ast->o.st_for.has_cond = cond != NULL;
+  ast->o.st_for.has_step = step != NULL;
+  mark = ast_begin (arena);
+  if (init) ast_add (arena, init);
+  if (cond) ast_add (arena, cond);
+  if (step) ast_add (arena, step);
+  ast_add (arena, body);
+  ast_finish (arena, ast, mark);
+  return ast;
+}
+
+struct ast *
+parse_scope (struct lex *lex, struct env *env, struct ast_arena *arena)
+{
+  struct ast *ast, *child;
+  jmp_buf recover, *outer;
+  volatile size_t kept;
+  size_t mark;
+
+  ast = new_ast (arena, AST_SCOPE);
+  ast->token = *parse_expect (lex, TOK_LBRACE, "{");
+
+  mark = kept = ast_begin (arena);
+
+  /* After an error, drop the statement it was in, and go on from the next
+   * one (see cerror_at ()) */
+  outer = lex->recover;
+  lex->recover = &recover;
+  if (setjmp (recover)) {
+    arena->stack_len = kept;
+    parse_sync (lex, 1);
+  }
+
+  while (!token_is_id (lexer_peek (lex), TOK_RBRACE)) {
+    if (!lexer_peek (lex))
+      cerror_eof (lex, "expected }");
+    child = parse_statement (lex, env, arena);
+    if (child) ast_add (arena, child);
+    kept = arena->stack_len;
+  }
+  lex->recover = outer;
+  lexer_next (lex);
+  ast_finish (arena, ast, mark);
+
+  return ast;
+}
+
+struct ast *
+parse_statement (struct lex *lex, struct env *env, struct ast_arena *arena)
+{
+  struct ast *ast, *a = NULL, *b = NULL, *c = NULL;
+  struct token *token = lexer_peek (lex);
+
+  if (!token)
+    cerror_eof (lex, "expected statement");
+
+  switch (token->id) {
+  case TOK_SEMI:
+    /* Empty statement */
+    lexer_next (lex);
+    return NULL;
+
+  case TOK_LBRACE:
+    return parse_scope (lex, env, arena);
+
+  case TOK_FOR:
+    return parse_for (lex, env, arena);
+
+  case TOK_IF:
+    ast = new_ast (arena, AST_ST_IF);
+    ast->token = *lexer_next (lex);
+    a = parse_cond (lex, env, arena);
+    b = parse_body (lex, env, arena);
+    if (token_is_id (lexer_peek (lex), TOK_ELSE)) {
+      lexer_next (lex);
+      c = parse_body (lex, env, arena);
+    }
+    break;
+
+  case TOK_WHILE:
+    ast = new_ast (arena, AST_ST_WHILE);
+    ast->token = *lexer_next (lex);
+    a = parse_cond (lex, env, arena);
+    b = parse_body (lex, env, arena);
+    break;
+
+  case TOK_DO:
+    ast = new_ast (arena, AST_ST_DO_WHILE);
+    ast->token = *lexer_next (lex);
+    a = parse_body (lex, env, arena);
+    parse_expect (lex, TOK_WHILE, "while");
+    b = parse_cond (lex, env, arena);
+    parse_expect (lex, TOK_SEMI, ";");
+    break;
+
+  case TOK_RETURN:
+    ast = new_ast (arena, AST_ST_RETURN);
+    ast->token = *lexer_next (lex);
+    if (!token_is_id (lexer_peek (lex), TOK_SEMI))
+      a = parse_expr (lex, env, arena, 0);
+    parse_expect (lex, TOK_SEMI, ";");
+    break;
+
+  case TOK_BREAK:
+  case TOK_CONTINUE:
+    ast = new_ast (arena, token->id == TOK_BREAK ? AST_ST_BREAK
+                   : AST_ST_CONTINUE);
+    ast->token = *lexer_next (lex);
+    parse_expect (lex, TOK_SEMI, ";");
+    break;
+
+  default:
+    if (is_vardecl (lex))
+      return parse_vardecl (lex, env, arena);
+
+    /* Expression statement */
+    ast = parse_expr (lex, env, arena, 0);
+    parse_expect (lex, TOK_SEMI, ";");
+    return ast;
+  }
+
+  set_children (arena, ast, a, b, c);
+  return ast;
+}
+
+enum ast_visit_result
+print_statement (struct ast *ast, size_t depth, void *data)
+{
+  /* (while
+   *   (cond...)
+   *   (body...))
+   */
+
+  static const char *const names[AST_N_TAGS] = {
+    [AST_ST_BREAK] = "break",
+    [AST_ST_CONTINUE] = "continue",
+    [AST_ST_DO_WHILE] = "do-while",
+    [AST_ST_WHILE] = "while",
+    [AST_ST_FOR] = "for",
+    [AST_ST_IF] = "if",
+    [AST_ST_RETURN] = "return",
+    [AST_SCOPE] = "scope"
+  };
+  FILE *dest = data;
+
+  print_start (ast, depth, dest);
+  fprintf (dest, "(%s", names[ast->tag]);
+  if (ast->tag == AST_ST_FOR) {
+    /* Say which of the optional parts the children are */
+    if (ast->o.st_for.has_init) fputs (" init", dest);
+    if (ast->o.st_for.has_cond) fputs (" cond", dest);
+    if (ast->o.st_for.has_step) fputs (" step", dest);
+  }
+  if (ast->n_children) fputc ('\n', dest);
+  return AST_CONTINUE;
+}
+
+enum ast_visit_result
+print_st_vardecl (struct ast *ast, size_t depth, void *data)
+{
+  /* (let "name"
+   *   (init...))
+   * (var type "name")
+   */
+
+  FILE *dest = data;
+
+  print_start (ast, depth, dest);
+  if (ast->o.st_vardecl.type) {
+    fputs ("(var ", dest);
+    print_type (ast->o.st_vardecl.type, dest);
+    fprintf (dest, " \"%s\"", ast->o.st_vardecl.name);
+  } else {
+    fprintf (dest, "(let \"%s\"", ast->o.st_vardecl.name);
+  }
+  if (ast->n_children) fputc ('\n', dest);
+  return AST_CONTINUE;
+}
@@ -164,7 +164,9 @@ read_args(struct args *args, int argc, char **argv)
             ++llc_opts_count;
         }
 
-        else if (!strncmp (argv[i], "-as", 3)) {
+        /* -ast and -ast=... are options of their own, further down */
+        else if (!strncmp (argv[i], "-as", 3) &&
+                 strcmp (argv[i], "-ast") && strncmp (argv[i], "-ast=", 5)) {
             if (as_opts_count >= (LIST_ARG_MAX - 1)) {
                 error_message ("too many occurrences of -as");
             }
@@ -186,6 +188,14 @@ read_args(struct args *args, int argc, char **argv)
             args->debug = 1;
         }
 
+        else if (!strncmp (argv[i], "-j", 2)) {
+            char const *n = consume (argc, argv, &i, 2, 0);
+            char *end;
+            args->jobs = (int) strtol (n, &end, 10);
+            if (*end || args->jobs < 1)
+                error_message ("-j must be given a positive number");
+        }
+
         else if (!strncmp (argv[i], "-O", 2)) {
             if (argv[i][2] >= '0' && argv[i][2] <= '3')
                 args->optlevel = argv[i][2] - '0';
@@ -212,6 +222,18 @@ read_args(struct args *args, int argc, char **argv)
             args->fpic = 1;
         }
 
+        else if (!strncmp (argv[i], "-ferror-limit=", 14)) {
+            char *end;
+            unsigned long limit = strtoul (argv[i] + 14, &end, 10);
+            if (!argv[i][14] || *end || argv[i][14] == '-')
+                error_message ("-ferror-limit must be given a number");
+            args->error_limit = limit;
+        }
+
+        else if (!strcmp (argv[i], "-freorder-fields")) {
+            args->reorder_fields = 1;
+        }
+
         else if (!strncmp (argv[i], "-l", 2)) {
             if (libs_count >= (LIST_ARG_MAX - 1)) {
                 error_message ("too many occurrences of -l");
@@ -291,6 +313,56 @@ read_args(struct args *args, int argc, char **argv)
             args->pre_ast_only = 1;
         }
 
+        else if (!strncmp (argv[i], "-ast=", 5) ||
+                 !strncmp (argv[i], "-pre-ast=", 9)) {
+            const char *format = strchr (argv[i], '=') + 1;
+            if (argv[i][1] == 'a')
+                args->ast_only = 1;
+            else
+                args->pre_ast_only = 1;
+            if (!strcmp (format, "binary"))
+                args->ast_binary = 1;
+            else if (!strcmp (format, "text"))
+                args->ast_binary = 0;
+            else
+                error_message ("unknown AST format %s", format);
+        }
+
+        else if (!strcmp (argv[i], "-skip-bodies")) {
+            args->skip_bodies = 1;
+        }
+
+        else if (!strcmp (argv[i], "-deps")) {
+            args->deps_only = 1;
+        }
+
+        else if (!strcmp (argv[i], "-dump-layouts")) {
+            args->dump_layouts = 1;
+        }
+
+        else if (!strncmp (argv[i], "-cache-dir=", 11)) {
+            if (!argv[i][11])
+                error_message ("-cache-dir option expects argument");
+            args->cache_dir = argv[i] + 11;
+        }
+
+        else if (!strncmp (argv[i], "-cache-size=", 12)) {
+            char *end;
+            unsigned long size = strtoul (argv[i] + 12, &end, 10);
+            if (!argv[i][12] || *end || argv[i][12] == '-' ||
+                size > (size_t) -1 >> 20)
+                error_message ("-cache-size must be given a size in MiB");
+            args->cache_size = size;
+        }
+
+        else if (!strcmp (argv[i], "-cache-clear")) {
+            args->cache_clear = 1;
+        }
+
+        else if (!strcmp (argv[i], "-cache-stats")) {
+            args->cache_stats = 1;
+        }
+
         else if (!strcmp (argv[i], "-force-platform")) {
             args->force_platform = 1;
         }
@@ -337,9 +409,14 @@ static void usage (char const *argv0)
         "    -ld<opt>          give <opt> to the linker\n"
         "    -g                include debugging information\n"
         "    -O<n>             set optimisation level (0, 1, 2, 3)\n"
+        "    -j<n>             compile up to <n> source files at once\n"
         "    -m<bits>          set machine (32, 64)\n"
         "    -fPIC             generate position-independent code (implicit\n"
         "                      with non-executable packages)\n"
+        "    -ferror-limit=<n> stop a file after <n> errors (0 for no limit;\n"
+        "                      default 20)\n"
+        "    -freorder-fields  lay out the fields of every record and class\n"
+        "                      to waste least space, as @reorder does\n"
         "    -l<lib>           link with <lib>\n"
         "    -L<dir>           add <dir> to the library search path\n"
         "    -P<dir>           add <dir> to the package search path\n"
@@ -353,6 +430,12 @@ static void usage (char const *argv0)
         "    -sm               enable systems programming mode\n"
         "    -malloc <func>    use <func> as the allocator\n"
         "    -free <func>      use <func> as the deallocator\n"
+        "    -cache-dir=<dir>  keep lexed and parsed files in <dir>, and\n"
+        "                      reuse them while the source is unchanged\n"
+        "    -cache-size=<n>   limit the cache to <n> MiB (0 for no limit;\n"
+        "                      default 256)\n"
+        "    -cache-clear      empty the cache first\n"
+        "    -cache-stats      print cache hits and misses at the end\n"
         "------------------------------------------------------------------\n"
         "    -W(no-)octalish   (do not) warn about the use of numbers like\n"
         "                      0755 (which is decimal 755 in Alpha).\n"
@@ -364,6 +447,14 @@ static void usage (char const *argv0)
         "                      input, then quit\n"
         "    -ast              dump the AST after parsing, and quit\n"
         "    -pre-ast          dump the AST before type checking, and quit\n"
+        "    -ast=FORMAT, -pre-ast=FORMAT\n"
+        "                      dump the AST as 'text' (the default), or as\n"
+        "                      'binary' (to the -o file, or stdout)\n"
+        "    -skip-bodies      leave function bodies out of the AST dump\n"
+        "    -deps             list the packages each input imports, and\n"
+        "                      quit\n"
+        "    -dump-layouts     print the layout of each record and class in\n"
+        "                      the inputs, and quit\n"
         "    -force-platform   force compiling on an unsupported platform\n",
         argv0);
 }
@@ -382,6 +473,9 @@ static void init_args (struct args *args)
 
     /* Some do not */
     args->w_octalish = 1;
+    args->jobs = 1;
+    args->cache_size = 256;
+    args->error_limit = 20;
 
     args->sources = malloc (LIST_ARG_MAX * sizeof (*args->sources));
     if (args->sources == NULL) error_errno ();
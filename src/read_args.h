@@ -3,6 +3,8 @@
 #ifndef _READ_ARGS_H
 #define _READ_ARGS_H 1
 
+#include <stddef.h>
+
 struct args;
 
 /* Allow this many of any list-type argument */
@@ -48,6 +50,31 @@ struct args {
     /* Dump the AST before type checking and quit? */
     int pre_ast_only;
 
+    /* Dump the AST in binary (see parse/binast.h) rather than as text? */
+    int ast_binary;
+
+    /* Leave function bodies out of the AST dump? */
+    int skip_bodies;
+
+    /* List each file's imports and quit? */
+    int deps_only;
+
+    /* Print the layout of each record and class and quit? */
+    int dump_layouts;
+
+    /* Directory to cache lexed and parsed files in (see cache.h), or NULL
+     * for none */
+    char const *cache_dir;
+
+    /* Limit on the size of the cache, in MiB, or 0 for none */
+    size_t cache_size;
+
+    /* Empty the cache before compiling? */
+    int cache_clear;
+
+    /* Print cache statistics at the end? */
+    int cache_stats;
+
     /* Force compiling on an unsupported platform? */
     int force_platform;
 
@@ -63,6 +90,15 @@ struct args {
     /* Optimisation level */
     int optlevel;
 
+    /* Number of source files to compile at once */
+    int jobs;
+
+    /* Number of errors to stop a file at, or 0 for no limit */
+    size_t error_limit;
+
+    /* Reorder the fields of every record and class? */
+    int reorder_fields;
+
     /* Machine ID string */
     char const *machine;
 
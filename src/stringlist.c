@@ -1,6 +1,7 @@
 /* Copyright (c) 2011, Christopher Pavlina. All rights reserved. */
 
 #include "stringlist.h"
+#include "intern.h"
 #include <stdlib.h>
 #include <string.h>
 
@@ -11,7 +12,7 @@ static int
 make_room (struct stringlist *sl)
 {
     if (sl->n_in_list >= (sl->buf_size - 1)) {
-        char **new_list = realloc (sl->list,
+        const char **new_list = realloc (sl->list,
                 2 * sl->buf_size * sizeof (*new_list));
         if (!new_list) return 1;
         memset (new_list + sl->buf_size, 0, sl->buf_size * sizeof (*new_list));
@@ -35,17 +36,14 @@ stringlist_init (struct stringlist *sl)
 int
 stringlist_append (struct stringlist *sl, const char *s)
 {
-    char *copy = strdup (s);
-    if (!copy) return 1;
-
     if (make_room (sl)) return 1;
-    sl->list[sl->n_in_list] = copy;
+    sl->list[sl->n_in_list] = intern_s (s);
     ++sl->n_in_list;
 
     return 0;
 }
 
-char *
+const char *
 stringlist_get (struct stringlist *sl, size_t i)
 {
     return sl->list[i];
@@ -54,11 +52,7 @@ stringlist_get (struct stringlist *sl, size_t i)
 int
 stringlist_set (struct stringlist *sl, size_t i, const char *s)
 {
-    char *copy = strdup (s);
-    if (!copy) return 1;
-
-    if (sl->list[i]) free (sl->list[i]);
-    sl->list[i] = copy;
+    sl->list[i] = intern_s (s);
 
     return 0;
 }
@@ -69,7 +63,7 @@ stringlist_len (struct stringlist *sl)
     return sl->n_in_list;
 }
 
-char **
+const char **
 stringlist_array (struct stringlist *sl)
 {
     return sl->list;
@@ -78,9 +72,5 @@ stringlist_array (struct stringlist *sl)
 void
 stringlist_free (struct stringlist *sl)
 {
-    size_t i;
-    for (i = 0; i < sl->n_in_list; ++i) {
-        if (sl->list[i]) free (sl->list[i]);
-    }
     free (sl->list);
 }
@@ -6,10 +6,11 @@
 #include <stddef.h>
 
 /* This is a mutable list of strings. It can be easily converted to an array,
- * or left as a list. */
+ * or left as a list. The strings are interned (see intern.h), so they are
+ * never freed, and equal strings compare with ==. */
 
 struct stringlist {
-    char **list;
+    const char **list;
     size_t n_in_list;
     size_t buf_size;
 };
@@ -18,15 +19,16 @@ struct stringlist {
 int
 stringlist_init (struct stringlist *sl);
 
-/* Append a string to the list. Takes a copy. Returns nonzero on error. */
+/* Append a string to the list. Interns it. Returns nonzero on error. */
 int
 stringlist_append (struct stringlist *sl, const char *s);
 
 /* Get a string from the list. No bounds-checking. */
-char *
+const char *
 stringlist_get (struct stringlist *sl, size_t i);
 
-/* Set a string in the list. The index must exist. Returns nonzero on error. */
+/* Set a string in the list. The index must exist. Interns the string.
+ * Returns nonzero on error. */
 int
 stringlist_set (struct stringlist *sl, size_t i, const char *s);
 
@@ -36,7 +38,7 @@ stringlist_len (struct stringlist *sl);
 
 /* Get the stringlist as an array. When done with the array, call
  * stringlist_free() on the stringlist. */
-char **
+const char **
 stringlist_array (struct stringlist *sl);
 
 /* Free the stringlist */
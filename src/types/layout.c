@@ -0,0 +1,219 @@
+/* Copyright (c) 2011, Christopher Pavlina. All rights reserved. */
+
+#include "layout.h"
+#include "../error.h"
+#include <string.h>
+
+/* layout.state */
+enum { NOT_LAID_OUT, LAYING_OUT, LAID_OUT };
+
+#define ROUND_UP(n, align) (((n) + (align) - 1) / (align) * (align))
+
+struct layout *layouts_find (struct layouts *layouts, const char *name)
+{
+  size_t i;
+
+  /* Names are interned */
+  for (i = 0; i < layouts->n; ++i)
+    if (layouts->list[i].name == name)
+      return &layouts->list[i];
+  return NULL;
+}
+
+static void lay_out (struct layouts *layouts, struct layout *L,
+                     struct lex *lex, struct env *env);
+
+/* Work out the size and alignment of field 'f', declared by 'ast' */
+static void size_field (struct layouts *layouts, struct layout_field *f,
+                        struct ast *ast, struct lex *lex, struct env *env)
+{
+  size_t word = env->bits / 8;
+  struct layout *inner = NULL;
+
+  if (f->type->enc == OBJECT && !f->type->n_args)
+    inner = layouts_find (layouts, f->type->name);
+  if (inner && inner->is_record) {
+    if (inner->state == LAYING_OUT) {
+      cerror_continue (lex, &ast->token, "record %s holds itself",
+                       inner->name);
+      f->size = 0;
+      f->align = 1;
+      return;
+    }
+    lay_out (layouts, inner, lex, env);
+    f->size = inner->size;
+    f->align = inner->align;
+    return;
+  }
+
+  f->size = f->type->size;
+  f->align = f->size < word ? f->size : word;
+  if (!f->align) f->align = 1;
+}
+
+/* Put the fields in the order to lay them out in, for @reorder (see
+ * layout.h) */
+static void order_fields (struct layout_field *fields, size_t n)
+{
+  struct layout_field swap;
+  size_t i, j, best, at = 0, pad_j, pad_best;
+
+  for (i = 0; i < n; ++i) {
+    best = i;
+    pad_best = ROUND_UP (at, fields[i].align) - at;
+    for (j = i + 1; j < n; ++j) {
+      pad_j = ROUND_UP (at, fields[j].align) - at;
+      if (fields[j].is_hot != fields[best].is_hot) {
+        if (!fields[j].is_hot) continue;
+      } else if (pad_j != pad_best) {
+        if (pad_j > pad_best) continue;
+      } else if (fields[j].align != fields[best].align) {
+        if (fields[j].align < fields[best].align) continue;
+      } else if (fields[j].index > fields[best].index) {
+        continue;
+      }
+      best = j;
+      pad_best = pad_j;
+    }
+
+    swap = fields[i];
+    fields[i] = fields[best];
+    fields[best] = swap;
+    at = ROUND_UP (at, fields[i].align) + fields[i].size;
+  }
+}
+
+/* Give L's fields their offsets, in the order they are in, and work out L's
+ * size, alignment and padding */
+static void place_fields (struct layout *L)
+{
+  size_t i, at = 0;
+
+  L->align = 1;
+  L->padding = 0;
+  for (i = 0; i < L->n_fields; ++i) {
+    L->fields[i].offset = ROUND_UP (at, L->fields[i].align);
+    L->padding += L->fields[i].offset - at;
+    at = L->fields[i].offset + L->fields[i].size;
+    if (L->fields[i].align > L->align)
+      L->align = L->fields[i].align;
+  }
+  L->size = ROUND_UP (at, L->align);
+  L->padding += L->size - at;
+}
+
+static void lay_out (struct layouts *layouts, struct layout *L,
+                     struct lex *lex, struct env *env)
+{
+  struct ast *ast = L->ast;
+  size_t i;
+
+  if (L->state != NOT_LAID_OUT)
+    return;
+  L->state = LAYING_OUT;
+
+  L->n_fields = ast->n_children;
+  L->fields = arena_alloc (&layouts->mem,
+                           L->n_fields * sizeof (*L->fields));
+  for (i = 0; i < L->n_fields; ++i) {
+    L->fields[i].name = ast->children[i]->o.field.name;
+    L->fields[i].type = ast->children[i]->o.field.type;
+    L->fields[i].index = i;
+    L->fields[i].is_hot = ast->children[i]->o.field.is_hot;
+    size_field (layouts, &L->fields[i], ast->children[i], lex, env);
+  }
+  place_fields (L);
+
+  L->is_reordered = ast->o.class.is_reorder || env->reorder_fields;
+  if (L->is_reordered) {
+    L->declared_size = L->size;
+    order_fields (L->fields, L->n_fields);
+    place_fields (L);
+  }
+  L->state = LAID_OUT;
+}
+
+void layouts_compute (struct layouts *layouts, struct ast *file,
+                      struct lex *lex, struct env *env)
+{
+  struct layout *L, *other;
+  struct ast *ast;
+  size_t i, n = 0, errors = lex->n_errors;
+
+  memset (layouts, 0, sizeof (*layouts));
+  arena_init (&layouts->mem);
+  for (i = 0; i < file->n_children; ++i)
+    if (file->children[i]->tag == AST_CLASS)
+      ++n;
+  layouts->list = arena_alloc (&layouts->mem, n * sizeof (*layouts->list));
+
+  /* Every name must be known before the first is laid out, to tell which
+   * fields are records */
+  for (i = 0; i < file->n_children; ++i) {
+    ast = file->children[i];
+    if (ast->tag != AST_CLASS)
+      continue;
+    other = layouts_find (layouts, ast->o.class.name);
+    if (other) {
+      cerror_continue (lex, &ast->token, "%s is already declared",
+                       ast->o.class.name);
+      continue;
+    }
+    L = &layouts->list[layouts->n++];
+    memset (L, 0, sizeof (*L));
+    L->name = ast->o.class.name;
+    L->ast = ast;
+    L->is_record = ast->o.class.is_record;
+  }
+
+  for (i = 0; i < layouts->n; ++i)
+    lay_out (layouts, &layouts->list[i], lex, env);
+
+  if (lex->n_errors != errors) {
+    layouts_free (layouts);
+    error_fail ();
+  }
+}
+
+void layouts_free (struct layouts *layouts)
+{
+  arena_free (&layouts->mem);
+  layouts->list = NULL;
+  layouts->n = 0;
+}
+
+void layouts_print (struct layouts *layouts, FILE *f)
+{
+  struct layout *L;
+  struct layout_field *field;
+  size_t i, j, at;
+
+  for (i = 0; i < layouts->n; ++i) {
+    L = &layouts->list[i];
+    if (i) fputc ('\n', f);
+    fprintf (f, "%s %s: size %lu, align %lu, %lu bytes padding",
+             L->is_record ? "record" : "class", L->name,
+             (unsigned long) L->size, (unsigned long) L->align,
+             (unsigned long) L->padding);
+    if (L->is_reordered)
+      fprintf (f, " (reordered from %lu)", (unsigned long) L->declared_size);
+    fputc ('\n', f);
+    if (!L->n_fields)
+      continue;
+
+    fputs ("  offset  size  align  field\n", f);
+    for (j = 0, at = 0; j <= L->n_fields; ++j) {
+      field = j < L->n_fields ? &L->fields[j] : NULL;
+      if ((field ? field->offset : L->size) > at)
+        fprintf (f, "  %6lu  %4lu         (padding)\n", (unsigned long) at,
+                 (unsigned long) ((field ? field->offset : L->size) - at));
+      if (!field)
+        break;
+      fprintf (f, "  %6lu  %4lu  %5lu  ", (unsigned long) field->offset,
+               (unsigned long) field->size, (unsigned long) field->align);
+      print_type (field->type, f);
+      fprintf (f, " %s%s\n", field->name, field->is_hot ? " @hot" : "");
+      at = field->offset + field->size;
+    }
+  }
+}
@@ -0,0 +1,84 @@
+/* Copyright (c) 2011, Christopher Pavlina. All rights reserved. */
+
+#ifndef _TYPES_LAYOUT_H
+#define _TYPES_LAYOUT_H 1
+
+#include "type.h"
+#include "../arena.h"
+#include "../parse/parse.h"
+#include <stdio.h>
+
+/* Record and class layouts: where each field goes, and how big and how
+ * aligned the whole is, on the target machine (see env->bits).
+ *
+ * A scalar is aligned to its size, but to no more than a word - 4 bytes with
+ * -m32, 8 with -m64, as the i386 and x86-64 ABIs have it. Pointers, arrays and
+ * objects take a word; so do instances of classes, which are references. A
+ * field whose type is a record holds the record itself, so a record can't
+ * hold itself, even through others. The size is a multiple of the alignment,
+ * so that records in a row stay aligned. Only the records of the same file
+ * are known for now; any other name is taken to be an object.
+ *
+ * Fields go in the order declared, unless the record or class is marked
+ * @reorder, or -freorder-fields is given. Then the @hot fields come first,
+ * together, so that they span as few cache lines as they can, and the rest
+ * after them. In each group, the next field is the one needing least padding
+ * where it would go, and of those, the most aligned - which leaves no padding
+ * inside a group, but for what small fields can't fill.
+ */
+
+struct layout_field {
+  /* Interned */
+  const char *name;
+  struct type *type;
+  size_t offset, size, align;
+  /* Its place in the declaration */
+  size_t index;
+  unsigned char is_hot;
+};
+
+struct layout {
+  /* Interned */
+  const char *name;
+  /* The AST_CLASS node */
+  struct ast *ast;
+  size_t size, align;
+  /* Bytes of padding, between the fields and after them */
+  size_t padding;
+  /* If the fields were reordered, the size they would have taken in the
+   * order declared */
+  size_t declared_size;
+  /* In the order laid out */
+  struct layout_field *fields;
+  size_t n_fields;
+  unsigned char is_record, is_reordered;
+  /* How far layouts_compute () has got with it: see layout.c */
+  unsigned char state;
+};
+
+/* The layouts of a file's records and classes, in the order declared */
+struct layouts {
+  struct layout *list;
+  size_t n;
+  /* Memory for the lists */
+  struct arena mem;
+};
+
+/* Lay out the records and classes of 'file', parsed from 'lex', for 'env'.
+ * The tree and the lexer must stay until layouts_free (). Errors - a record
+ * holding itself, or a name declared twice - are counted as the file's; exit
+ * once they have all been reported. */
+void layouts_compute (struct layouts *layouts, struct ast *file,
+                      struct lex *lex, struct env *env);
+
+/* Free the layouts */
+void layouts_free (struct layouts *layouts);
+
+/* The layout of record or class 'name' (interned), or NULL */
+struct layout *layouts_find (struct layouts *layouts, const char *name);
+
+/* Print each layout, with the offset, size and alignment of every field and
+ * the padding between them, to 'f' */
+void layouts_print (struct layouts *layouts, FILE *f);
+
+#endif /* _TYPES_LAYOUT_H */
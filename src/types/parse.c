@@ -1,49 +1,33 @@
 /* Copyright (c) 2011, Christopher Pavlina. All rights reserved. */
 
 #include "type.h"
+#include "builtin_types.h"
 #include "../lex/lex.h"
 #include "../error.h"
-#include "../strlcpy.h"
+#include "../intern.h"
 #include <stdlib.h>
 #include <string.h>
 
 /* This is the main type parser in AlCo. It can parse all type declarations.
- * Note one trick: If it sees a >> token, it will advance the (notably writable)
- * token to just > after consuming a single character. This is so that things
- * like map<int, list<string>> are parsed correctly. Yes, I know it's a dirty
- * trick. No, I won't change it.
+ * A >> closing two argument lists, as in map<int, list<string>>, is split
+ * (see lexer_split ()), and its second > left to close the outer one.
  *
- * This function will always return a newly-allocated type, even for simple
- * primitives, so you can directly link or modify.
+ * Types are built bottom up, each part made canonical (see get_ty ()) as soon
+ * as it is complete, so parsing the same type twice gives back the same
+ * node.
  */
 
-/* Helper: Initialise 'enc' and 'size' from the type name. Only reads the 'name'
- * field - everything else may be uninitialised. */
+/* Helper: Initialise 'enc' and 'size' from the token ID of the type name.
+ * Everything else may be uninitialised. */
 static void
-init_enc_size(struct type *type, struct env *env)
+init_enc_size(struct type *type, int id, struct env *env)
 {
-        /* Make sure these arrays line up. It is not necessary to match the NULL
-         * in 'names' with the other arrays. */
-        static const char *names[] = {
-                "i8", "i16", "i32", "i64", "int",      "ssize",
-                "u8", "u16", "u32", "u64", "unsigned", "size",
-                      "f16", "f32", "f64", "float",    "double", "bool", NULL };
-        const size_t sizes[] = {
-                1,    2,     4,     8,     4,          env->bits / 8,
-                1,    2,     4,     8,     4,          env->bits / 8,
-                      2,     4,     8,     4,          8,        1 };
-        static const enum type_encoding encodings[] = {
-                SINT, SINT,  SINT,  SINT,  SINT,       SINT,
-                UINT, UINT,  UINT,  UINT,  UINT,       UINT,
-                      FLOAT, FLOAT, FLOAT, FLOAT,      FLOAT,    BOOL };
-
-        size_t i;
-        for (i = 0; names[i]; ++i) {
-                if (!strcmp(type->name, names[i])) {
-                        type->size = sizes[i];
-                        type->enc = encodings[i];
-                        return;
-                }
+        if (id >= TOK_FIRST_TYPE && id < TOK_END_TYPE) {
+                type->size = builtin_types[id - TOK_FIRST_TYPE].size;
+                type->enc = builtin_types[id - TOK_FIRST_TYPE].enc;
+                if (!type->size)
+                        type->size = env->bits / 8;
+                return;
         }
 
         /* If we get here, this is not a primitive. The only nonprimitive named
@@ -56,7 +40,6 @@ static void
 do_base_name(struct type *t, struct lex *lex, struct env *env)
 {
         struct token *token;
-        size_t n;
 
         /* Base name */
         token = lexer_next(lex);
@@ -64,27 +47,76 @@ do_base_name(struct type *t, struct lex *lex, struct env *env)
                 cerror_eof(lex, "expected type name");
         else if (!token_is_t(token, T_WORD))
                 cerror_at(lex, token, "expected type name");
-        n = strlcpy(t->name, token->value, TYPE_NAME_MAX);
-        if (n >= TYPE_NAME_MAX) {
-                cerror_at(lex, token,
-                          "type name too long - maximum length is %zu",
-                          TYPE_NAME_MAX - 1);
+        /* From base name we can get much information */
+        init_enc_size(t, token->id, env);
+
+        /* An alias, such as int, is the standard type it stands for; only
+         * the token keeps how it was spelt */
+        if (t->enc != OBJECT)
+                t->name = get_ty_standard(t->enc, t->size)->name;
+        else
+                t->name = intern(token->value, token->len);
+}
+
+/* One type argument, read while the rest are being read. The list is kept on
+ * the stack, so that nothing is left allocated if an error is recovered from
+ * (see cerror_at ()). */
+struct arg_link {
+        struct type *type;
+        struct arg_link *prev;
+};
+
+/* Read argument number 'n' of 't', after the < or the , before it, and the
+ * rest after it. Return 't' with its arguments, canonical. */
+static struct type *
+read_argument(struct type *t, struct arg_link *prev, size_t n,
+              struct lex *lex, struct env *env)
+{
+        struct arg_link link;
+        struct type *buf[8], **args = buf, *canon;
+        struct token *token;
+        size_t i;
+
+        link.type = parse_type(lex, env);
+        link.prev = prev;
+
+        token = lexer_next(lex);
+        if (token_is_id(token, TOK_SHR)) {
+                /* Take the first > of >>, and leave the second to close the
+                 * enclosing argument list */
+                lexer_split(lex);
+        } else if (!token) {
+                cerror_eof(lex, "expected , or >");
+        } else if (token_is_id(token, TOK_COMMA)) {
+                return read_argument(t, &link, n + 1, lex, env);
+        } else if (!token_is_id(token, TOK_GT)) {
+                cerror_after(lex, lexer_last(lex), "expected ,");
         }
 
-        /* From base name we can get much information */
-        init_enc_size(t, env);
+        /* That was the last one */
+        if (n + 1 > sizeof (buf) / sizeof (buf[0])) {
+                args = malloc((n + 1) * sizeof (*args));
+                if (!args) error_errno();
+        }
+        for (i = n + 1, prev = &link; i--; prev = prev->prev)
+                args[i] = prev->type;
+        t->args = args;
+        t->n_args = n + 1;
+        canon = get_ty(t);
+        if (args != buf)
+                free(args);
+        return canon;
 }
 
-static void
+static struct type *
 do_arguments(struct type *t, struct lex *lex, struct env *env)
 {
-        struct type *temp, *last_argument;
-        struct token *args_token, *token;
+        struct token *args_token;
 
         /* Arguments */
         args_token = lexer_peek(lex);
-        if (!token_is(args_token, T_OPER, "<"))
-                return;
+        if (!token_is_id(args_token, TOK_LT))
+                return get_ty(t);
 
         if (t->enc != OBJECT) {
                 cerror_at(lex, args_token,
@@ -92,29 +124,7 @@ do_arguments(struct type *t, struct lex *lex, struct env *env)
         }
 
         lexer_next(lex);
-        t->child_type = last_argument = NULL;
-        while (1) {
-                temp = parse_type(lex, env);
-                if (last_argument) {
-                        last_argument->sibling_type = temp;
-                } else {
-                        t->child_type = last_argument = temp;
-                }
-                token = lexer_next(lex);
-                if (token_is(token, T_OPER, ">")) {
-                        break;
-                } else if (token_is(token, T_OPER, ">>")) {
-                        /* Rewrite >> to > */
-                        token->value[1] = 0;
-                        ++token->col;
-                        break;
-                } else if (!token) {
-                        cerror_eof(lex, "expected , or >");
-                } else if (!token_is(token, T_OPER, ",")) {
-                        cerror_after(lex, lexer_last(lex),
-                                     "expected ,");
-                }
-        }
+        return read_argument(t, NULL, 0, lex, env);
 }
 
 static struct type *
@@ -124,24 +134,24 @@ do_modifiers(struct type *t, struct lex *lex, struct env *env)
 
         while (1) {
                 token = lexer_peek(lex);
-                if (token_is(token, T_OPER, "*")) {
+                if (token_is_id(token, TOK_MUL)) {
                         t = get_ty_pointer (t, env);
                         lexer_next(lex);
 
-                } else if (token_is(token, T_OPER, "[")) {
+                } else if (token_is_id(token, TOK_LBRACKET)) {
                         lexer_next(lex);
                         struct token *token2 = lexer_next(lex);
                         if (!token2)
                                 cerror_eof(lex, "expected ]");
-                        else if (!token_is(token2, T_OPER, "]"))
+                        else if (!token_is_id(token2, TOK_RBRACKET))
                                 cerror_after(lex, token, "expected ]");
                         t = get_ty_array(t, env);
 
-                } else if (token_is(token, T_WORD, "const")) {
-                        t->is_const = 1;
+                } else if (token_is_id(token, TOK_CONST)) {
+                        t = get_ty_qualified(t, 1, 0);
                         lexer_next(lex);
-                } else if (token_is(token, T_WORD, "volatile")) {
-                        t->is_volatile = 1;
+                } else if (token_is_id(token, TOK_VOLATILE)) {
+                        t = get_ty_qualified(t, 0, 1);
                         lexer_next(lex);
                 } else
                         break;
@@ -152,16 +162,11 @@ do_modifiers(struct type *t, struct lex *lex, struct env *env)
 struct type *
 parse_type(struct lex *lex, struct env *env)
 {
-        struct type *t;
-
-        t = malloc(sizeof (*t));
-        if (!t) error_errno();
+        struct type t;
 
-        do_base_name(t, lex, env);
+        memset(&t, 0, sizeof (t));
 
-        do_arguments(t, lex, env);
+        do_base_name(&t, lex, env);
 
-        t = do_modifiers(t, lex, env);
-        
-        return t;
+        return do_modifiers(do_arguments(&t, lex, env), lex, env);
 }
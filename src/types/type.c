@@ -2,28 +2,30 @@
 
 #include "type.h"
 #include "../error.h"
+#include "../intern.h"
+#include "../arena.h"
 #include <assert.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
+#include <pthread.h>
 
-static struct type _ty_i8   = {SINT,  1, 0, 0, NULL, NULL, "i8", 0};
-static struct type _ty_i16  = {SINT,  2, 0, 0, NULL, NULL, "i16", 0};
-static struct type _ty_i32  = {SINT,  4, 0, 0, NULL, NULL, "int", 0};
-static struct type _ty_i64  = {SINT,  8, 0, 0, NULL, NULL, "i64", 0};
-static struct type _ty_u8   = {SINT,  1, 0, 0, NULL, NULL, "u8", 0};
-static struct type _ty_u16  = {SINT,  2, 0, 0, NULL, NULL, "u16", 0};
-static struct type _ty_u32  = {SINT,  4, 0, 0, NULL, NULL, "unsigned", 0};
-static struct type _ty_u64  = {SINT,  8, 0, 0, NULL, NULL, "u64", 0};
-static struct type _ty_f16  = {FLOAT, 2, 0, 0, NULL, NULL, "f16", 0};
-static struct type _ty_f32  = {FLOAT, 4, 0, 0, NULL, NULL, "float", 0};
-static struct type _ty_f64  = {FLOAT, 8, 0, 0, NULL, NULL, "double", 0};
-static struct type _ty_bool = {BOOL,  1, 0, 0, NULL, NULL, "bool", 0};
-static struct type _ty_null = {NULLT, 1, 0, 0, NULL, NULL, "#null#", 0};
-
-static struct type _ty_ssize_32 = {SINT, 4, 0, 0, NULL, NULL, "ssize", 0};
-static struct type _ty_ssize_64 = {SINT, 8, 0, 0, NULL, NULL, "ssize", 0};
-static struct type _ty_size_32  = {UINT, 4, 0, 0, NULL, NULL, "size", 0};
-static struct type _ty_size_64  = {UINT, 8, 0, 0, NULL, NULL, "size", 0};
+/* A standard type, with no qualifiers, child or arguments */
+#define BASIC(enc, size, name) {enc, 0, 0, size, 0, NULL, NULL, name}
+
+static struct type _ty_i8   = BASIC (SINT, 1, "i8");
+static struct type _ty_i16  = BASIC (SINT, 2, "i16");
+static struct type _ty_i32  = BASIC (SINT, 4, "i32");
+static struct type _ty_i64  = BASIC (SINT, 8, "i64");
+static struct type _ty_u8   = BASIC (UINT, 1, "u8");
+static struct type _ty_u16  = BASIC (UINT, 2, "u16");
+static struct type _ty_u32  = BASIC (UINT, 4, "u32");
+static struct type _ty_u64  = BASIC (UINT, 8, "u64");
+static struct type _ty_f16  = BASIC (FLOAT, 2, "f16");
+static struct type _ty_f32  = BASIC (FLOAT, 4, "f32");
+static struct type _ty_f64  = BASIC (FLOAT, 8, "f64");
+static struct type _ty_bool = BASIC (BOOL, 1, "bool");
+static struct type _ty_null = BASIC (NULLT, 1, "#null#");
 
 struct type *ty_i8   = &_ty_i8;
 struct type *ty_i16  = &_ty_i16;
@@ -39,109 +41,232 @@ struct type *ty_f64  = &_ty_f64;
 struct type *ty_bool = &_ty_bool;
 struct type *ty_null = &_ty_null;
 
-struct type *get_ty_ssize (struct env *env)
+/* The canonical types are kept in an open-addressed table, with linear
+ * probing; NULL marks an empty slot. All but the standard types, which are
+ * static, live in 'nodes'. Types are made by parallel jobs (see jobs.h), so
+ * the table and arena are locked while they are used. */
+static struct type **table = NULL;
+static size_t table_size = 0, n_types = 0;
+static struct arena nodes;
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* FNV-1a, a word at a time. Child and argument types are canonical, and names
+ * interned, so their addresses stand for their contents. */
+static uint32_t hash_type (const struct type *T)
 {
-  assert (env->bits == 32 || env->bits == 64);
-  return env->bits == 32 ? &_ty_ssize_32 : &_ty_ssize_64;
+  uint64_t h = 14695981039346656037u;
+  size_t i;
+
+#define MIX(x) (h = (h ^ (uint64_t) (x)) * 1099511628211u)
+  MIX (T->enc | T->is_const << 4 | T->is_volatile << 5 |
+       (uint64_t) T->size << 6);
+  MIX ((uintptr_t) T->name);
+  MIX ((uintptr_t) T->child_type);
+  for (i = 0; i < T->n_args; ++i)
+    MIX ((uintptr_t) T->args[i]);
+#undef MIX
+  return (uint32_t) (h ^ h >> 32);
 }
 
-struct type *get_ty_size (struct env *env)
+static int same_type (const struct type *A, const struct type *B)
 {
-  assert (env->bits == 32 || env->bits == 64);
-  return env->bits == 32 ? &_ty_size_32 : &_ty_size_64;
+  size_t i;
+
+  if (A->enc != B->enc || A->size != B->size || A->is_const != B->is_const ||
+      A->is_volatile != B->is_volatile || A->name != B->name ||
+      A->child_type != B->child_type || A->n_args != B->n_args)
+    return 0;
+  for (i = 0; i < A->n_args; ++i)
+    if (A->args[i] != B->args[i])
+      return 0;
+  return 1;
 }
 
-struct type *get_ty_pointer (struct type *T, struct env *env)
+/* Find the slot for T: either the slot holding its canonical type, or the
+ * empty slot where that would go */
+static struct type **find_slot (const struct type *T, uint32_t hash)
 {
-  struct type *ty_ptr = malloc (sizeof (*ty_ptr));
-  if (!ty_ptr) error_errno ();
-  ty_ptr->enc = POINTER;
-  ty_ptr->size = env->bits / 8;
-  ty_ptr->is_const = 0;
-  ty_ptr->is_volatile = 0;
-  ty_ptr->child_type = T;
-  ty_ptr->sibling_type = NULL;
-  ty_ptr->was_malloced = 1;
-
-  /* Copy T->name with an asterisk appended */
-  size_t name_len = strlen (T->name);
-  if (name_len + 1 > TYPE_NAME_MAX) {
-    error_message ("internal error: type name '%s*' is "
-                   "too long for name buffer - sorry...", T->name);
+  size_t i;
+
+  for (i = hash & (table_size - 1); table[i];
+       i = (i + 1) & (table_size - 1)) {
+    if (same_type (table[i], T))
+      break;
   }
-  
-  memcpy (ty_ptr->name, T->name, name_len);
-  ty_ptr->name[name_len] = '*';
-  ty_ptr->name[name_len + 1] = 0;
+  return &table[i];
+}
 
-  return ty_ptr;
+/* Double the size of the table */
+static void grow_table (void)
+{
+  struct type **old = table;
+  size_t old_size = table_size, i;
+
+  table_size = old_size ? 2 * old_size : 256;
+  table = calloc (table_size, sizeof (*table));
+  if (!table) error_errno ();
+  for (i = 0; i < old_size; ++i) {
+    if (old[i])
+      *find_slot (old[i], hash_type (old[i])) = old[i];
+  }
+  free (old);
 }
 
-struct type *get_ty_array (struct type *T, struct env *env)
+/* Put T in the table as it is. Call with the table locked. */
+static void add_type (struct type *T, uint32_t hash)
+{
+  /* Keep the table at most three quarters full */
+  if (4 * (n_types + 1) > 3 * table_size)
+    grow_table ();
+  *find_slot (T, hash) = T;
+  ++n_types;
+}
+
+void types_init (void)
 {
-  struct type *ty_arr = malloc (sizeof (*ty_arr));
-  if (!ty_arr) error_errno ();
-  ty_arr->enc = ARRAY;
-  ty_arr->size = env->bits / 8;
-  ty_arr->is_const = 0;
-  ty_arr->is_volatile = 0;
-  ty_arr->child_type = T;
-  ty_arr->sibling_type = NULL;
-  ty_arr->was_malloced = 1;
-
-  /* Copy T->name with [] appended */
-  size_t name_len = strlen (T->name);
-  if (name_len + 2 > TYPE_NAME_MAX) {
-    error_message ("internal error: type name '%s[]' is too long for name "
-                   "buffer - sorry...", T->name);
+  static struct type *const all[] = {
+    &_ty_i8, &_ty_i16, &_ty_i32, &_ty_i64, &_ty_u8, &_ty_u16, &_ty_u32,
+    &_ty_u64, &_ty_f16, &_ty_f32, &_ty_f64, &_ty_bool, &_ty_null };
+  size_t i;
+
+  arena_init (&nodes);
+  for (i = 0; i < sizeof (all) / sizeof (all[0]); ++i) {
+    all[i]->name = intern_static (all[i]->name);
+    add_type (all[i], hash_type (all[i]));
   }
+}
 
-  memcpy (ty_arr->name, T->name, name_len);
-  ty_arr->name[name_len] = '[';
-  ty_arr->name[name_len + 1] = ']';
-  ty_arr->name[name_len + 2] = 0;
+void types_free (void)
+{
+  arena_free (&nodes);
+  free (table);
+  table = NULL;
+  table_size = n_types = 0;
+}
+
+struct type *get_ty (const struct type *T)
+{
+  uint32_t hash = hash_type (T);
+  struct type **slot, *canon, **args;
 
-  return ty_arr;
+  pthread_mutex_lock (&lock);
+  slot = find_slot (T, hash);
+  if (*slot) {
+    canon = *slot;
+    pthread_mutex_unlock (&lock);
+    return canon;
+  }
+
+  canon = arena_alloc (&nodes, sizeof (*canon));
+  *canon = *T;
+  if (T->n_args) {
+    args = arena_alloc (&nodes, T->n_args * sizeof (*args));
+    memcpy (args, T->args, T->n_args * sizeof (*args));
+    canon->args = args;
+  }
+  add_type (canon, hash);
+
+  pthread_mutex_unlock (&lock);
+  return canon;
+}
+
+struct type *get_ty_standard (enum type_encoding enc, size_t size)
+{
+  switch (enc) {
+  case SINT:
+    return size == 1 ? ty_i8 : size == 2 ? ty_i16 : size == 4 ? ty_i32
+      : size == 8 ? ty_i64 : NULL;
+  case UINT:
+    return size == 1 ? ty_u8 : size == 2 ? ty_u16 : size == 4 ? ty_u32
+      : size == 8 ? ty_u64 : NULL;
+  case FLOAT:
+    return size == 2 ? ty_f16 : size == 4 ? ty_f32 : size == 8 ? ty_f64
+      : NULL;
+  case BOOL:
+    return size == 1 ? ty_bool : NULL;
+  default:
+    return NULL;
+  }
+}
+
+struct type *get_ty_ssize (struct env *env)
+{
+  assert (env->bits == 32 || env->bits == 64);
+  return env->bits == 32 ? ty_i32 : ty_i64;
+}
+
+struct type *get_ty_size (struct env *env)
+{
+  assert (env->bits == 32 || env->bits == 64);
+  return env->bits == 32 ? ty_u32 : ty_u64;
 }
 
-/* See below for description */
-static struct type *_copy_ty (struct type *T, int follow_sibs)
+struct type *get_ty_pointer (struct type *T, struct env *env)
 {
-  struct type *new_ty;
-  if (!T) return NULL;
+  struct type ty_ptr = {POINTER, 0, 0, 0, 0, NULL, NULL, NULL};
 
-  new_ty = malloc (sizeof (*new_ty));
-  if (!new_ty) error_errno ();
+  ty_ptr.size = env->bits / 8;
+  ty_ptr.child_type = T;
+  return get_ty (&ty_ptr);
+}
 
-  /* Most items can be directly copied */
-  memcpy (new_ty, T, sizeof (*new_ty));
+struct type *get_ty_array (struct type *T, struct env *env)
+{
+  struct type ty_arr = {ARRAY, 0, 0, 0, 0, NULL, NULL, NULL};
 
-  new_ty->was_malloced = 1;
-  new_ty->child_type = _copy_ty (new_ty->child_type, 1);
-  if (follow_sibs)
-    new_ty->sibling_type = _copy_ty (new_ty->sibling_type, 1);
-  else
-    new_ty->sibling_type = NULL;
+  ty_arr.size = env->bits / 8;
+  ty_arr.child_type = T;
+  return get_ty (&ty_arr);
+}
 
-  return new_ty;
+struct type *get_ty_qualified (struct type *T, int _const, int _volatile)
+{
+  struct type new_ty = *T;
+
+  if (_const)
+    new_ty.is_const = _const > 0;
+  if (_volatile)
+    new_ty.is_volatile = _volatile > 0;
+  if (new_ty.is_const == T->is_const && new_ty.is_volatile == T->is_volatile)
+    return T;
+  return get_ty (&new_ty);
 }
 
-struct type *copy_ty (struct type *T, int _const, int _volatile)
+/* Append 's' at buf[at], for type_format (). Returns the length of 's'. */
+static size_t format_put (char *buf, size_t size, size_t at, const char *s)
 {
-  /* Recursively copy T through its child types. We don't want to follow its
-   * siblings, but we DO want to follow its childrens' siblings, so _copy_ty
-   * allows this choice. */
-  struct type *new_ty = _copy_ty (T, 0);
+  size_t len = strlen (s), n;
 
-  if (_const < 0)
-    new_ty->is_const = 0;
-  else if (_const > 0)
-    new_ty->is_const = 1;
+  if (at < size) {
+    n = len < size - at - 1 ? len : size - at - 1;
+    memcpy (buf + at, s, n);
+    buf[at + n] = 0;
+  }
+  return len;
+}
 
-  if (_volatile < 0)
-    new_ty->is_volatile = 0;
-  else if (_volatile > 0)
-    new_ty->is_volatile = 1;
+size_t type_format (struct type *T, char *buf, size_t size)
+{
+  size_t n = 0, i;
 
-  return new_ty;
+  if (size) buf[0] = 0;
+  if (T->enc == POINTER || T->enc == ARRAY) {
+    n += type_format (T->child_type, buf, size);
+    n += format_put (buf, size, n, T->enc == POINTER ? "*" : "[]");
+  } else {
+    n += format_put (buf, size, n, T->name);
+    if (T->n_args) {
+      n += format_put (buf, size, n, "<");
+      for (i = 0; i < T->n_args; ++i) {
+        if (i)
+          n += format_put (buf, size, n, ", ");
+        n += type_format (T->args[i], n < size ? buf + n : NULL,
+                          n < size ? size - n : 0);
+      }
+      n += format_put (buf, size, n, ">");
+    }
+  }
+  if (T->is_const) n += format_put (buf, size, n, " const");
+  if (T->is_volatile) n += format_put (buf, size, n, " volatile");
+  return n;
 }
@@ -5,51 +5,82 @@
 
 #include "../env.h"
 #include "../lex/lex.h"
-
-#define TYPE_NAME_MAX 255
+#include <stdint.h>
 
 /* Alpha type encodings */
 enum type_encoding {
   UINT, SINT, BOOL, FLOAT, ARRAY, POINTER, OBJECT, NULLT
 };
 
+/* Types are canonical: structurally equal types - same encoding, size,
+ * qualifiers, name, child and arguments - are always the same node, so types
+ * can be compared with ==, and each distinct type is stored once however
+ * often it is mentioned. An alias is the type it stands for: int is i32 (see
+ * get_ty_standard ()). Nodes are shared, so never modify one; get another with
+ * get_ty_pointer (), get_ty_qualified () and friends instead. They live until
+ * types_free (). */
 struct type {
-  enum type_encoding enc;
+  /* enum type_encoding */
+  unsigned enc : 4;
+
+  unsigned is_const : 1;
+  unsigned is_volatile : 1;
 
   /* Size in bytes of the value - for example, u32 would have UINT type,
    * 4 size */
-  int size;
+  unsigned size : 26;
 
-  int is_const;
-  int is_volatile;
+  uint32_t n_args;
 
-  /* Used to link together complex types. For example:
+  /* What a POINTER or ARRAY points to or holds. For example:
    * int*[] : ARRAY -(child)-> POINTER -(child)-> i32
-   * map<string, int> : OBJECT[map] -(child)-> OBJECT[string] -(sibling)-> i32
    */
-  struct type *child_type, *sibling_type;
+  struct type *child_type;
 
-  /* Type name */
-  char name[TYPE_NAME_MAX + 1];
+  /* An OBJECT's arguments, in order. For example:
+   * map<string, int> : OBJECT[map], args {OBJECT[string], i32}
+   */
+  struct type *const *args;
 
-  /* Whether the type was malloc()ed - used by type_free () */
-  int was_malloced;
+  /* Base name - interned (see intern.h), so names compare with ==. NULL for
+   * POINTER and ARRAY, which are named after their child; type_format ()
+   * spells out the whole name when one is needed. */
+  const char *name;
 };
 
 /* Some standard types to avoid constantly allocating new ones */
-struct type *ty_i8;
-struct type *ty_i16;
-struct type *ty_i32;
-struct type *ty_i64;
-struct type *ty_u8;
-struct type *ty_u16;
-struct type *ty_u32;
-struct type *ty_u64;
-struct type *ty_f16;
-struct type *ty_f32;
-struct type *ty_f64;
-struct type *ty_bool;
-struct type *ty_null;
+extern struct type *ty_i8;
+extern struct type *ty_i16;
+extern struct type *ty_i32;
+extern struct type *ty_i64;
+extern struct type *ty_u8;
+extern struct type *ty_u16;
+extern struct type *ty_u32;
+extern struct type *ty_u64;
+extern struct type *ty_f16;
+extern struct type *ty_f32;
+extern struct type *ty_f64;
+extern struct type *ty_bool;
+extern struct type *ty_null;
+
+/* Intern the names of the standard types, and make them canonical. Call once
+ * at startup, before any types are parsed. */
+void types_init (void);
+
+/* Free every type but the standard ones. This is only for leak checking - see
+ * free_on_exit.h. */
+void types_free (void);
+
+/* The canonical type structurally equal to T, whose child and arguments must
+ * be canonical already. T itself is not kept; it may be a temporary. Exit on
+ * error. */
+struct type *get_ty (const struct type *T);
+
+/* The standard type of encoding 'enc' and 'size' bytes, or NULL if there is
+ * none. Every builtin scalar type is one of these: int is i32, unsigned u32,
+ * float f32 and double f64, and ssize and size are the i and u types of the
+ * target's word. */
+struct type *get_ty_standard (enum type_encoding enc, size_t size);
 
 /* Get the 'size' and 'ssize' types */
 struct type *get_ty_ssize (struct env *env);
@@ -64,13 +95,15 @@ struct type *get_ty_pointer (struct type *T, struct env *env);
 /* Get type T[] for a given type T. Exit on error. */
 struct type *get_ty_array (struct type *T, struct env *env);
 
-/* Make a copy, recursively, of type T:
+/* Get type T with its qualifiers changed:
  * _const: -1: not const, 0: same constness, 1: const
  * _volatile: -1: not volatile, 0: same volatility, 1: volatile
- */
-struct type *copy_ty (struct type *T, int _const, int _volatile);
+ * Exit on error. */
+struct type *get_ty_qualified (struct type *T, int _const, int _volatile);
 
-/* Free a type, recursively, if necessary. */
-void type_free (struct type *T);
+/* Spell out type T in full, as in "map<string, int*[]> const", snprintf ()
+ * style: write at most 'size' bytes (NUL included) to 'buf', and return the
+ * length of the whole name. */
+size_t type_format (struct type *T, char *buf, size_t size);
 
 #endif /* _TYPES_TYPE_H */
@@ -0,0 +1,58 @@
+// NAME Operator precedence and associativity
+// COMPILE ["-pre-ast"]
+// CEXIT 0
+// COUT (package "tprec"
+// COUT   (function "f" void ()
+// COUT     (scope
+// COUT       (binary "="
+// COUT         (name "a")
+// COUT         (binary "="
+// COUT           (name "b")
+// COUT           (binary "-"
+// COUT             (binary "-"
+// COUT               (name "c")
+// COUT               (name "d"))
+// COUT             (binary "*"
+// COUT               (name "e")
+// COUT               (name "f")))))
+// COUT       (binary "="
+// COUT         (name "x")
+// COUT         (binary "||"
+// COUT           (name "p")
+// COUT           (binary "&&"
+// COUT             (name "q")
+// COUT             (binary "=="
+// COUT               (name "r")
+// COUT               (binary "<"
+// COUT                 (name "s")
+// COUT                 (binary "<<"
+// COUT                   (name "t")
+// COUT                   (name "u")))))))
+// COUT       (binary "="
+// COUT         (name "m")
+// COUT         (conditional
+// COUT           (name "a")
+// COUT           (name "b")
+// COUT           (conditional
+// COUT             (name "c")
+// COUT             (name "d")
+// COUT             (name "e"))))
+// COUT       (binary "="
+// COUT         (name "n")
+// COUT         (binary "*"
+// COUT           (prefix "-"
+// COUT             (name "a"))
+// COUT           (binary "+"
+// COUT             (name "b")
+// COUT             (name "c")))))))
+
+// Assignment is right associative, and the rest of the binary operators left
+// associative; each level binds tighter than the one above it
+package tprec;
+
+void f () {
+    a = b = c - d - e * f;
+    x = p || q && r == s < t << u;
+    m = a ? b : c ? d : e;
+    n = -a * (b + c);
+}
@@ -0,0 +1,23 @@
+// NAME Nested generics closed by >>
+// COMPILE ["-pre-ast"]
+// CEXIT 0
+// COUT (package "tgen"
+// COUT   (function "f" void ()
+// COUT     (scope
+// COUT       (var list<list<i32>> "a")
+// COUT       (var map<string, list<list<i32>>> "b")
+// COUT       (var map<list<i32>, i32> "c"
+// COUT         (binary ">>"
+// COUT           (name "x")
+// COUT           (int 2)))
+// COUT       (var list<list<i32>*> "d"))))
+
+// A >> closes two argument lists, and is still a shift in an expression
+package tgen;
+
+void f () {
+    list<list<int>> a;
+    map<string, list<list<int>>> b;
+    map<list<int>, int> c = x >> 2;
+    list<list<int>*> d;
+}
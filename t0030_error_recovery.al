@@ -0,0 +1,25 @@
+// NAME Recovery from several errors in one file
+// COMPILE []
+// CEXIT 1
+// CERR t0030_error_recovery.al:15:9: error: expected expression
+// CERR t0030_error_recovery.al:17:9: error: expected )
+// CERR t0030_error_recovery.al:20:16: error: expected type name
+// CERR t0030_error_recovery.al:24:12: error: extrastandard identifier must start with $$
+// CERR t0030_error_recovery.al:24:9: error: expected ;
+
+// Each error is reported, and the parser goes on from the next statement or
+// declaration
+package terr;
+
+void f () {
+    x = ;
+    y = 1;
+    if (x { }
+}
+
+void g (int a, ) {
+}
+
+void h () {
+    a = 1 $ 2;
+}
@@ -0,0 +1,50 @@
+// NAME -ferror-limit stops a file after that many errors
+// COMPILE ["-ferror-limit=3"]
+// CEXIT 1
+// CERR t0031_error_limit.al:13:9: error: expected expression
+// CERR t0031_error_limit.al:14:9: error: expected expression
+// CERR t0031_error_limit.al:18:9: error: expected expression
+// CERR t0031_error_limit.al: too many errors, stopping now
+
+// The third error is the last reported, and the file is given up on
+package tlimit;
+
+void f0 () {
+    x = ;
+    y = ;
+}
+
+void f1 () {
+    x = ;
+    y = ;
+}
+
+void f2 () {
+    x = ;
+    y = ;
+}
+
+void f3 () {
+    x = ;
+    y = ;
+}
+
+void f4 () {
+    x = ;
+    y = ;
+}
+
+void f5 () {
+    x = ;
+    y = ;
+}
+
+void f6 () {
+    x = ;
+    y = ;
+}
+
+void f7 () {
+    x = ;
+    y = ;
+}
@@ -0,0 +1,51 @@
+// NAME -ferror-limit counts the errors of bodies parsed in parallel together
+// COMPILE ["-ferror-limit=3", "-j4"]
+// CEXIT 1
+// CERR t0032_error_limit_jobs.al:14:9: error: expected expression
+// CERR t0032_error_limit_jobs.al:15:9: error: expected expression
+// CERR t0032_error_limit_jobs.al:19:9: error: expected expression
+// CERR t0032_error_limit_jobs.al: too many errors, stopping now
+
+// The limit is applied to the bodies' errors in the order of the file, so the
+// same three are reported as without -j, in this order, and the limit once
+package tlimit;
+
+void f0 () {
+    x = ;
+    y = ;
+}
+
+void f1 () {
+    x = ;
+    y = ;
+}
+
+void f2 () {
+    x = ;
+    y = ;
+}
+
+void f3 () {
+    x = ;
+    y = ;
+}
+
+void f4 () {
+    x = ;
+    y = ;
+}
+
+void f5 () {
+    x = ;
+    y = ;
+}
+
+void f6 () {
+    x = ;
+    y = ;
+}
+
+void f7 () {
+    x = ;
+    y = ;
+}
@@ -0,0 +1,26 @@
+// NAME Recovery from several errors, with bodies parsed in parallel
+// COMPILE ["-j4"]
+// CEXIT 1
+// CERR t0033_error_recovery_jobs.al:16:9: error: expected expression
+// CERR t0033_error_recovery_jobs.al:18:9: error: expected )
+// CERR t0033_error_recovery_jobs.al:21:16: error: expected type name
+// CERR t0033_error_recovery_jobs.al:25:12: error: extrastandard identifier must start with $$
+// CERR t0033_error_recovery_jobs.al:25:9: error: expected ;
+
+// Each error is reported, and the parser goes on from the next statement or
+// declaration. The errors come out in this order, as without -j: the
+// declaration's between the bodies', and the lexer's in with the parser's.
+package terr;
+
+void f () {
+    x = ;
+    y = 1;
+    if (x { }
+}
+
+void g (int a, ) {
+}
+
+void h () {
+    a = 1 $ 2;
+}
@@ -0,0 +1,16 @@
+// NAME A cache miss, then a hit on the same file
+// COMPILE ["-cache-dir=build/t0050_cache", "-cache-clear"]
+// COMPILE ["-cache-dir=build/t0050_cache", "-cache-stats"]
+// CEXIT 0
+// CERR build/t0050_cache: 1 hits, 0 misses, 0 stored, 0 evicted
+
+// The COMPILE lines are run in order, and the last is checked. The first
+// starts from an empty cache, so the file is lexed, parsed and stored; the
+// second reads it back. The cache is the test's own, in the build directory,
+// and an executable has no interface to write.
+executable tcache;
+
+void f () {
+    list<list<int>> l;
+    x = y >> 2;
+}
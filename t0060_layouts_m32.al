@@ -0,0 +1,56 @@
+// NAME Record and class layouts with -m32
+// COMPILE ["-m32", "-dump-layouts"]
+// CEXIT 0
+// COUT t0060_layouts_m32.al:
+// COUT record Point: size 24, align 4, 5 bytes padding
+// COUT   offset  size  align  field
+// COUT        0     1      1  i8 tag
+// COUT        1     3         (padding)
+// COUT        4     8      4  f64 x
+// COUT       12     2      2  i16 kind
+// COUT       14     2         (padding)
+// COUT       16     8      4  f64 y
+// COUT
+// COUT record Entry: size 20, align 4, 0 bytes padding (reordered from 28)
+// COUT   offset  size  align  field
+// COUT        0     4      4  u32 hits @hot
+// COUT        4     4      4  Point* next @hot
+// COUT        8     8      4  i64 key
+// COUT       16     2      2  u16 slot
+// COUT       18     1      1  u8 flags
+// COUT       19     1      1  bool live
+// COUT
+// COUT class Node: size 36, align 4, 3 bytes padding (reordered from 36)
+// COUT   offset  size  align  field
+// COUT        0     4      4  Node parent @hot
+// COUT        4     4      4  i32 depth
+// COUT        8    24      4  Point at
+// COUT       32     1      1  bool leaf
+// COUT       33     3         (padding)
+
+// Point is laid out as declared. Entry and Node are reordered: the @hot
+// fields first, then the rest, each group leaving as little padding as it can
+package tlayout;
+
+record Point {
+    i8 tag;
+    f64 x;
+    i16 kind;
+    f64 y;
+}
+
+@reorder record Entry {
+    u8 flags;
+    i64 key;
+    @hot u32 hits;
+    u16 slot;
+    @hot Point* next;
+    bool live;
+}
+
+@reorder class Node {
+    bool leaf;
+    @hot Node parent;
+    int depth;
+    Point at;
+}
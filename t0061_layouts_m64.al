@@ -0,0 +1,56 @@
+// NAME Record and class layouts with -m64
+// COMPILE ["-m64", "-dump-layouts"]
+// CEXIT 0
+// COUT t0061_layouts_m64.al:
+// COUT record Point: size 32, align 8, 13 bytes padding
+// COUT   offset  size  align  field
+// COUT        0     1      1  i8 tag
+// COUT        1     7         (padding)
+// COUT        8     8      8  f64 x
+// COUT       16     2      2  i16 kind
+// COUT       18     6         (padding)
+// COUT       24     8      8  f64 y
+// COUT
+// COUT record Entry: size 24, align 8, 0 bytes padding (reordered from 40)
+// COUT   offset  size  align  field
+// COUT        0     8      8  Point* next @hot
+// COUT        8     4      4  u32 hits @hot
+// COUT       12     2      2  u16 slot
+// COUT       14     1      1  u8 flags
+// COUT       15     1      1  bool live
+// COUT       16     8      8  i64 key
+// COUT
+// COUT class Node: size 48, align 8, 3 bytes padding (reordered from 56)
+// COUT   offset  size  align  field
+// COUT        0     8      8  Node parent @hot
+// COUT        8    32      8  Point at
+// COUT       40     4      4  i32 depth
+// COUT       44     1      1  bool leaf
+// COUT       45     3         (padding)
+
+// Point is laid out as declared. Entry and Node are reordered: the @hot
+// fields first, then the rest, each group leaving as little padding as it can
+package tlayout;
+
+record Point {
+    i8 tag;
+    f64 x;
+    i16 kind;
+    f64 y;
+}
+
+@reorder record Entry {
+    u8 flags;
+    i64 key;
+    @hot u32 hits;
+    u16 slot;
+    @hot Point* next;
+    bool live;
+}
+
+@reorder class Node {
+    bool leaf;
+    @hot Node parent;
+    int depth;
+    Point at;
+}
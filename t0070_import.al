@@ -0,0 +1,15 @@
+// NAME A file imports a package compiled before it, from a -P directory
+// COMPILE ["-Pbuild", "t0070_import/timported.al"]
+// COMPILE ["-Pbuild"]
+// CEXIT 0
+
+// The first run compiles the package, which writes build/timported.ali; the
+// second compiles only this file, so the import can only be resolved by
+// loading that interface. Without it, the compilation would fail as
+// t0071_import_missing.al does.
+executable timport;
+import timported;
+
+void f () {
+    a = twice (2);
+}
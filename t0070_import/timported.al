@@ -0,0 +1,6 @@
+// The package which t0070_import.al imports; not a test itself.
+package timported;
+
+int twice (int x) {
+    return x + x;
+}
@@ -0,0 +1,11 @@
+// NAME Importing a package with no interface in any -P directory
+// COMPILE ["-Pbuild"]
+// CEXIT 1
+// CERR t0071_import_missing.al: cannot find package tnowhere
+
+// Neither build/ nor the directory of this file has tnowhere.ali.
+executable tmissing;
+import tnowhere;
+
+void f () {
+}